@@ -0,0 +1,510 @@
+#include "easy/base/BinaryLog.h"
+#include "easy/base/Atomic.h"
+#include "easy/base/FileUtil.h"
+#include "easy/base/LogFormatter.h"
+#include "easy/base/Logger.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <fstream>
+#include <iterator>
+
+namespace easy
+{
+BinaryLogSite::BinaryLogSite(LogLevel level, const char* file, int32_t line, const char* function, const char* format)
+    : level_(level), file_(file), line_(line), function_(function), format_(format)
+{
+    static AtomicInt<uint32_t> s_id;
+    id_ = s_id.incrementAndFetch();
+}
+
+namespace
+{
+// appends one entry, the length is filled in when it goes away
+class EntryWriter : noncopyable
+{
+  public:
+    EntryWriter(LogLine& line, BinaryLog::Kind kind) : line_(line), start_(line.length())
+    {
+        put(static_cast<uint32_t>(0));
+        put(static_cast<uint8_t>(kind));
+    }
+
+    ~EntryWriter()
+    {
+        uint32_t length = static_cast<uint32_t>(line_.length() - start_);
+        memcpy(line_.data() + start_, &length, sizeof(length));
+    }
+
+    template <typename T>
+    void put(T v)
+    {
+        memcpy(line_.reserve(sizeof(v)), &v, sizeof(v));
+        line_.commit(sizeof(v));
+    }
+
+    void putString(const char* s, size_t n)
+    {
+        put(static_cast<uint32_t>(n));
+        line_.append(s, n);
+    }
+
+    void putString(const char* s) { putString(s, strlen(s)); }
+
+  private:
+    LogLine& line_;
+    size_t   start_;
+};
+
+// reads the fields of an entry or of the args, ok() is false once one was cut
+class EntryReader
+{
+  public:
+    EntryReader(const char* data, size_t length) : cur_(data), end_(data + length) {}
+
+    template <typename T>
+    T get()
+    {
+        T v = T();
+        if (static_cast<size_t>(end_ - cur_) < sizeof(v))
+        {
+            ok_  = false;
+            cur_ = end_;
+            return v;
+        }
+        memcpy(&v, cur_, sizeof(v));
+        cur_ += sizeof(v);
+        return v;
+    }
+
+    // the bytes stay in the entry
+    const char* getString(size_t& n)
+    {
+        n = get<uint32_t>();
+        if (static_cast<size_t>(end_ - cur_) < n)
+        {
+            ok_  = false;
+            n    = 0;
+            cur_ = end_;
+        }
+        const char* s = cur_;
+        cur_ += n;
+        return s;
+    }
+
+    std::string getString()
+    {
+        size_t      n;
+        const char* s = getString(n);
+        return std::string(s, n);
+    }
+
+    bool ok() const { return ok_; }
+
+    bool done() const { return cur_ == end_; }
+
+    const char* current() const { return cur_; }
+
+    size_t left() const { return static_cast<size_t>(end_ - cur_); }
+
+  private:
+    const char* cur_;
+    const char* end_;
+    bool        ok_{true};
+};
+
+struct Arg
+{
+    BinaryLogArgs::Type type;
+    int64_t             i;
+    uint64_t            u;
+    double              d;
+    const char*         s;
+    size_t              n;
+};
+
+bool NextArg(EntryReader& reader, Arg& arg)
+{
+    if (reader.done())
+    {
+        return false;
+    }
+    arg.type = static_cast<BinaryLogArgs::Type>(reader.get<char>());
+    switch (arg.type)
+    {
+        case BinaryLogArgs::INT: arg.i = reader.get<int64_t>(); break;
+        case BinaryLogArgs::UINT:
+        case BinaryLogArgs::POINTER: arg.u = reader.get<uint64_t>(); break;
+        case BinaryLogArgs::DOUBLE: arg.d = reader.get<double>(); break;
+        case BinaryLogArgs::STRING: arg.s = reader.getString(arg.n); break;
+        default: return false;
+    }
+    return reader.ok();
+}
+
+// snprintf of one conversion, spec is the conversion without its length modifier
+template <typename T>
+void Print(std::ostream& os, const char* spec, T v)
+{
+    char buf[128];
+    int  n = snprintf(buf, sizeof(buf), spec, v);
+    if (n < 0)
+    {
+        return;
+    }
+    if (static_cast<size_t>(n) < sizeof(buf))
+    {
+        os.write(buf, n);
+        return;
+    }
+    std::unique_ptr<char[]> big(new char[static_cast<size_t>(n) + 1]);
+    snprintf(big.get(), static_cast<size_t>(n) + 1, spec, v);
+    os.write(big.get(), n);
+}
+}  // namespace
+
+void BinaryLog::EncodeSite(LogLine& line, const BinaryLogSite& site)
+{
+    EntryWriter entry(line, SITE);
+    entry.put(site.getId());
+    entry.put(static_cast<uint8_t>(site.getLevel()));
+    entry.put(site.getLine());
+    entry.putString(site.getFile());
+    entry.putString(site.getFunction());
+    entry.putString(site.getFormat());
+}
+
+void BinaryLog::EncodeLogger(LogLine& line, uint32_t id, const std::string& name)
+{
+    EntryWriter entry(line, LOGGER);
+    entry.put(id);
+    entry.putString(name.data(), name.size());
+}
+
+void BinaryLog::EncodeRecord(LogLine& line, const BinaryLogRecord& record)
+{
+    EntryWriter entry(line, RECORD);
+    entry.put(record.site->getId());
+    entry.put(record.logger->getId());
+    entry.put(record.time.microSecondsSinceEpoch());
+    entry.put(record.threadId);
+    entry.put(record.fiberId);
+    entry.putString(record.threadName);
+    line.append(record.args->data(), record.args->length());  // the rest of the entry
+}
+
+void BinaryLog::EncodeText(LogLine& line, uint32_t logger, LogLevel level, int32_t lineNo, Timestamp time, uint32_t threadId, uint32_t fiberId,
+    const char* threadName, const char* file, const char* function, const char* message, size_t length)
+{
+    EntryWriter entry(line, TEXT);
+    entry.put(logger);
+    entry.put(static_cast<uint8_t>(level));
+    entry.put(lineNo);
+    entry.put(time.microSecondsSinceEpoch());
+    entry.put(threadId);
+    entry.put(fiberId);
+    entry.putString(threadName);
+    entry.putString(file);
+    entry.putString(function);
+    entry.putString(message, length);
+}
+
+void BinaryLog::EncodeDropped(LogLine& line, uint64_t count)
+{
+    EntryWriter entry(line, DROPPED);
+    entry.put(count);
+}
+
+void BinaryLog::FormatArgs(std::ostream& os, const char* format, const char* args, size_t length)
+{
+    EntryReader reader(args, length);
+    const char* p = format;
+    while (*p)
+    {
+        const char* percent = strchr(p, '%');
+        if (!percent)
+        {
+            os.write(p, static_cast<std::streamsize>(strlen(p)));
+            return;
+        }
+        os.write(p, percent - p);
+        p = percent + 1;
+        if (*p == '%')
+        {
+            os.put('%');
+            ++p;
+            continue;
+        }
+
+        // flags, width and precision are kept, a * takes an int argument
+        char   spec[64];
+        size_t n     = 0;
+        bool   plain = true;  // a %s without them is written as is
+        spec[n++]    = '%';
+        auto copy    = [&](char c) {
+            if (n < sizeof(spec) - 8)  // room for the length and the conversion
+            {
+                spec[n++] = c;
+            }
+            plain = false;
+        };
+        auto star = [&]() {
+            Arg  arg;
+            int  v = 0;
+            char buf[32];
+            if (NextArg(reader, arg) && (arg.type == BinaryLogArgs::INT || arg.type == BinaryLogArgs::UINT))
+            {
+                v = arg.type == BinaryLogArgs::INT ? static_cast<int>(arg.i) : static_cast<int>(arg.u);
+            }
+            int len = snprintf(buf, sizeof(buf), "%d", v);
+            for (int k = 0; k < len; ++k)
+            {
+                copy(buf[k]);
+            }
+        };
+        while (*p && strchr("-+ #0'", *p))
+        {
+            copy(*p++);
+        }
+        if (*p == '*')
+        {
+            star();
+            ++p;
+        }
+        while (isdigit(static_cast<unsigned char>(*p)))
+        {
+            copy(*p++);
+        }
+        if (*p == '.')
+        {
+            copy(*p++);
+            if (*p == '*')
+            {
+                star();
+                ++p;
+            }
+            while (isdigit(static_cast<unsigned char>(*p)))
+            {
+                copy(*p++);
+            }
+        }
+        while (*p && strchr("hlLqjzt", *p))
+        {
+            ++p;  // the size is the one of the recorded value
+        }
+        char conversion = *p;
+        if (!conversion)
+        {
+            return;
+        }
+        ++p;
+
+        Arg arg;
+        if (!NextArg(reader, arg))
+        {
+            os << "<?>";
+            continue;
+        }
+        bool integer = arg.type == BinaryLogArgs::INT || arg.type == BinaryLogArgs::UINT || arg.type == BinaryLogArgs::POINTER;
+        long long          i = arg.type == BinaryLogArgs::INT ? arg.i : static_cast<long long>(arg.u);
+        unsigned long long u = arg.type == BinaryLogArgs::INT ? static_cast<unsigned long long>(arg.i) : arg.u;
+        switch (conversion)
+        {
+            case 'd':
+            case 'i':
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                if (!integer)
+                {
+                    os << "<?>";
+                    break;
+                }
+                spec[n++] = 'l';
+                spec[n++] = 'l';
+                spec[n++] = conversion;
+                spec[n]   = '\0';
+                if (conversion == 'd' || conversion == 'i')
+                {
+                    Print(os, spec, i);
+                }
+                else
+                {
+                    Print(os, spec, u);
+                }
+                break;
+            case 'c':
+                if (!integer)
+                {
+                    os << "<?>";
+                    break;
+                }
+                spec[n++] = 'c';
+                spec[n]   = '\0';
+                Print(os, spec, static_cast<int>(i));
+                break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                if (arg.type != BinaryLogArgs::DOUBLE && !integer)
+                {
+                    os << "<?>";
+                    break;
+                }
+                spec[n++] = conversion;
+                spec[n]   = '\0';
+                Print(os, spec, arg.type == BinaryLogArgs::DOUBLE ? arg.d : static_cast<double>(i));
+                break;
+            case 's':
+                if (arg.type != BinaryLogArgs::STRING)
+                {
+                    os << "<?>";
+                    break;
+                }
+                if (plain)
+                {
+                    os.write(arg.s, static_cast<std::streamsize>(arg.n));
+                    break;
+                }
+                spec[n++] = 's';
+                spec[n]   = '\0';
+                Print(os, spec, std::string(arg.s, arg.n).c_str());
+                break;
+            case 'p':
+                if (!integer)
+                {
+                    os << "<?>";
+                    break;
+                }
+                spec[n++] = 'p';
+                spec[n]   = '\0';
+                Print(os, spec, reinterpret_cast<void*>(static_cast<uintptr_t>(u)));
+                break;
+            default: os << "<?>"; break;
+        }
+    }
+}
+
+BinaryLogDecoder::BinaryLogDecoder(const std::string& pattern)
+    : formatter_(std::make_shared<LogFormatter>(pattern.empty() ? DefaultLogFormatter::pattern() : pattern))
+{}
+
+bool BinaryLogDecoder::decode(const std::string& filename, std::ostream& os)
+{
+    std::ifstream ifs;
+    if (!FileUtil::OpenForRead(ifs, filename, std::ios::in | std::ios::binary))
+    {
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    return scan(data, os);
+}
+
+bool BinaryLogDecoder::scan(const std::string& data, std::ostream& os)
+{
+    size_t pos = 0;
+    while (data.size() - pos >= sizeof(uint32_t) + sizeof(uint8_t))
+    {
+        uint32_t length;
+        memcpy(&length, data.data() + pos, sizeof(length));
+        if (length < sizeof(uint32_t) + sizeof(uint8_t) || length > data.size() - pos)
+        {
+            return false;  // cut by a crash, or not a binary log
+        }
+        uint8_t     kind = static_cast<uint8_t>(data[pos + sizeof(uint32_t)]);
+        EntryReader entry(data.data() + pos + sizeof(uint32_t) + sizeof(uint8_t), length - sizeof(uint32_t) - sizeof(uint8_t));
+        pos += length;
+
+        // the ids of another process that appended to the file mean other things, a definition holds until the next one
+        if (kind == BinaryLog::SITE)
+        {
+            uint32_t id = entry.get<uint32_t>();
+            Site     site;
+            site.level    = static_cast<LogLevel>(entry.get<uint8_t>());
+            site.line     = entry.get<int32_t>();
+            site.file     = entry.getString();
+            site.function = entry.getString();
+            site.format   = entry.getString();
+            sites_[id]    = site;
+        }
+        else if (kind == BinaryLog::LOGGER)
+        {
+            uint32_t id      = entry.get<uint32_t>();
+            loggerNames_[id] = entry.getString();
+            loggers_.erase(id);
+        }
+        else if (kind == BinaryLog::RECORD)
+        {
+            uint32_t    siteId     = entry.get<uint32_t>();
+            uint32_t    loggerId   = entry.get<uint32_t>();
+            int64_t     time       = entry.get<int64_t>();
+            uint32_t    threadId   = entry.get<uint32_t>();
+            uint32_t    fiberId    = entry.get<uint32_t>();
+            std::string threadName = entry.getString();
+            auto        it         = sites_.find(siteId);
+            if (it == sites_.end())
+            {
+                os << "unknown log site " << siteId << "\n";
+                continue;
+            }
+            const Site& site   = it->second;
+            auto        logger = getLogger(loggerId);
+            LogRecord   record(logger.get(), site.level, site.file.c_str(), site.line, site.function.c_str(), 0, threadId, fiberId, Timestamp(time),
+                threadName.c_str());
+            BinaryLog::FormatArgs(record.getSS(), site.format.c_str(), entry.current(), entry.left());
+            print(os, logger, record);
+        }
+        else if (kind == BinaryLog::TEXT)
+        {
+            uint32_t    loggerId   = entry.get<uint32_t>();
+            LogLevel    level      = static_cast<LogLevel>(entry.get<uint8_t>());
+            int32_t     line       = entry.get<int32_t>();
+            int64_t     time       = entry.get<int64_t>();
+            uint32_t    threadId   = entry.get<uint32_t>();
+            uint32_t    fiberId    = entry.get<uint32_t>();
+            std::string threadName = entry.getString();
+            std::string file       = entry.getString();
+            std::string function   = entry.getString();
+            size_t      n;
+            const char* message = entry.getString(n);
+            auto        logger  = getLogger(loggerId);
+            LogRecord   record(logger.get(), level, file.c_str(), line, function.c_str(), 0, threadId, fiberId, Timestamp(time), threadName.c_str());
+            record.getSS().write(message, static_cast<std::streamsize>(n));
+            print(os, logger, record);
+        }
+        else if (kind == BinaryLog::DROPPED)
+        {
+            os << "dropped " << entry.get<uint64_t>() << " log messages\n";
+        }
+    }
+    return pos == data.size();
+}
+
+void BinaryLogDecoder::print(std::ostream& os, const std::shared_ptr<Logger>& logger, LogRecord& record)
+{
+    LocalLogLine line;
+    formatter_->format(*line, logger, record.getLevel(), LogRecord::ptr(LogRecord::ptr(), &record));
+    os.write(line->data(), static_cast<std::streamsize>(line->length()));
+    ++records_;
+}
+
+std::shared_ptr<Logger> BinaryLogDecoder::getLogger(uint32_t id)
+{
+    auto it = loggers_.find(id);
+    if (it != loggers_.end())
+    {
+        return it->second;
+    }
+    auto name   = loggerNames_.find(id);
+    auto logger = std::make_shared<Logger>(name != loggerNames_.end() ? name->second : "unknown");
+    loggers_[id] = logger;
+    return logger;
+}
+
+}  // namespace easy
@@ -0,0 +1,236 @@
+#ifndef __EASY_BINARY_LOG_H__
+#define __EASY_BINARY_LOG_H__
+
+#include "easy/base/LogLevel.h"
+#include "easy/base/Timestamp.h"
+#include "easy/base/noncopyable.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <type_traits>
+
+namespace easy
+{
+class Logger;
+class LogLine;
+class LogRecord;
+class LogFormatter;
+
+// where an ELOG_BIN_* statement is, one static per statement
+// a binary record only carries its id, the site is written once per file
+class BinaryLogSite : noncopyable
+{
+  public:
+    // file, function and format outlive the site
+    BinaryLogSite(LogLevel level, const char* file, int32_t line, const char* function, const char* format);
+
+    uint32_t    getId() const { return id_; }
+    LogLevel    getLevel() const { return level_; }
+    const char* getFile() const { return file_; }
+    int32_t     getLine() const { return line_; }
+    const char* getFunction() const { return function_; }
+    const char* getFormat() const { return format_; }
+
+  private:
+    uint32_t    id_;
+    LogLevel    level_;
+    const char* file_;
+    int32_t     line_;
+    const char* function_;
+    const char* format_;
+};
+
+// the printf arguments of a record as typed raw values, on the stack of the statement
+// a string is copied, an argument that does not fit in kSize is left out
+class BinaryLogArgs : noncopyable
+{
+  public:
+    static const size_t kSize = 1024;
+
+    enum Type
+    {
+        INT     = 'i',  // int64_t
+        UINT    = 'u',  // uint64_t
+        DOUBLE  = 'd',  // double
+        STRING  = 's',  // uint32_t length, the bytes
+        POINTER = 'p',  // uint64_t
+    };
+
+    template <typename... Args>
+    explicit BinaryLogArgs(const Args&... args)
+    {
+        add(args...);
+    }
+
+    const char* data() const { return data_; }
+
+    size_t length() const { return length_; }
+
+  private:
+    void add() {}
+
+    template <typename T, typename... Args>
+    void add(const T& v, const Args&... args)
+    {
+        put(v);
+        add(args...);
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type put(T v)
+    {
+        putValue(INT, static_cast<int64_t>(v));
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type put(T v)
+    {
+        putValue(UINT, static_cast<uint64_t>(v));
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_enum<T>::value>::type put(T v)
+    {
+        putValue(INT, static_cast<int64_t>(v));
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type put(T v)
+    {
+        putValue(DOUBLE, static_cast<double>(v));
+    }
+
+    template <typename T>
+    void put(const T* v)
+    {
+        putValue(POINTER, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(v)));
+    }
+
+    void put(std::nullptr_t) { putValue(POINTER, static_cast<uint64_t>(0)); }
+
+    void put(const char* v)
+    {
+        if (!v)
+        {
+            v = "(null)";
+        }
+        size_t n = strlen(v);
+        if (length_ + 1 + sizeof(uint32_t) >= kSize)
+        {
+            return;
+        }
+        n              = std::min(n, kSize - length_ - 1 - sizeof(uint32_t));  // cut to what is left
+        uint32_t size  = static_cast<uint32_t>(n);
+        data_[length_] = static_cast<char>(STRING);
+        memcpy(data_ + length_ + 1, &size, sizeof(size));
+        memcpy(data_ + length_ + 1 + sizeof(size), v, n);
+        length_ += 1 + sizeof(size) + n;
+    }
+
+    void put(char* v) { put(static_cast<const char*>(v)); }
+
+    template <typename T>
+    void putValue(Type type, T v)
+    {
+        if (length_ + 1 + sizeof(v) > kSize)
+        {
+            return;
+        }
+        data_[length_] = static_cast<char>(type);
+        memcpy(data_ + length_ + 1, &v, sizeof(v));
+        length_ += 1 + sizeof(v);
+    }
+
+    char   data_[kSize];
+    size_t length_{0};
+};
+
+// what an ELOG_BIN_* statement hands to the logger, valid for the call only
+struct BinaryLogRecord
+{
+    const BinaryLogSite* site;
+    Logger*              logger;
+    Timestamp            time;
+    uint32_t             threadId;
+    uint32_t             fiberId;
+    const char*          threadName;
+    const BinaryLogArgs* args;
+};
+
+// the entries of a binary log file, native byte order, read on the same kind of machine
+// every entry starts with its uint32_t length and a uint8_t kind, an unknown kind is skipped
+class BinaryLog
+{
+  public:
+    enum Kind
+    {
+        SITE    = 1,  // id, level, line, file, function, format
+        LOGGER  = 2,  // id, name
+        RECORD  = 3,  // site, logger, time, thread id, fiber id, thread name, the args
+        TEXT    = 4,  // logger, level, line, time, thread id, fiber id, thread name, file, function, message of an ELOG_* record
+        DROPPED = 5,  // the count of the messages dropped by the appender
+    };
+
+    static void EncodeSite(LogLine& line, const BinaryLogSite& site);
+
+    static void EncodeLogger(LogLine& line, uint32_t id, const std::string& name);
+
+    static void EncodeRecord(LogLine& line, const BinaryLogRecord& record);
+
+    static void EncodeText(LogLine& line, uint32_t logger, LogLevel level, int32_t lineNo, Timestamp time, uint32_t threadId, uint32_t fiberId,
+        const char* threadName, const char* file, const char* function, const char* message, size_t length);
+
+    static void EncodeDropped(LogLine& line, uint64_t count);
+
+    // printf of format with the args of a BinaryLogArgs, a missing or mistyped one prints as <?>
+    static void FormatArgs(std::ostream& os, const char* format, const char* args, size_t length);
+
+    // the arguments are checked like printf, never called
+    __attribute__((format(printf, 1, 2))) static void CheckFormat(const char* format, ...) {}
+};
+
+// the text of a binary log file, offline, in one pass
+// a site or logger is defined before its first record, the processes appending to a file each define their own ids
+class BinaryLogDecoder : noncopyable
+{
+  public:
+    // the pattern of LogFormatter, the default one of a Logger if empty
+    explicit BinaryLogDecoder(const std::string& pattern = "");
+
+    // false if the file cannot be read or its last entry is cut, what was decoded is written anyway
+    bool decode(const std::string& filename, std::ostream& os);
+
+    uint64_t records() const { return records_; }
+
+  private:
+    struct Site
+    {
+        LogLevel    level;
+        int32_t     line;
+        std::string file;
+        std::string function;
+        std::string format;
+    };
+
+    bool scan(const std::string& data, std::ostream& os);
+
+    void print(std::ostream& os, const std::shared_ptr<Logger>& logger, LogRecord& record);
+
+    std::shared_ptr<Logger> getLogger(uint32_t id);
+
+    std::shared_ptr<LogFormatter>               formatter_;
+    std::map<uint32_t, Site>                    sites_;
+    std::map<uint32_t, std::string>             loggerNames_;
+    std::map<uint32_t, std::shared_ptr<Logger>> loggers_;
+    uint64_t                                    records_{0};
+};
+
+}  // namespace easy
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef __EASY_CALLBACK_H__
+#define __EASY_CALLBACK_H__
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace easy
+{
+// move-only void() callable, stored inline without heap allocation when it fits in kInlineSize
+class Callback
+{
+  public:
+    static const size_t kInlineSize = 48;
+
+    Callback() = default;
+
+    Callback(std::nullptr_t) {}
+
+    template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Callback>::value>::type>
+    Callback(F&& f)
+    {
+        typedef typename std::decay<F>::type Func;
+        if (IsNull(f))
+        {
+            return;
+        }
+        init<Func>(std::forward<F>(f), std::integral_constant<bool, IsInline<Func>()>());
+    }
+
+    Callback(Callback&& other) noexcept { moveFrom(other); }
+
+    Callback& operator=(Callback&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    Callback& operator=(std::nullptr_t)
+    {
+        reset();
+        return *this;
+    }
+
+    Callback(const Callback&) = delete;
+    Callback& operator=(const Callback&) = delete;
+
+    ~Callback() { reset(); }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    void operator()() { ops_->invoke(&storage_); }
+
+    void reset()
+    {
+        if (ops_)
+        {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    // false if the callable did not fit and lives on the heap
+    bool isInline() const { return !ops_ || ops_->inline_; }
+
+  private:
+    struct Ops
+    {
+        void (*invoke)(void* storage);
+        void (*move)(void* dst, void* src);  // move construct dst, destroy src
+        void (*destroy)(void* storage);
+        bool inline_;
+    };
+
+    typedef typename std::aligned_storage<kInlineSize, alignof(std::max_align_t)>::type Storage;
+
+    template <typename Func>
+    static constexpr bool IsInline()
+    {
+        return sizeof(Func) <= kInlineSize && alignof(Func) <= alignof(Storage) && std::is_nothrow_move_constructible<Func>::value;
+    }
+
+    template <typename Func>
+    struct InlineOps
+    {
+        static void Invoke(void* storage) { (*static_cast<Func*>(storage))(); }
+
+        static void Move(void* dst, void* src)
+        {
+            new (dst) Func(std::move(*static_cast<Func*>(src)));
+            static_cast<Func*>(src)->~Func();
+        }
+
+        static void Destroy(void* storage) { static_cast<Func*>(storage)->~Func(); }
+
+        static const Ops ops;
+    };
+
+    template <typename Func>
+    struct HeapOps
+    {
+        static void Invoke(void* storage) { (**static_cast<Func**>(storage))(); }
+
+        static void Move(void* dst, void* src) { *static_cast<Func**>(dst) = *static_cast<Func**>(src); }
+
+        static void Destroy(void* storage) { delete *static_cast<Func**>(storage); }
+
+        static const Ops ops;
+    };
+
+    template <typename Func, typename F>
+    void init(F&& f, std::true_type)
+    {
+        new (&storage_) Func(std::forward<F>(f));
+        ops_ = &InlineOps<Func>::ops;
+    }
+
+    template <typename Func, typename F>
+    void init(F&& f, std::false_type)
+    {
+        *reinterpret_cast<Func**>(&storage_) = new Func(std::forward<F>(f));
+        ops_                                 = &HeapOps<Func>::ops;
+    }
+
+    void moveFrom(Callback& other)
+    {
+        if (other.ops_)
+        {
+            other.ops_->move(&storage_, &other.storage_);
+            ops_       = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+
+    template <typename F>
+    static bool IsNull(const F&)
+    {
+        return false;
+    }
+
+    template <typename R>
+    static bool IsNull(R (*const& f)())
+    {
+        return f == nullptr;
+    }
+
+    static bool IsNull(const std::function<void()>& f) { return !f; }
+
+  private:
+    Storage    storage_;
+    const Ops* ops_ = nullptr;
+};
+
+template <typename Func>
+const Callback::Ops Callback::InlineOps<Func>::ops = {&Invoke, &Move, &Destroy, true};
+
+template <typename Func>
+const Callback::Ops Callback::HeapOps<Func>::ops = {&Invoke, &Move, &Destroy, false};
+
+}  // namespace easy
+
+#endif
@@ -21,7 +21,7 @@ void Channel::cleanUp(EventCtx& ctx)
     ctx.cb_ = nullptr;
 }
 
-void Channel::handleEvent(Event event)
+void Channel::handleEvent(Event event, int threadId)
 {
     if (EASY_UNLIKELY(!(events_ & event)))
     {
@@ -31,11 +31,11 @@ void Channel::handleEvent(Event event)
     EventCtx& ctx = getEventCtx(event);
     if (ctx.cb_)
     {
-        ctx.scheduler_->schedule(std::move(ctx.cb_));
+        ctx.scheduler_->schedule(std::move(ctx.cb_), threadId);
     }
     else
     {
-        ctx.scheduler_->schedule(std::move(ctx.fiber_));
+        ctx.scheduler_->schedule(std::move(ctx.fiber_), threadId);
     }
     EASY_ASSERT(!ctx.cb_ && !ctx.fiber_);  // std::move
     ctx.scheduler_ = nullptr;
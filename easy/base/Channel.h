@@ -7,6 +7,7 @@
 #include "easy/base/noncopyable.h"
 
 #include <sys/epoll.h>
+#include <deque>
 
 namespace easy
 {
@@ -35,13 +36,25 @@ class Channel : noncopyable
 
     void cleanUp(EventCtx& ctx);
 
-    void handleEvent(Event event);
+    // threadId: where a parked fiber or the callback resumes, -1 for any thread
+    void handleEvent(Event event, int threadId = -1);
 
     EventCtx read_;
     EventCtx write_;
     int      fd_;
-    Event    events_ = NONE;
+    Event    events_     = NONE;   // events with a waiter
+    Event    ready_      = NONE;   // edges seen with no waiter, persistent mode only
+    bool     registered_ = false;  // stays in the epoll set until cancelAll, persistent mode only
+    int      loop_       = 0;      // IOManager loop the fd is registered in, fixed while registered
     SpinLock lock_;
+
+    // io_uring mode only
+    int             uringInflight_ = 0;  // requests not completed yet, cancelled on close
+    std::deque<int> accepted_;           // fds or -errno from the multishot accept, not taken yet
+    Fiber::ptr      acceptWaiter_;
+    int             acceptThread_ = -1;
+    uint32_t        closeGen_     = 0;  // bumped on close, tells a cancel from a timeout and drops stale accepts
+    bool            acceptArmed_  = false;
 };
 
 }  // namespace easy
@@ -1,6 +1,9 @@
 #include "easy/base/Condition.h"
 #include "easy/base/Macro.h"
 
+#include <errno.h>
+#include <time.h>
+
 namespace easy
 {
 Condition::Condition(MutexLock& mutex) : lock_(mutex) { EASY_CHECK(pthread_cond_init(&pcond_, nullptr)); }
@@ -9,6 +12,16 @@ Condition::~Condition() { EASY_CHECK(pthread_cond_destroy(&pcond_)); }
 
 void Condition::wait() { EASY_CHECK(pthread_cond_wait(&pcond_, lock_.mutexPtr())); }
 
+bool Condition::waitForMilliSeconds(int64_t ms)
+{
+    struct timespec abstime;
+    clock_gettime(CLOCK_REALTIME, &abstime);
+    int64_t nanoseconds = abstime.tv_nsec + ms % 1000 * 1000 * 1000;
+    abstime.tv_sec += static_cast<time_t>(ms / 1000 + nanoseconds / (1000 * 1000 * 1000));
+    abstime.tv_nsec = static_cast<long>(nanoseconds % (1000 * 1000 * 1000));
+    return pthread_cond_timedwait(&pcond_, lock_.mutexPtr(), &abstime) != ETIMEDOUT;
+}
+
 void Condition::notify() { EASY_CHECK(pthread_cond_signal(&pcond_)); }
 
 void Condition::notifyAll() { EASY_CHECK(pthread_cond_broadcast(&pcond_)); }
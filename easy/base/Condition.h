@@ -17,6 +17,9 @@ class Condition : noncopyable
 
     void wait();
 
+    // false on timeout
+    bool waitForMilliSeconds(int64_t ms);
+
     void notify();
 
     void notifyAll();
@@ -0,0 +1,119 @@
+#include "easy/base/Context.h"
+#include "easy/base/Macro.h"
+
+#include <cstdint>
+#include <cstring>
+
+extern "C" void easy_swap_context(void** from_sp, void* to_sp);
+
+#if defined(EASY_HAS_ASM_CONTEXT) && defined(__x86_64__)
+// rdi = &from->sp_, rsi = to->sp_
+// frame (low -> high): mxcsr, x87 cw, r12, r13, r14, r15, rbx, rbp, return address
+asm(R"(
+    .text
+    .globl easy_swap_context
+    .type easy_swap_context, @function
+    .align 16
+easy_swap_context:
+    pushq %rbp
+    pushq %rbx
+    pushq %r15
+    pushq %r14
+    pushq %r13
+    pushq %r12
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r12
+    popq %r13
+    popq %r14
+    popq %r15
+    popq %rbx
+    popq %rbp
+    ret
+    .size easy_swap_context, .-easy_swap_context
+)");
+#elif defined(EASY_HAS_ASM_CONTEXT) && defined(__aarch64__)
+// x0 = &from->sp_, x1 = to->sp_
+// frame (low -> high): d8-d15, x19-x28, x29, x30, pc
+asm(R"(
+    .text
+    .globl easy_swap_context
+    .type easy_swap_context, %function
+    .align 4
+easy_swap_context:
+    sub sp, sp, #0xb0
+    stp d8, d9, [sp, #0x00]
+    stp d10, d11, [sp, #0x10]
+    stp d12, d13, [sp, #0x20]
+    stp d14, d15, [sp, #0x30]
+    stp x19, x20, [sp, #0x40]
+    stp x21, x22, [sp, #0x50]
+    stp x23, x24, [sp, #0x60]
+    stp x25, x26, [sp, #0x70]
+    stp x27, x28, [sp, #0x80]
+    stp x29, x30, [sp, #0x90]
+    str x30, [sp, #0xa0]
+    mov x9, sp
+    str x9, [x0]
+    mov sp, x1
+    ldp d8, d9, [sp, #0x00]
+    ldp d10, d11, [sp, #0x10]
+    ldp d12, d13, [sp, #0x20]
+    ldp d14, d15, [sp, #0x30]
+    ldp x19, x20, [sp, #0x40]
+    ldp x21, x22, [sp, #0x50]
+    ldp x23, x24, [sp, #0x60]
+    ldp x25, x26, [sp, #0x70]
+    ldp x27, x28, [sp, #0x80]
+    ldp x29, x30, [sp, #0x90]
+    ldr x9, [sp, #0xa0]
+    add sp, sp, #0xb0
+    ret x9
+    .size easy_swap_context, .-easy_swap_context
+)");
+#endif
+
+namespace easy
+{
+void UContext::make(void* stack, size_t size, ContextFunc fn)
+{
+    EASY_CHECK(getcontext(&ctx_));
+    ctx_.uc_link          = nullptr;
+    ctx_.uc_stack.ss_sp   = stack;
+    ctx_.uc_stack.ss_size = size;
+    makecontext(&ctx_, fn, 0);
+}
+
+void UContext::Swap(UContext* from, UContext* to) { EASY_CHECK(swapcontext(&from->ctx_, &to->ctx_)); }
+
+#ifdef EASY_HAS_ASM_CONTEXT
+void AsmContext::make(void* stack, size_t size, ContextFunc fn)
+{
+    uintptr_t top = (reinterpret_cast<uintptr_t>(stack) + size) & ~static_cast<uintptr_t>(15);
+#if defined(__x86_64__)
+    // fn starts as if it was called: rsp % 16 == 8 and a null return address
+    uint64_t* sp = reinterpret_cast<uint64_t*>(top) - 9;
+    memset(sp, 0, 9 * sizeof(uint64_t));
+    uint32_t* fpu = reinterpret_cast<uint32_t*>(sp);
+    fpu[0]        = 0x1F80;  // mxcsr default
+    fpu[1]        = 0x037F;  // x87 control word default
+    sp[7]         = reinterpret_cast<uint64_t>(fn);
+#elif defined(__aarch64__)
+    // fn starts with sp 16-byte aligned, x29 = x30 = 0 terminates the frame chain
+    uint64_t* sp = reinterpret_cast<uint64_t*>(top) - 22;
+    memset(sp, 0, 22 * sizeof(uint64_t));
+    sp[20] = reinterpret_cast<uint64_t>(fn);
+#endif
+    sp_ = sp;
+}
+
+void AsmContext::Swap(AsmContext* from, AsmContext* to) { easy_swap_context(&from->sp_, to->sp_); }
+#endif
+
+}  // namespace easy
@@ -0,0 +1,50 @@
+#ifndef __EASY_CONTEXT_H__
+#define __EASY_CONTEXT_H__
+
+#include "easy/base/noncopyable.h"
+
+#include <ucontext.h>
+#include <cstddef>
+
+#if !defined(EASY_FIBER_USE_UCONTEXT) && (defined(__x86_64__) || defined(__aarch64__))
+#define EASY_HAS_ASM_CONTEXT 1
+#endif
+
+namespace easy
+{
+typedef void (*ContextFunc)();
+
+// ucontext_t backend, portable but swapcontext() saves and restores
+// the signal mask with rt_sigprocmask on every switch
+class UContext : noncopyable
+{
+  public:
+    void make(void* stack, size_t size, ContextFunc fn);
+
+    static void Swap(UContext* from, UContext* to);
+
+  private:
+    ucontext_t ctx_;
+};
+
+#ifdef EASY_HAS_ASM_CONTEXT
+// hand-written backend, only callee-saved registers are switched
+class AsmContext : noncopyable
+{
+  public:
+    void make(void* stack, size_t size, ContextFunc fn);
+
+    static void Swap(AsmContext* from, AsmContext* to);
+
+  private:
+    void* sp_{nullptr};  // saved stack pointer, registers live on the stack
+};
+
+typedef AsmContext FiberContext;
+#else
+typedef UContext FiberContext;
+#endif
+
+}  // namespace easy
+
+#endif
@@ -0,0 +1,118 @@
+#include "easy/base/Deadline.h"
+#include "easy/base/Fiber.h"
+#include "easy/base/IOManager.h"
+
+#include <errno.h>
+#include <algorithm>
+
+namespace easy
+{
+Deadline::Deadline(uint64_t ms) : fiber_(Fiber::GetThis().get())
+{
+    parent_ = fiber_->deadline_;
+    if (ms != -1UL)
+    {
+        expiration_ = addTime(Timestamp::now(Timestamp::MONOTONIC), static_cast<int64_t>(ms));
+        // an outer deadline that ends first already has a timer
+        if (ms < (parent_ ? parent_->remaining() : -1UL))
+        {
+            iom_ = IOManager::GetThis();
+            if (iom_)
+            {
+                iom_->armTimer(timer_, ms, &Deadline::OnTimeout, this);
+            }
+        }
+    }
+    fiber_->deadline_ = this;
+}
+
+Deadline::~Deadline()
+{
+    if (iom_)
+    {
+        iom_->disarmTimer(timer_);  // waits for OnTimeout if it is running
+    }
+    fiber_->deadline_ = parent_;
+}
+
+void Deadline::OnTimeout(void* arg) { static_cast<Deadline*>(arg)->expire(ETIMEDOUT); }
+
+void Deadline::cancel() { expire(ECANCELED); }
+
+void Deadline::expire(int error)
+{
+    SpinLockGuard _(lock_);
+    error_.compareAndSet(0, error);
+    if (wake_)
+    {
+        wake_(arg_, error_.get());
+        wake_ = nullptr;
+    }
+}
+
+int Deadline::error() const
+{
+    for (const Deadline* deadline = this; deadline; deadline = deadline->parent_)
+    {
+        if (int error = deadline->error_.get())
+        {
+            return error;
+        }
+        if (deadline->expiration_.valid() && !deadline->iom_ && !(Timestamp::now(Timestamp::MONOTONIC) < deadline->expiration_))
+        {
+            return ETIMEDOUT;  // no timer, outside an IOManager or bounded by an outer one
+        }
+    }
+    return 0;
+}
+
+uint64_t Deadline::remaining() const
+{
+    uint64_t  left = -1UL;
+    Timestamp now;
+    for (const Deadline* deadline = this; deadline; deadline = deadline->parent_)
+    {
+        if (deadline->expiration_.valid())
+        {
+            if (!now.valid())
+            {
+                now = Timestamp::now(Timestamp::MONOTONIC);
+            }
+            int64_t us = deadline->expiration_.microSecondsSinceEpoch() - now.microSecondsSinceEpoch();
+            left       = std::min(left, us > 0 ? static_cast<uint64_t>((us + 999) / 1000) : 0);
+        }
+    }
+    return left;
+}
+
+bool Deadline::park(void (*wake)(void*, int), void* arg)
+{
+    bool ok = true;
+    for (Deadline* deadline = this; deadline && ok; deadline = deadline->parent_)
+    {
+        SpinLockGuard _(deadline->lock_);
+        ok = !deadline->error_.get();
+        if (ok)
+        {
+            deadline->wake_ = wake;
+            deadline->arg_  = arg;
+        }
+    }
+    if (!ok || error())
+    {
+        unpark();
+        return false;
+    }
+    return true;
+}
+
+void Deadline::unpark()
+{
+    for (Deadline* deadline = this; deadline; deadline = deadline->parent_)
+    {
+        SpinLockGuard _(deadline->lock_);
+        deadline->wake_ = nullptr;
+    }
+}
+
+}  // namespace easy
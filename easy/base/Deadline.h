@@ -0,0 +1,64 @@
+#ifndef __EASY_DEADLINE_H__
+#define __EASY_DEADLINE_H__
+
+#include "easy/base/Atomic.h"
+#include "easy/base/Mutex.h"
+#include "easy/base/Timer.h"
+#include "easy/base/Timestamp.h"
+#include "easy/base/noncopyable.h"
+
+#include <cstdint>
+
+namespace easy
+{
+class Fiber;
+class IOManager;
+
+// a deadline and a cancellation for the hooked calls of the running fiber, one timer covers all of them
+// lives on the stack of the fiber and is current for its scope, an inner one is bounded by the outer ones
+//   easy::Deadline deadline(500);  // read, write, connect and sleep fail with ETIMEDOUT 500ms from now
+// cancel from another fiber or thread fails them with ECANCELED
+class Deadline : noncopyable
+{
+  public:
+    // ms from now, -1UL for a cancellation only
+    explicit Deadline(uint64_t ms = -1UL);
+
+    ~Deadline();
+
+    // wakes the call the fiber is parked in, it and the later ones fail with ECANCELED
+    void cancel();
+
+    // 0, ETIMEDOUT or ECANCELED, of this one or an outer one
+    int error() const;
+
+    // ms left before the earliest deadline of this one and the outer ones, -1UL if there is none, 0 if it passed
+    uint64_t remaining() const;
+
+    // a hooked call parks, wake(arg, errno) runs once on the thread that expires or cancels one of the chain
+    // false with error() set if one already did
+    bool park(void (*wake)(void*, int), void* arg);
+
+    // the call resumed, a wake running now is waited for
+    void unpark();
+
+  private:
+    static void OnTimeout(void* arg);
+
+    void expire(int error);
+
+  private:
+    Deadline*      parent_;
+    Fiber*         fiber_;
+    Timestamp      expiration_;  // CLOCK_MONOTONIC, invalid if none
+    IOManager*     iom_{nullptr};  // timer_ is armed
+    Timer          timer_;
+    AtomicInt<int> error_{0};
+    SpinLock       lock_;
+    void (*wake_)(void*, int) = nullptr;  // lock_ held
+    void* arg_                = nullptr;
+};
+
+}  // namespace easy
+
+#endif
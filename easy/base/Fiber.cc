@@ -1,12 +1,16 @@
 #include "easy/base/Fiber.h"
 #include "easy/base/Atomic.h"
 #include "easy/base/Config.h"
+#include "easy/base/Deadline.h"
+#include "easy/base/IOManager.h"
 #include "easy/base/Logger.h"
 #include "easy/base/Macro.h"
 #include "easy/base/Scheduler.h"
+#include "easy/base/StackAllocator.h"
 #include "easy/base/common.h"
+#include "easy/base/hook.h"
 
-#include <sys/mman.h>
+#include <time.h>
 #include <cassert>
 
 namespace easy
@@ -22,67 +26,113 @@ static thread_local Fiber::ptr t_root_fiber    = nullptr;
 
 static ConfigVar<uint32_t>::ptr fiber_stack_size = Config::Lookup<uint32_t>("fiber.stack_size", 128 * 1024, "fiber stack size");
 
-class MallocStackAllocator
+Fiber* NewFiber()
 {
-  public:
-    static void* Alloc(size_t size) { return malloc(size); }
+    return new Fiber();  // root continue only
+}
 
-    static void Dealloc(void* vp, size_t size) { return free(vp); }
-};
+// room kept below the Fiber for the shared_ptr control block of MakeFiber
+static const size_t kControlBlockSize = 64;
+
+Fiber* NewFiber(Callback cb, size_t stacksize, bool use_caller)
+{
+    // the Fiber lives at the top of its own stack block, one pooled allocation per fiber
+    stacksize        = stacksize ? stacksize : fiber_stack_size->value();
+    size_t allocsize = StackPool::RoundUp(stacksize + kControlBlockSize + sizeof(Fiber));
+    char*  block     = static_cast<char*>(StackPool::Alloc(allocsize));
+    size_t offset    = (allocsize - sizeof(Fiber)) & ~(alignof(Fiber) - 1);
+    Fiber* ptr       = new (block + offset) Fiber(std::move(cb), offset - kControlBlockSize, use_caller, block);
+    ptr->allocsize_  = allocsize;
+    return ptr;
+}
+
+void FreeFiber(Fiber* ptr)
+{
+    if (!ptr->allocsize_)
+    {
+        delete ptr;
+        return;
+    }
+    void*  block     = ptr->stack_;
+    size_t allocsize = ptr->allocsize_;
+    ptr->~Fiber();
+    StackPool::Dealloc(block, allocsize);
+}
 
-class MMapStackAllocator
+// hands out the control block slot of a fiber block, the block goes back to the pool
+// when the control block is released, i.e. after the last weak_ptr is gone
+template <typename T>
+class FiberBlockAllocator
 {
   public:
-    static void* Alloc(size_t size) { return mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0); }
+    typedef T value_type;
 
-    static void Dealloc(void* vp, size_t size) { munmap(vp, size); }
-};
+    FiberBlockAllocator(void* block, size_t allocsize, void* slot) : block_(block), allocsize_(allocsize), slot_(slot) {}
+
+    template <typename U>
+    FiberBlockAllocator(const FiberBlockAllocator<U>& other) : block_(other.block_), allocsize_(other.allocsize_), slot_(other.slot_)
+    {
+    }
 
-// using StackAllocator = MallocStackAllocator;
+    T* allocate(size_t n)
+    {
+        EASY_ASSERT(n * sizeof(T) <= kControlBlockSize);
+        return static_cast<T*>(slot_);
+    }
 
-using StackAllocator = MMapStackAllocator;
+    void deallocate(T*, size_t) { StackPool::Dealloc(block_, allocsize_); }
 
-Fiber* NewFiber()
-{
-    return new Fiber();  // root continue only
-}
+    template <typename U>
+    bool operator==(const FiberBlockAllocator<U>& other) const
+    {
+        return block_ == other.block_;
+    }
 
-Fiber* NewFiber(std::function<void()> cb, size_t stacksize, bool use_caller)
-{
-    stacksize = stacksize ? stacksize : fiber_stack_size->value();
-    Fiber* p  = static_cast<Fiber*>(StackAllocator::Alloc(sizeof(Fiber) + stacksize));
-    return new (p) Fiber(cb, stacksize, use_caller);
-}
+    template <typename U>
+    bool operator!=(const FiberBlockAllocator<U>& other) const
+    {
+        return block_ != other.block_;
+    }
 
-void FreeFiber(Fiber* ptr)
+    void*  block_;
+    size_t allocsize_;
+    void*  slot_;
+};
+
+static void DestroyFiber(Fiber* ptr) { ptr->~Fiber(); }
+
+Fiber::ptr MakeFiber(Callback cb, size_t stacksize, bool use_caller)
 {
-    ptr->~Fiber();
-    StackAllocator::Dealloc(ptr, 0);
+    Fiber* ptr  = NewFiber(std::move(cb), stacksize, use_caller);
+    char*  slot = reinterpret_cast<char*>(ptr) - kControlBlockSize;
+    return Fiber::ptr(ptr, DestroyFiber, FiberBlockAllocator<Fiber>(ptr->stack_, ptr->allocsize_, slot));
 }
 
 Fiber::Fiber()
 {
     Fiber::SetThis(this);
-    state_ = EXEC;  // root should be EXEC
-    EASY_CHECK(getcontext(&ctx_));
+    state_ = EXEC;  // root should be EXEC, ctx_ is filled by the first switch out
     s_fiber_count.increment();
     ELOG_DEBUG(logger) << "Fiber ctor root id=" << id_;
 }
 
-Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool use_caller) : id_(s_numsCreated.incrementAndFetch()), cb_(cb)
+Fiber::Fiber(Callback cb, size_t stacksize, bool use_caller) : Fiber(std::move(cb), stacksize, use_caller, nullptr) {}
+
+Fiber::Fiber(Callback cb, size_t stacksize, bool use_caller, void* stack) : id_(s_numsCreated.incrementAndFetch()), cb_(std::move(cb))
 {
     s_fiber_count.increment();
 
-    EASY_ASSERT(stacksize != 0);
-    stacksize_ = stacksize;
-
-    stack_ = StackAllocator::Alloc(stacksize_);
-    EASY_CHECK(getcontext(&ctx_));
-    ctx_.uc_link          = nullptr;
-    ctx_.uc_stack.ss_sp   = stack_;
-    ctx_.uc_stack.ss_size = stacksize_;
-
-    makecontext(&ctx_, &Fiber::MainFunc, 0);
+    stacksize_ = stacksize ? stacksize : fiber_stack_size->value();
+    if (stack)
+    {
+        stack_ = stack;  // owned by NewFiber/FreeFiber
+    }
+    else
+    {
+        stacksize_ = StackPool::RoundUp(stacksize_);
+        stack_     = StackPool::Alloc(stacksize_);
+    }
+    ctx_.make(stack_, stacksize_, &Fiber::MainFunc);
 
     ELOG_DEBUG(logger) << "Fiber ctor sub id=" << id_;
 }
@@ -94,7 +144,10 @@ Fiber::~Fiber()
     {
         // sub fiber should free stack
         EASY_ASSERT(state_ == INIT || state_ == TERM || state_ == EXCEPT);
-        StackAllocator::Dealloc(stack_, stacksize_);
+        if (!allocsize_)
+        {
+            StackPool::Dealloc(stack_, stacksize_);
+        }
     }
     else
     {
@@ -114,7 +167,7 @@ void Fiber::sched_resume()
     EASY_ASSERT(state_ == INIT || state_ == READY || state_ == HOLD);
     Fiber::SetThis(this);
     state_ = EXEC;
-    EASY_CHECK(swapcontext(&Scheduler::GetSchedulerFiber()->ctx_, &ctx_));
+    FiberContext::Swap(&Scheduler::GetSchedulerFiber()->ctx_, &ctx_);
 }
 
 void Fiber::sched_yield()
@@ -122,7 +175,7 @@ void Fiber::sched_yield()
     Fiber::SetThis(Scheduler::GetSchedulerFiber());
     // state_ = HOLD;  don't do this
 
-    EASY_CHECK(swapcontext(&ctx_, &Scheduler::GetSchedulerFiber()->ctx_));
+    FiberContext::Swap(&ctx_, &Scheduler::GetSchedulerFiber()->ctx_);
 }
 
 void Fiber::resume()
@@ -131,33 +184,31 @@ void Fiber::resume()
     EASY_ASSERT(state_ == INIT || state_ == READY || state_ == HOLD);
     Fiber::SetThis(this);
     state_ = EXEC;
-    EASY_CHECK(swapcontext(&t_root_fiber->ctx_, &ctx_));
+    FiberContext::Swap(&t_root_fiber->ctx_, &ctx_);
 }
 
 void Fiber::yield()
 {
     EASY_ASSERT_MESSAGE(t_root_fiber, "root fiber not exist");
     SetThis(t_root_fiber.get());
-    EASY_CHECK(swapcontext(&ctx_, &t_root_fiber->ctx_));
+    FiberContext::Swap(&ctx_, &t_root_fiber->ctx_);
 }
 
-void Fiber::reset(std::function<void()> cb)
+void Fiber::reset(Callback cb)
 {
     EASY_ASSERT(stack_);
     cb_ = std::move(cb);
-    EASY_CHECK(getcontext(&ctx_));
-
-    ctx_.uc_link          = nullptr;
-    ctx_.uc_stack.ss_sp   = stack_;
-    ctx_.uc_stack.ss_size = stacksize_;
-
-    makecontext(&ctx_, &Fiber::MainFunc, 0);
+    ctx_.make(stack_, stacksize_, &Fiber::MainFunc);
 
     state_ = INIT;
 }
 
+size_t Fiber::stackHighWater() const { return stack_ ? StackPool::HighWater(stack_, stacksize_) : 0; }
+
 void Fiber::SetThis(Fiber* co) { t_running_fiber = co; }
 
+Deadline* Fiber::CurrentDeadline() { return t_running_fiber ? t_running_fiber->deadline_ : nullptr; }
+
 Fiber::ptr Fiber::GetThis()
 {
     if (t_running_fiber)
@@ -175,6 +226,7 @@ Fiber::ptr Fiber::GetThis()
 
 void Fiber::YieldToHold()
 {
+    EASY_ASSERT_MESSAGE(!Scheduler::InInlineTask(), "yield inside an inline task, it runs on the scheduler fiber");
     Fiber::ptr cur = GetThis();
     cur->state_    = HOLD;
     if (Scheduler::GetThis() && Scheduler::GetSchedulerFiber() != t_running_fiber)
@@ -187,6 +239,61 @@ void Fiber::YieldToHold()
     }
 }
 
+// a parked sleep, woken once by its timer or by the Deadline of the fiber
+struct Sleeper
+{
+    IOManager* iom;
+    Fiber::ptr fiber;
+    int        threadId;
+    int        woken;
+    int        cancelled;  // errno of the deadline
+};
+
+static void OnSleepWake(void* arg, int error)
+{
+    Sleeper* sleeper = static_cast<Sleeper*>(arg);
+    if (__sync_bool_compare_and_swap(&sleeper->woken, 0, 1))
+    {
+        sleeper->cancelled = error;
+        sleeper->iom->schedule(std::move(sleeper->fiber), sleeper->threadId);
+    }
+}
+
+static void OnSleepTimeout(void* arg) { OnSleepWake(arg, 0); }
+
+int Fiber::SleepFor(uint64_t ms)
+{
+    IOManager* iom = IOManager::GetThis();
+    if (!iom)
+    {
+        // a plain thread
+        struct timespec ts = {static_cast<time_t>(ms / 1000), static_cast<long>(ms % 1000 * 1000 * 1000)};
+        nanosleep_f(&ts, nullptr);
+        return 0;
+    }
+    Sleeper   sleeper  = {iom, GetThis(), Scheduler::CurrentThreadId(), 0, 0};
+    Deadline* deadline = CurrentDeadline();
+    if (deadline && !deadline->park(&OnSleepWake, &sleeper))
+    {
+        return deadline->error();
+    }
+    Timer timer;
+    iom->armTimer(timer, ms, &OnSleepTimeout, &sleeper);
+    YieldToHold();
+    iom->disarmTimer(timer);
+    if (deadline)
+    {
+        deadline->unpark();
+    }
+    return sleeper.cancelled;
+}
+
+int Fiber::SleepUntil(Timestamp when)
+{
+    int64_t us = when.microSecondsSinceEpoch() - Timestamp::now(Timestamp::MONOTONIC).microSecondsSinceEpoch();
+    return SleepFor(us > 0 ? static_cast<uint64_t>((us + 999) / 1000) : 0);
+}
+
 uint64_t Fiber::CurrentFiberId()
 {
     if (t_running_fiber)
@@ -1,9 +1,11 @@
 #ifndef __EASY_FIBER_H__
 #define __EASY_FIBER_H__
 
+#include "easy/base/Callback.h"
+#include "easy/base/Context.h"
+#include "easy/base/Timestamp.h"
 #include "easy/base/noncopyable.h"
 
-#include <ucontext.h>
 #include <cstdint>
 #include <functional>
 #include <memory>
@@ -11,20 +13,27 @@
 namespace easy
 {
 class Fiber;
+class Deadline;
 
 Fiber* NewFiber();
 
-Fiber* NewFiber(std::function<void()> cb, size_t stacksize = 0, bool use_caller = false);
+Fiber* NewFiber(Callback cb, size_t stacksize = 0, bool use_caller = false);
 
 void FreeFiber(Fiber* ptr);
 
+// same as Fiber::ptr(NewFiber(...), FreeFiber), but the shared_ptr control block
+// also lives in the stack block, no heap allocation once the stack pool is warm
+std::shared_ptr<Fiber> MakeFiber(Callback cb, size_t stacksize = 0, bool use_caller = false);
+
 class Fiber : noncopyable, public std::enable_shared_from_this<Fiber>
 {
-    friend Fiber* NewFiber();
-    friend Fiber* NewFiber(std::function<void()> cb, size_t stacksize, bool use_caller);
-    friend void   FreeFiber(Fiber* ptr);
+    friend Fiber*                 NewFiber();
+    friend Fiber*                 NewFiber(Callback cb, size_t stacksize, bool use_caller);
+    friend void                   FreeFiber(Fiber* ptr);
+    friend std::shared_ptr<Fiber> MakeFiber(Callback cb, size_t stacksize, bool use_caller);
 
     friend class Scheduler;
+    friend class Deadline;
 
   public:
     typedef std::shared_ptr<Fiber> ptr;
@@ -39,7 +48,7 @@ class Fiber : noncopyable, public std::enable_shared_from_this<Fiber>
         EXCEPT
     };
 
-    Fiber(std::function<void()> cb, size_t stacksize = 0, bool use_caller = false);
+    Fiber(Callback cb, size_t stacksize = 0, bool use_caller = false);
 
     ~Fiber();
 
@@ -51,7 +60,7 @@ class Fiber : noncopyable, public std::enable_shared_from_this<Fiber>
 
     void yield();
 
-    void reset(std::function<void()> cb);
+    void reset(Callback cb);
 
     uint64_t id() const { return id_; }
 
@@ -59,23 +68,42 @@ class Fiber : noncopyable, public std::enable_shared_from_this<Fiber>
 
     bool finish() const { return (state_ == TERM || state_ == EXCEPT); }
 
+    size_t stackSize() const { return stacksize_; }
+
+    // deepest stack use so far in bytes, see StackPool::HighWater
+    size_t stackHighWater() const;
+
     static void       SetThis(Fiber* co);
     static Fiber::ptr GetThis();
     static void       YieldToHold();
     static uint64_t   CurrentFiberId();
 
+    // the innermost Deadline of the running fiber, nullptr if there is none
+    static Deadline* CurrentDeadline();
+
+    // parks the running fiber on an embedded timer of its IOManager, no allocation
+    // it is requeued to the thread it slept on, 0 or the errno of its Deadline if that ended first
+    static int SleepFor(uint64_t ms);
+
+    // until a CLOCK_MONOTONIC time
+    static int SleepUntil(Timestamp when);
+
   private:
     Fiber();  // root Fiber only
 
+    Fiber(Callback cb, size_t stacksize, bool use_caller, void* stack);
+
     static void MainFunc();
 
   private:
-    uint64_t              id_{0};
-    size_t                stacksize_{0};
-    State                 state_{State::INIT};
-    ucontext_t            ctx_;
-    void*                 stack_{nullptr};
-    std::function<void()> cb_;
+    uint64_t     id_{0};
+    size_t       stacksize_{0};
+    State        state_{State::INIT};
+    FiberContext ctx_;
+    void*        stack_{nullptr};
+    size_t       allocsize_{0};  // block size when allocated by NewFiber
+    Callback     cb_;
+    Deadline*    deadline_{nullptr};  // on the stack of this fiber
 };
 
 }  // namespace easy
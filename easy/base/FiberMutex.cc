@@ -0,0 +1,282 @@
+#include "easy/base/FiberMutex.h"
+#include "easy/base/Macro.h"
+#include "easy/base/Scheduler.h"
+
+namespace easy
+{
+FiberWaiter::FiberWaiter() : fiber_(Fiber::GetThis()), scheduler_(Scheduler::GetThis()), threadId_(Scheduler::CurrentThreadId())
+{
+    EASY_ASSERT_MESSAGE(scheduler_ && threadId_ >= 0, "a fiber primitive waits outside a scheduler");
+    scheduler_->parkedFibers_.increment();  // the workers do not stop under it
+}
+
+void FiberWaiter::wake()
+{
+    Scheduler* scheduler = scheduler_;
+    scheduler->schedule(std::move(fiber_), threadId_);
+    scheduler->parkedFibers_.decrement();
+}
+
+void FiberWaitQueue::push_back(FiberWaiter* waiter)
+{
+    waiter->next_ = nullptr;
+    if (tail_)
+    {
+        tail_->next_ = waiter;
+    }
+    else
+    {
+        head_ = waiter;
+    }
+    tail_ = waiter;
+}
+
+void FiberWaitQueue::push_front(FiberWaiter* waiter)
+{
+    waiter->next_ = head_;
+    head_         = waiter;
+    if (!tail_)
+    {
+        tail_ = waiter;
+    }
+}
+
+FiberWaiter* FiberWaitQueue::pop_front()
+{
+    FiberWaiter* waiter = head_;
+    if (waiter)
+    {
+        head_ = waiter->next_;
+        if (!head_)
+        {
+            tail_ = nullptr;
+        }
+    }
+    return waiter;
+}
+
+// lock is held, it is released before the fiber yields
+static void Park(SpinLock& lock, FiberWaitQueue& waiters, FiberWaiter& waiter)
+{
+    waiters.push_back(&waiter);
+    lock.unlock();
+    Fiber::YieldToHold();
+}
+
+void FiberMutex::lock()
+{
+    bool woken = false;
+    while (true)
+    {
+        lock_.lock();
+        if (!locked_)
+        {
+            locked_ = true;
+            lock_.unlock();
+            return;
+        }
+        // a running fiber took it first, the woken one waits in front again
+        FiberWaiter waiter;
+        if (woken)
+        {
+            waiters_.push_front(&waiter);
+        }
+        else
+        {
+            waiters_.push_back(&waiter);
+        }
+        lock_.unlock();
+        Fiber::YieldToHold();
+        woken = true;
+    }
+}
+
+bool FiberMutex::tryLock()
+{
+    SpinLockGuard _(lock_);
+    if (locked_)
+    {
+        return false;
+    }
+    locked_ = true;
+    return true;
+}
+
+void FiberMutex::unlock()
+{
+    lock_.lock();
+    EASY_ASSERT(locked_);
+    // not handed over, a fiber that runs takes it without a switch, the woken one competes
+    locked_             = false;
+    FiberWaiter* waiter = waiters_.pop_front();
+    lock_.unlock();
+    if (waiter)
+    {
+        waiter->wake();
+    }
+}
+
+void FiberCondition::wait()
+{
+    FiberWaiter waiter;
+    lock_.lock();
+    waiters_.push_back(&waiter);
+    lock_.unlock();
+    // a notify from here on requeues the fiber to this thread, it runs once the fiber yielded
+    mutex_.unlock();
+    Fiber::YieldToHold();
+    mutex_.lock();
+}
+
+void FiberCondition::notify()
+{
+    lock_.lock();
+    FiberWaiter* waiter = waiters_.pop_front();
+    lock_.unlock();
+    if (waiter)
+    {
+        waiter->wake();
+    }
+}
+
+void FiberCondition::notifyAll()
+{
+    lock_.lock();
+    FiberWaitQueue waiters;
+    while (FiberWaiter* waiter = waiters_.pop_front())
+    {
+        waiters.push_back(waiter);
+    }
+    lock_.unlock();
+    while (FiberWaiter* waiter = waiters.pop_front())
+    {
+        waiter->wake();  // popped before, the waiter goes away with its fiber
+    }
+}
+
+void FiberSemaphore::wait()
+{
+    lock_.lock();
+    if (count_ > 0)
+    {
+        --count_;
+        lock_.unlock();
+        return;
+    }
+    FiberWaiter waiter;
+    Park(lock_, waiters_, waiter);  // notify handed the count over
+}
+
+bool FiberSemaphore::tryWait()
+{
+    SpinLockGuard _(lock_);
+    if (!count_)
+    {
+        return false;
+    }
+    --count_;
+    return true;
+}
+
+void FiberSemaphore::notify()
+{
+    lock_.lock();
+    FiberWaiter* waiter = waiters_.pop_front();
+    if (!waiter)
+    {
+        ++count_;
+    }
+    lock_.unlock();
+    if (waiter)
+    {
+        waiter->wake();
+    }
+}
+
+void FiberRWLock::rdlock()
+{
+    while (true)
+    {
+        lock_.lock();
+        if (!writer_ && !writersWaiting_)
+        {
+            ++readers_;
+            lock_.unlock();
+            return;
+        }
+        FiberWaiter waiter;
+        Park(lock_, readWaiters_, waiter);
+    }
+}
+
+void FiberRWLock::wrlock()
+{
+    bool woken = false;
+    while (true)
+    {
+        lock_.lock();
+        if (!writer_ && !readers_)
+        {
+            writer_ = true;
+            if (woken)
+            {
+                --writersWaiting_;
+            }
+            lock_.unlock();
+            return;
+        }
+        FiberWaiter waiter;
+        if (woken)
+        {
+            writeWaiters_.push_front(&waiter);
+        }
+        else
+        {
+            ++writersWaiting_;
+            writeWaiters_.push_back(&waiter);
+        }
+        lock_.unlock();
+        Fiber::YieldToHold();
+        woken = true;
+    }
+}
+
+void FiberRWLock::unlock()
+{
+    FiberWaitQueue wake;
+    lock_.lock();
+    if (writer_)
+    {
+        writer_ = false;
+    }
+    else
+    {
+        EASY_ASSERT(readers_ > 0);
+        --readers_;
+    }
+    if (!writer_ && !readers_)
+    {
+        if (writersWaiting_)
+        {
+            // none if the woken writer has not run yet, its unlock wakes the next
+            if (FiberWaiter* waiter = writeWaiters_.pop_front())
+            {
+                wake.push_back(waiter);
+            }
+        }
+        else
+        {
+            while (FiberWaiter* waiter = readWaiters_.pop_front())
+            {
+                wake.push_back(waiter);
+            }
+        }
+    }
+    lock_.unlock();
+    while (FiberWaiter* waiter = wake.pop_front())
+    {
+        waiter->wake();
+    }
+}
+
+}  // namespace easy
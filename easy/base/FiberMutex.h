@@ -0,0 +1,159 @@
+#ifndef __EASY_FIBER_MUTEX_H__
+#define __EASY_FIBER_MUTEX_H__
+
+#include "easy/base/Fiber.h"
+#include "easy/base/Mutex.h"
+#include "easy/base/noncopyable.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace easy
+{
+class Scheduler;
+
+// a parked fiber, on its own stack
+struct FiberWaiter : noncopyable
+{
+    FiberWaiter();
+
+    // requeues the fiber to the thread it parked on, it cannot run there before it has yielded
+    // this may be gone once it returns
+    void wake();
+
+    Fiber::ptr   fiber_;
+    Scheduler*   scheduler_;
+    int          threadId_;
+    FiberWaiter* next_{nullptr};
+};
+
+// FIFO of parked fibers, the owner locks
+class FiberWaitQueue : noncopyable
+{
+  public:
+    bool empty() const { return !head_; }
+
+    void push_back(FiberWaiter* waiter);
+
+    void push_front(FiberWaiter* waiter);
+
+    FiberWaiter* front() const { return head_; }
+
+    FiberWaiter* pop_front();
+
+  private:
+    FiberWaiter* head_{nullptr};
+    FiberWaiter* tail_{nullptr};
+};
+
+// the primitives below park the calling fiber and yield to its Scheduler instead of blocking the thread
+// a fiber that holds one may yield or do hooked io, the other fibers of its thread keep running
+// they must be used from fibers of a Scheduler, waiters are woken in FIFO order
+// unlock wakes the first waiter without handing the mutex over, a running fiber may take it first
+class FiberMutex : noncopyable
+{
+  public:
+    void lock();
+
+    bool tryLock();
+
+    void unlock();
+
+  private:
+    SpinLock       lock_;
+    bool           locked_{false};
+    FiberWaitQueue waiters_;
+};
+
+class FiberMutexGuard : noncopyable
+{
+  public:
+    FiberMutexGuard(FiberMutex& mutex) : mutex_(mutex) { mutex_.lock(); }
+
+    ~FiberMutexGuard() { mutex_.unlock(); }
+
+  private:
+    FiberMutex& mutex_;
+};
+
+class FiberCondition : noncopyable
+{
+  public:
+    FiberCondition(FiberMutex& mutex) : mutex_(mutex) {}
+
+    // mutex held, it is released while parked and held again on return
+    void wait();
+
+    void notify();
+
+    void notifyAll();
+
+  private:
+    FiberMutex&    mutex_;
+    SpinLock       lock_;
+    FiberWaitQueue waiters_;
+};
+
+// a permit is handed to the first waiter
+class FiberSemaphore : noncopyable
+{
+  public:
+    FiberSemaphore(uint32_t count = 0) : count_(count) {}
+
+    void wait();
+
+    bool tryWait();
+
+    void notify();
+
+  private:
+    SpinLock       lock_;
+    uint32_t       count_;
+    FiberWaitQueue waiters_;
+};
+
+// a writer waiting keeps new readers out, the readers wait until no writer does
+// like FiberMutex the woken fibers compete for it
+class FiberRWLock : noncopyable
+{
+  public:
+    void rdlock();
+
+    void wrlock();
+
+    void unlock();
+
+  private:
+    SpinLock       lock_;
+    size_t         readers_{0};
+    bool           writer_{false};
+    size_t         writersWaiting_{0};  // parked or woken and not in yet
+    FiberWaitQueue readWaiters_;
+    FiberWaitQueue writeWaiters_;
+};
+
+class FiberReadLockGuard : noncopyable
+{
+  public:
+    FiberReadLockGuard(FiberRWLock& mutex) : mutex_(mutex) { mutex_.rdlock(); }
+
+    ~FiberReadLockGuard() { mutex_.unlock(); }
+
+  private:
+    FiberRWLock& mutex_;
+};
+
+class FiberWriteLockGuard : noncopyable
+{
+  public:
+    FiberWriteLockGuard(FiberRWLock& mutex) : mutex_(mutex) { mutex_.wrlock(); }
+
+    ~FiberWriteLockGuard() { mutex_.unlock(); }
+
+  private:
+    FiberRWLock& mutex_;
+};
+
+}  // namespace easy
+
+#endif
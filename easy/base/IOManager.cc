@@ -1,12 +1,15 @@
 #include "easy/base/IOManager.h"
+#include "easy/base/Config.h"
 #include "easy/base/Logger.h"
 #include "easy/base/Macro.h"
 #include "easy/base/Mutex.h"
 #include "easy/base/Scheduler.h"
+#include "easy/base/Uring.h"
 
 #include <fcntl.h>
 #include <signal.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 #include <functional>
 
@@ -22,30 +25,99 @@ IgnoreSigPipe initObj;
 
 static Logger::ptr logger = ELOG_NAME("system");
 
+static ConfigVar<bool>::ptr iomanager_loop_per_thread = Config::Lookup<bool>("iomanager.loop_per_thread",
+    false,
+    "every thread waits on its own epoll fd, an fd stays with the thread that registered it, read when an IOManager is created");
+
+static ConfigVar<bool>::ptr iomanager_per_thread_timers = Config::Lookup<bool>("iomanager.per_thread_timers",
+    false,
+    "with loop_per_thread, a timer added on a worker thread is queued and fired by that thread without the shared lock and timerfd, "
+    "read when an IOManager is created");
+
+static ConfigVar<bool>::ptr iomanager_epoll_timers = Config::Lookup<bool>("iomanager.epoll_timers",
+    false,
+    "the earliest timer becomes the epoll_wait timeout, epoll_pwait2 for sub millisecond precision, "
+    "the timerfd is only set when a thread waits on a later deadline, read when an IOManager is created");
+
+static ConfigVar<bool>::ptr iomanager_persistent_events = Config::Lookup<bool>("iomanager.persistent_events",
+    false,
+    "fds stay registered edge triggered for their lifetime and readiness is kept in Channel, read when an IOManager is created");
+
+static ConfigVar<bool>::ptr iomanager_io_uring = Config::Lookup<bool>("iomanager.io_uring",
+    false,
+    "hooked socket io that would block completes through io_uring, epoll if the kernel lacks it, read when an IOManager is created");
+
+static ConfigVar<uint32_t>::ptr iomanager_io_uring_entries =
+    Config::Lookup<uint32_t>("iomanager.io_uring_entries", 256, "io_uring submission queue size, the completion queue is 4 times larger");
+
+static AtomicInt<uint64_t> s_epoll_waits{0};
+static AtomicInt<uint64_t> s_timerfd_sets{0};
+static AtomicInt<uint64_t> s_epoll_ctls{0};
+static AtomicInt<uint64_t> s_wakeups{0};
+static AtomicInt<uint64_t> s_uring_enters{0};
+static AtomicInt<uint64_t> s_uring_sqes{0};
+
 IOManager::IOManager(int threadNums, bool use_caller, const std::string& name) : Scheduler(threadNums, use_caller, name)
 {
-    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
-    EASY_ASSERT(epollFd_ > 0);
+    persistent_      = iomanager_persistent_events->value();
+    epollTimers_     = iomanager_epoll_timers->value();
+    perThreadTimers_ = iomanager_per_thread_timers->value() && iomanager_loop_per_thread->value() && threadNums > 1;
 
-    EASY_CHECK(pipe(weakupFds_));
+    EASY_CHECK(fcntl(timerfd(), F_SETFL, O_NONBLOCK /*| O_CLOEXEC*/));
 
-    epoll_event event;
-    memset(&event, 0, sizeof(epoll_event));
-    event.events  = EPOLLIN | EPOLLET;  // epoll lt
-    event.data.fd = weakupFds_[0];
+#ifdef EASY_HAS_IO_URING
+    if (iomanager_io_uring->value())
+    {
+        uring_.reset(new Uring(iomanager_io_uring_entries->value()));
+        if (!uring_->valid())
+        {
+            ELOG_WARN(logger) << "io_uring is not available, " << name << " falls back to epoll";
+            uring_.reset();
+        }
+    }
+#endif
 
-    EASY_CHECK(fcntl(weakupFds_[0], F_SETFL, O_NONBLOCK /*| O_CLOEXEC*/));
+    size_t nloops = iomanager_loop_per_thread->value() ? static_cast<size_t>(threadNums) : 1;
+    for (size_t i = 0; i < nloops; ++i)
+    {
+        std::unique_ptr<Loop> loop(new Loop);
+        loop->owner_ = this;
+        loop->index_ = static_cast<int>(i);
 
-    EASY_CHECK(epoll_ctl(epollFd_, EPOLL_CTL_ADD, weakupFds_[0], &event));
+        loop->epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+        EASY_ASSERT(loop->epollFd_ > 0);
 
-    event.data.fd = timerfd();
+        loop->weakupFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        EASY_ASSERT(loop->weakupFd_ > 0);
 
-    EASY_CHECK(fcntl(timerfd(), F_SETFL, O_NONBLOCK /*| O_CLOEXEC*/));
+        epoll_event event;
+        memset(&event, 0, sizeof(epoll_event));
+        event.events  = EPOLLIN | EPOLLET;  // epoll lt
+        event.data.fd = loop->weakupFd_;
+
+        EASY_CHECK(epoll_ctl(loop->epollFd_, EPOLL_CTL_ADD, loop->weakupFd_, &event));
 
-    EASY_CHECK(epoll_ctl(epollFd_, EPOLL_CTL_ADD, timerfd(), &event));
+        if (i == 0)
+        {
+            // only the timer loop sees the timer, an expiry does not wake every loop
+            event.data.fd = timerfd();
+
+            EASY_CHECK(epoll_ctl(loop->epollFd_, EPOLL_CTL_ADD, timerfd(), &event));
+        }
+
+#ifdef EASY_HAS_IO_URING
+        if (uring_)
+        {
+            // readable while completions wait in the cq ring, the first loop to get cqLock_ reaps them
+            event.data.fd = uring_->fd();
+            EASY_CHECK(epoll_ctl(loop->epollFd_, EPOLL_CTL_ADD, uring_->fd(), &event));
+        }
+#endif
+
+        loops_.push_back(std::move(loop));
+    }
 
     resizeChannels(32);  // speed up
-    resizeRevent(32);
 
     start();  // Scheduler::start
 }
@@ -54,9 +126,11 @@ IOManager::~IOManager()
 {
     stop();  // Scheduler::stop
 
-    close(epollFd_);
-    close(weakupFds_[0]);
-    close(weakupFds_[1]);
+    for (auto& loop : loops_)
+    {
+        close(loop->epollFd_);
+        close(loop->weakupFd_);
+    }
 
     for (size_t i = 0; i < channels_.size(); ++i)
     {
@@ -65,14 +139,6 @@ IOManager::~IOManager()
             delete channels_[i];
         }
     }
-
-    for (size_t i = 0; i < events_.size(); ++i)
-    {
-        if (events_[i])
-        {
-            delete events_[i];
-        }
-    }
 }
 
 void IOManager::resizeChannels(size_t size)
@@ -89,19 +155,6 @@ void IOManager::resizeChannels(size_t size)
     }
 }
 
-void IOManager::resizeRevent(size_t size)
-{
-    events_.resize(size);
-
-    for (size_t i = 0; i < events_.size(); ++i)
-    {
-        if (!events_[i])
-        {
-            events_[i] = new epoll_event;
-        }
-    }
-}
-
 int IOManager::addEvent(int fd, Channel::Event event, std::function<void()> cb)
 {
     Channel* channel = nullptr;
@@ -129,15 +182,36 @@ int IOManager::addEvent(int fd, Channel::Event event, std::function<void()> cb)
         return -1;
     }
 
-    int         op = channel->events_ ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
-    epoll_event epevent;
-    epevent.events   = EPOLLET | static_cast<EPOLL_EVENTS>(channel->events_ | event);
-    epevent.data.ptr = channel;
-
-    if (epoll_ctl(epollFd_, op, fd, &epevent))
+    if (persistent_)
     {
-        ELOG_ERROR(logger) << strerror(errno);
-        return -1;
+        if (channel->ready_ & event)
+        {
+            // the edge came while nobody waited, the io can be retried right away
+            channel->ready_ = static_cast<Channel::Event>(channel->ready_ & ~event);
+            return 1;
+        }
+        if (!channel->registered_)
+        {
+            // registered once for both directions, readiness at EPOLL_CTL_ADD is reported too
+            channel->loop_ = pickLoop();
+            if (control(channel, EPOLL_CTL_ADD, Channel::READ | Channel::WRITE))
+            {
+                return -1;
+            }
+            channel->registered_ = true;
+        }
+    }
+    else
+    {
+        if (!channel->events_)
+        {
+            channel->loop_ = pickLoop();  // not in any epoll set now
+        }
+        int op = channel->events_ ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (control(channel, op, channel->events_ | event))
+        {
+            return -1;
+        }
     }
 
     pendingEventCount_.increment();
@@ -182,14 +256,8 @@ bool IOManager::removeEvent(int fd, Channel::Event event)
     }
 
     Channel::Event new_events = static_cast<Channel::Event>(channel->events_ & ~event);
-    int            option     = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-    epoll_event    epevent;
-    epevent.events   = EPOLLET | static_cast<EPOLL_EVENTS>(new_events);
-    epevent.data.ptr = channel;
-
-    if (epoll_ctl(epollFd_, option, fd, &epevent))
+    if (!persistent_ && control(channel, new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL, new_events))
     {
-        ELOG_ERROR(logger) << strerror(errno);
         return false;
     }
 
@@ -221,18 +289,12 @@ bool IOManager::cancelEvent(int fd, Channel::Event event)
     }
 
     Channel::Event new_events = static_cast<Channel::Event>(channel->events_ & ~event);
-    int            option     = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-    epoll_event    epevent;
-    epevent.events   = EPOLLET | static_cast<EPOLL_EVENTS>(new_events);
-    epevent.data.ptr = channel;
-
-    if (epoll_ctl(epollFd_, option, fd, &epevent))
+    if (!persistent_ && control(channel, new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL, new_events))
     {
-        ELOG_ERROR(logger) << strerror(errno);
         return false;
     }
 
-    channel->handleEvent(event);
+    channel->handleEvent(event, loopThread(channel));
     pendingEventCount_.decrement();
     return true;
 }
@@ -250,31 +312,41 @@ bool IOManager::cancelAll(int fd)
         channel = channels_[idx];
     }
 
+    if (uring_)
+    {
+        uringCancel(channel);
+    }
+
     SpinLockGuard _(channel->lock_);
+    if (persistent_ && channel->registered_)
+    {
+        // the fd is about to be closed, the next one with this number registers again
+        channel->registered_ = false;
+        channel->ready_      = Channel::NONE;
+        if (control(channel, EPOLL_CTL_DEL, 0) && !channel->events_)
+        {
+            return false;
+        }
+    }
     if (!channel->events_)
     {
         return false;
     }
 
-    int         option = EPOLL_CTL_DEL;
-    epoll_event epevent;
-    epevent.events   = 0;
-    epevent.data.ptr = channel;
-
-    if (epoll_ctl(epollFd_, option, fd, &epevent))
+    if (!persistent_ && control(channel, EPOLL_CTL_DEL, 0))
     {
-        ELOG_ERROR(logger) << strerror(errno);
         return false;
     }
 
+    int threadId = loopThread(channel);
     if (channel->events_ & Channel::READ)
     {
-        channel->handleEvent(Channel::READ);
+        channel->handleEvent(Channel::READ, threadId);
         pendingEventCount_.decrement();
     }
     if (channel->events_ & Channel::WRITE)
     {
-        channel->handleEvent(Channel::WRITE);
+        channel->handleEvent(Channel::WRITE, threadId);
         pendingEventCount_.decrement();
     }
     EASY_ASSERT(channel->events_ == 0);
@@ -283,40 +355,658 @@ bool IOManager::cancelAll(int fd)
 
 IOManager* IOManager::GetThis() { return dynamic_cast<IOManager*>(Scheduler::GetThis()); }
 
-void IOManager::weakup()
+IOManager::Stats IOManager::GetStats()
+{
+    Stats stats;
+    stats.epollWaits  = s_epoll_waits.get();
+    stats.epollCtls   = s_epoll_ctls.get();
+    stats.wakeups     = s_wakeups.get();
+    stats.uringEnters = s_uring_enters.get();
+    stats.uringSqes   = s_uring_sqes.get();
+    stats.timerfdSets = s_timerfd_sets.get();
+    return stats;
+}
+
+Channel* IOManager::getChannel(int fd, bool create)
+{
+    size_t        idx = static_cast<size_t>(fd);
+    ReadLockGuard lock(lock_);
+    if (channels_.size() > idx)
+    {
+        return channels_[idx];
+    }
+    lock.unlock();
+    if (!create)
+    {
+        return nullptr;
+    }
+    WriteLockGuard _(lock_);
+    if (channels_.size() <= idx)
+    {
+        resizeChannels(idx << 1);
+    }
+    return channels_[idx];
+}
+
+#ifdef EASY_HAS_IO_URING
+
+// user_data of the io_uring requests, a UringOp* has the low 2 bits clear
+static const uint64_t kUringTagMask = 3;
+static const uint64_t kUringTimeout = 1;  // linked timeout, the request itself completes with -ECANCELED
+static const uint64_t kUringAccept  = 2;  // fd << 32 | closeGen << 2 | kUringAccept
+static const uint64_t kUringCancel  = 3;
+static const uint32_t kUringGenMask = 0x3fffffff;
+
+struct IOManager::UringOp
+{
+    Channel*          channel  = nullptr;
+    uint8_t           opcode   = IORING_OP_NOP;
+    int               fd       = -1;
+    uint64_t          addr     = 0;
+    uint32_t          len      = 0;
+    uint64_t          off      = 0;
+    uint32_t          msgFlags = 0;
+    __kernel_timespec ts;
+    Fiber::ptr        fiber;
+    int               threadId = -1;
+    uint32_t          closeGen = 0;
+    int               res      = 0;
+};
+
+ssize_t IOManager::uringIo(IoOp op, int fd, void* buf, size_t len, int flags, uint64_t timeout_ms)
+{
+    UringOp req;
+    switch (op)
+    {
+        case IO_READ: req.opcode = IORING_OP_READ; break;
+        case IO_WRITE: req.opcode = IORING_OP_WRITE; break;
+        case IO_RECV: req.opcode = IORING_OP_RECV; break;
+        case IO_SEND: req.opcode = IORING_OP_SEND; break;
+    }
+    req.fd       = fd;
+    req.addr     = reinterpret_cast<uint64_t>(buf);
+    req.len      = static_cast<uint32_t>(std::min<size_t>(len, UINT32_MAX));  // a short count is fine for a socket
+    req.off      = op == IO_READ || op == IO_WRITE ? static_cast<uint64_t>(-1) : 0;  // current position
+    req.msgFlags = static_cast<uint32_t>(flags);
+    return uringWait(req, timeout_ms);
+}
+
+int IOManager::uringConnect(int fd, const sockaddr* addr, socklen_t addrlen, uint64_t timeout_ms)
+{
+    UringOp req;
+    req.opcode = IORING_OP_CONNECT;
+    req.fd     = fd;
+    req.addr   = reinterpret_cast<uint64_t>(addr);
+    req.off    = addrlen;
+    return static_cast<int>(uringWait(req, timeout_ms));
+}
+
+ssize_t IOManager::uringWait(UringOp& op, uint64_t timeout_ms)
+{
+    EASY_ASSERT(uring_);
+    bool     timed   = timeout_ms != -1UL;
+    unsigned need    = timed ? 2 : 1;
+    Channel* channel = getChannel(op.fd, true);
+    op.channel       = channel;
+    op.fiber         = Fiber::GetThis();
+    op.threadId      = loopPerThread() ? Thread::GetCurrentThreadId() : -1;
+    if (timed)
+    {
+        op.ts.tv_sec  = static_cast<int64_t>(timeout_ms / 1000);
+        op.ts.tv_nsec = static_cast<long long>(timeout_ms % 1000 * 1000 * 1000);
+    }
+    {
+        SpinLockGuard _(channel->lock_);
+        op.closeGen = channel->closeGen_;
+        ++channel->uringInflight_;
+    }
+    {
+        MutexLockGuard lock(sqLock_);
+        if (uring_->space() < need)
+        {
+            uringSubmit();
+        }
+        if (EASY_UNLIKELY(uring_->space() < need))
+        {
+            SpinLockGuard _(channel->lock_);
+            --channel->uringInflight_;
+            op.fiber.reset();
+            errno = ENOSYS;  // the kernel does not keep up, wait on epoll this time
+            return -1;
+        }
+        io_uring_sqe* sqe = uring_->getSqe();
+        sqe->opcode       = op.opcode;
+        sqe->fd           = op.fd;
+        sqe->addr         = op.addr;
+        sqe->len          = op.len;
+        sqe->off          = op.off;
+        sqe->msg_flags    = op.msgFlags;
+        sqe->user_data    = reinterpret_cast<uint64_t>(&op);
+        if (timed)
+        {
+            sqe->flags |= IOSQE_IO_LINK;
+            io_uring_sqe* tsqe = uring_->getSqe();
+            tsqe->opcode       = IORING_OP_LINK_TIMEOUT;
+            tsqe->fd           = -1;
+            tsqe->addr         = reinterpret_cast<uint64_t>(&op.ts);
+            tsqe->len          = 1;
+            tsqe->user_data    = kUringTimeout;
+        }
+        pendingEventCount_.increment();
+        if (uring_->pending() >= kSubmitBatch)
+        {
+            uringSubmit();
+        }
+    }
+
+    // resumed by uringReap, op.res is the result of the syscall
+    Fiber::YieldToHold();
+
+    if (op.res >= 0)
+    {
+        return op.res;
+    }
+    errno = -op.res;
+    if (op.res == -ECANCELED)
+    {
+        SpinLockGuard _(channel->lock_);
+        errno = channel->closeGen_ != op.closeGen ? EBADF : timed ? ETIMEDOUT : ECANCELED;
+    }
+    return -1;
+}
+
+int IOManager::uringAccept(int fd, uint64_t timeout_ms)
+{
+    EASY_ASSERT(uring_);
+    Channel*             channel = getChannel(fd, true);
+    std::shared_ptr<int> timedout;
+    Timer::ptr           timer;
+    if (timeout_ms != -1UL)
+    {
+        timedout = std::make_shared<int>(0);
+        std::weak_ptr<int> wflag(timedout);
+        timer = addConditionTimer(
+            timeout_ms,
+            [this, channel, wflag]() {
+                auto       flag = wflag.lock();
+                Fiber::ptr waiter;
+                int        threadId = -1;
+                {
+                    SpinLockGuard _(channel->lock_);
+                    if (!flag)
+                    {
+                        return;
+                    }
+                    *flag    = 1;
+                    waiter   = std::move(channel->acceptWaiter_);
+                    threadId = channel->acceptThread_;
+                }
+                if (waiter)
+                {
+                    schedule(std::move(waiter), threadId);
+                    pendingEventCount_.decrement();
+                }
+            },
+            wflag,
+            false,
+            true);
+    }
+
+    int      ret = 0;
+    uint32_t gen = 0;
+    {
+        SpinLockGuard _(channel->lock_);
+        gen = channel->closeGen_;
+    }
+    while (true)
+    {
+        {
+            SpinLockGuard _(channel->lock_);
+            if (!channel->accepted_.empty())
+            {
+                ret = channel->accepted_.front();
+                channel->accepted_.pop_front();
+                break;
+            }
+            if (channel->closeGen_ != gen)
+            {
+                ret = -EBADF;
+                break;
+            }
+            if (timedout && *timedout)
+            {
+                ret = -ETIMEDOUT;
+                break;
+            }
+            if (!multishotAccept_.get() || channel->acceptWaiter_ || (!channel->acceptArmed_ && !uringArmAccept(channel)))
+            {
+                ret = -ENOSYS;  // accept on epoll
+                break;
+            }
+            channel->acceptWaiter_ = Fiber::GetThis();
+            channel->acceptThread_ = loopPerThread() ? Thread::GetCurrentThreadId() : -1;
+            pendingEventCount_.increment();
+        }
+        Fiber::YieldToHold();
+    }
+    if (timer)
+    {
+        timer->cancel();
+    }
+    if (ret < 0)
+    {
+        errno = -ret;
+        return -1;
+    }
+    return ret;
+}
+
+bool IOManager::uringArmAccept(Channel* channel)
+{
+#ifdef IORING_ACCEPT_MULTISHOT
+    MutexLockGuard _(sqLock_);
+    if (!uring_->space())
+    {
+        uringSubmit();
+        if (!uring_->space())
+        {
+            return false;
+        }
+    }
+    io_uring_sqe* sqe = uring_->getSqe();
+    sqe->opcode       = IORING_OP_ACCEPT;
+    sqe->fd           = channel->fd_;
+    sqe->ioprio       = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data    = static_cast<uint64_t>(channel->fd_) << 32 | static_cast<uint64_t>(channel->closeGen_ & kUringGenMask) << 2 | kUringAccept;
+    channel->acceptArmed_ = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void IOManager::uringSubmit()
+{
+    if (!uring_->pending())
+    {
+        return;
+    }
+    s_uring_enters.increment();
+    int ret = uring_->submit();
+    if (ret > 0)
+    {
+        s_uring_sqes.fetchAndAdd(static_cast<uint64_t>(ret));
+    }
+    else if (ret < 0 && ret != -EAGAIN && ret != -EBUSY && ret != -EINTR)
+    {
+        ELOG_ERROR(logger) << "io_uring_enter " << strerror(-ret);
+    }
+}
+
+void IOManager::uringReap()
+{
+    MutexLockGuard lock(cqLock_);
+    uring_->reap([this](const io_uring_cqe& cqe) {
+        uint64_t tag = cqe.user_data & kUringTagMask;
+        if (tag == kUringAccept)
+        {
+            int        fd      = static_cast<int>(cqe.user_data >> 32);
+            uint32_t   gen     = static_cast<uint32_t>(cqe.user_data >> 2) & kUringGenMask;
+            Channel*   channel = getChannel(fd, false);
+            Fiber::ptr waiter;
+            int        threadId = -1;
+            int        stale    = cqe.res;
+            if (channel)
+            {
+                SpinLockGuard _(channel->lock_);
+                if ((channel->closeGen_ & kUringGenMask) == gen)
+                {
+                    stale = -1;
+                    if (!(cqe.flags & IORING_CQE_F_MORE))
+                    {
+                        channel->acceptArmed_ = false;  // armed again by the next accept
+                    }
+                    if (cqe.res == -EINVAL)
+                    {
+                        multishotAccept_.set(0);  // before 5.19, the waiter goes to epoll
+                    }
+                    else if (cqe.res != -ECANCELED)
+                    {
+                        channel->accepted_.push_back(cqe.res);
+                    }
+                    waiter   = std::move(channel->acceptWaiter_);
+                    threadId = channel->acceptThread_;
+                }
+            }
+            if (stale >= 0)
+            {
+                ::close(stale);  // accepted after the listening fd was closed
+            }
+            if (waiter)
+            {
+                schedule(std::move(waiter), threadId);
+                pendingEventCount_.decrement();
+            }
+            return;
+        }
+        if (tag != 0 || !cqe.user_data)
+        {
+            return;  // linked timeout or cancel
+        }
+        UringOp* op = reinterpret_cast<UringOp*>(cqe.user_data);
+        {
+            SpinLockGuard _(op->channel->lock_);
+            --op->channel->uringInflight_;
+        }
+        Fiber::ptr fiber    = std::move(op->fiber);
+        int        threadId = op->threadId;
+        op->res             = cqe.res;  // op is gone once the fiber runs
+        schedule(std::move(fiber), threadId);
+        pendingEventCount_.decrement();
+    });
+}
+
+void IOManager::uringCancel(Channel* channel)
 {
-    if (!hasIdleThread())
+    std::deque<int> fds;
+    Fiber::ptr      waiter;
+    int             threadId = -1;
+    bool            inflight = false;
+    {
+        SpinLockGuard _(channel->lock_);
+        ++channel->closeGen_;
+        inflight              = channel->uringInflight_ > 0 || channel->acceptArmed_;
+        channel->acceptArmed_ = false;
+        fds.swap(channel->accepted_);
+        waiter   = std::move(channel->acceptWaiter_);
+        threadId = channel->acceptThread_;
+    }
+    for (int fd : fds)
     {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+#ifdef IORING_ASYNC_CANCEL_FD
+    if (inflight)
+    {
+        // the kernel holds the file of a request in flight, closing the fd alone does not stop it
+        MutexLockGuard _(sqLock_);
+        if (!uring_->space())
+        {
+            uringSubmit();
+        }
+        io_uring_sqe* sqe = uring_->getSqe();
+        if (sqe)
+        {
+            sqe->opcode       = IORING_OP_ASYNC_CANCEL;
+            sqe->fd           = channel->fd_;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+            sqe->user_data    = kUringCancel;
+        }
+        uringSubmit();  // now, the cancel looks the file up by fd
+    }
+#endif
+    if (waiter)
+    {
+        schedule(std::move(waiter), threadId);
+        pendingEventCount_.decrement();
+    }
+}
+
+#else
+
+ssize_t IOManager::uringIo(IoOp, int, void*, size_t, int, uint64_t)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int IOManager::uringAccept(int, uint64_t)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int IOManager::uringConnect(int, const sockaddr*, socklen_t, uint64_t)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+void IOManager::uringSubmit() {}
+
+void IOManager::uringReap() {}
+
+void IOManager::uringCancel(Channel*) {}
+
+#endif
+
+int IOManager::control(Channel* channel, int op, uint32_t events)
+{
+    epoll_event epevent;
+    epevent.events   = EPOLLET | events;
+    epevent.data.ptr = channel;
+    s_epoll_ctls.increment();
+    if (epoll_ctl(loops_[static_cast<size_t>(channel->loop_)]->epollFd_, op, channel->fd_, &epevent))
+    {
+        ELOG_ERROR(logger) << "epoll_ctl op=" << op << " fd=" << channel->fd_ << " " << strerror(errno);
+        return -1;
+    }
+    return 0;
+}
+
+int IOManager::nextLoopThread()
+{
+    if (!loopPerThread())
+    {
+        return -1;
+    }
+    return loops_[nextChannel_.fetchAndAdd(1) % loops_.size()]->threadId_.get();
+}
+
+IOManager::Loop*& IOManager::CurrentLoop()
+{
+    static thread_local Loop* t_loop = nullptr;
+    return t_loop;
+}
+
+bool IOManager::needTimerfd(bool earlier)
+{
+    // epoll_timers: an idle thread computes the deadline every time before it waits, a worker thread
+    // adding a timer is not waiting, so only threads outside or a thread already asleep need the timerfd
+    // with loop_per_thread only the timer loop waits for the shared timers
+    bool waits = loopPerThread() ? timerLoop(CurrentLoop()) && !loops_[0]->idle_.get() : inWorkerThread() && !hasIdleThread();
+    bool need  = !epollTimers_ || (earlier && !waits);
+    if (need)
+    {
+        s_timerfd_sets.increment();
+    }
+    return need;
+}
+
+int IOManager::timerThread()
+{
+    // the timer loop expires it, the callback goes back to the thread that added it
+    return loopPerThread() && inWorkerThread() ? Scheduler::CurrentThreadId() : -1;
+}
+
+int IOManager::waitEvents(Loop* loop, std::vector<epoll_event>& events, int64_t timeout_us)
+{
+    s_epoll_waits.increment();
+    int maxevents = static_cast<int>(events.size());
+#ifdef EASY_HAS_EPOLL_PWAIT2
+    static bool s_pwait2 = true;  // false after ENOSYS, before 5.11
+    if (s_pwait2 && timeout_us > 0 && timeout_us % 1000)
+    {
+        struct timespec ts;
+        ts.tv_sec  = static_cast<time_t>(timeout_us / Timestamp::kMicroSecondsPerSecond);
+        ts.tv_nsec = static_cast<long>(timeout_us % Timestamp::kMicroSecondsPerSecond * 1000);
+        int n      = epoll_pwait2(loop->epollFd_, &events[0], maxevents, &ts, nullptr);
+        if (n >= 0 || errno != ENOSYS)
+        {
+            return n;
+        }
+        s_pwait2 = false;
+    }
+#endif
+    // rounded up, waking early would only spin
+    return epoll_wait(loop->epollFd_, &events[0], maxevents, static_cast<int>((timeout_us + 999) / 1000));
+}
+
+int IOManager::pickLoop()
+{
+    if (!loopPerThread())
+    {
+        return 0;
+    }
+    // the fiber that parks on the fd runs here, keep the fd with this thread
+    Loop* loop = CurrentLoop();
+    if (loop && loop->owner_ == this)
+    {
+        return loop->index_;
+    }
+    return static_cast<int>(nextChannel_.fetchAndAdd(1) % loops_.size());
+}
+
+void IOManager::weakup(int threadId)
+{
+    // one wakeup in flight at a time, the woken thread wakes the next one while tasks are left, see Scheduler::run
+    if (!loopPerThread())
+    {
+        Loop* loop = loops_[0].get();
+        if (!hasIdleThread() || loop->weakupPending_.get() || !loop->weakupPending_.compareAndSet(0, 1))
+        {
+            return;
+        }
+        notify(loop);
         return;
     }
-    char    msg = 'X';
-    ssize_t ret = write(weakupFds_[1], &msg, sizeof(msg));
-    EASY_ASSERT(ret == 1);
+    if (threadId == -1)
+    {
+        weakupAny(false);
+        return;
+    }
+    for (auto& loop : loops_)
+    {
+        if (loop->threadId_.get() == threadId)
+        {
+            // pinned task in its inbox, only this thread can take it
+            if (loop->idle_.get() && !loop->weakupPending_.get() && loop->weakupPending_.compareAndSet(0, 1))
+            {
+                notify(loop.get());
+            }
+            return;
+        }
+    }
+}
+
+bool IOManager::weakupAny(bool force)
+{
+    for (auto& loop : loops_)
+    {
+        if ((force || loop->idle_.get()) && !loop->weakupPending_.get() && loop->weakupPending_.compareAndSet(0, 1))
+        {
+            notify(loop.get());
+            return true;
+        }
+    }
+    return false;
 }
 
-bool IOManager::canStop() { return !hasTimer() && pendingEventCount_.get() == 0 && Scheduler::canStop(); }
+void IOManager::notify(Loop* loop)
+{
+    s_wakeups.increment();
+    uint64_t one = 1;
+    ssize_t  ret = write(loop->weakupFd_, &one, sizeof(one));
+    EASY_ASSERT(ret == sizeof(one));
+}
+
+void IOManager::onLocalTimerMessage(int threadId) { weakup(threadId); }
+
+bool IOManager::canStop() { return !hasTimer() && expiring_.get() == 0 && pendingEventCount_.get() == 0 && Scheduler::canStop(); }
 
 void IOManager::idle()
 {
+    Loop* loop = loops_[0].get();
+    if (loopPerThread())
+    {
+        loop = CurrentLoop();
+        if (!loop || loop->owner_ != this)
+        {
+            // one idle fiber per thread for the whole run, claim a loop once
+            size_t idx = nextLoop_.fetchAndAdd(1);
+            EASY_ASSERT_MESSAGE(idx < loops_.size(), "more threads than loops");
+            loop          = loops_[idx].get();
+            CurrentLoop() = loop;
+            loop->threadId_.set(Thread::GetCurrentThreadId());
+            if (perThreadTimers_)
+            {
+                attachThread(loop->threadId_.get());
+            }
+        }
+    }
+
+    // one buffer per idle fiber, threads may wait on the same epoll fd concurrently
+    std::vector<epoll_event> events(kInitEventSize);
     while (EASY_UNLIKELY(!canStop()))
     {
-        int numEvents = 0;
+        int  numEvents  = 0;
+        bool timerFired = false;
         while (true)
         {
-            numEvents      = epoll_wait(epollFd_, *events_.begin(), static_cast<int>(events_.size()), kEPollTimeMs);
+            // a task queued before idle_ is visible did not wake us, do not sleep on it
+            if (uring_)
+            {
+                // sqes queued by the fibers this thread ran since the last idle go in one io_uring_enter
+                MutexLockGuard _(sqLock_);
+                uringSubmit();
+            }
+            loop->idle_.set(1);
+            const int64_t kMaxTimeout = static_cast<int64_t>(kEPollTimeMs) * 1000;
+            int64_t       timeout     = hasWork() ? 0 : kMaxTimeout;  // us
+            if (timeout && loopPerThread() && canStop())
+            {
+                // a stopping loop passes its wakeup to idle loops only, one not idle yet must not sleep on the last timer
+                timeout = 0;
+            }
+            // the wait ends at the earliest timer, no timerfd event for it
+            // the timer loop may stop before a timer added by the last task, then the loops left expire the shared timers
+            timerFired = timerLoop(loop) ? epollTimers_ : Scheduler::canStop();
+            if (timerFired && timeout)
+            {
+                int64_t next = nextTimeout();
+                if (next >= 0 && next < timeout)
+                {
+                    timeout = next;
+                }
+            }
+            if (perThreadTimers_ && timeout)
+            {
+                // the deadline of this thread's own timers, no timerfd
+                int64_t next = nextLocalTimeout();
+                if (next >= 0 && next < timeout)
+                {
+                    timeout = next;
+                }
+            }
+            numEvents      = waitEvents(loop, events, timeout);
             int savedErrno = errno;
+            loop->idle_.set(0);
+            Timestamp::setLoopTime(Timestamp::now(Timestamp::MONOTONIC));  // for the expiry below and the tasks it wakes
             if (numEvents > 0)
             {
                 ELOG_DEBUG(logger) << numEvents << " events happened";
-                if (static_cast<size_t>(numEvents) == events_.size())
-                {
-                    resizeRevent(events_.size() << 1);
-                }
                 break;
             }
             else if (numEvents == 0)
             {
                 ELOG_DEBUG(logger) << "nothing happened";
+                if (timeout != kMaxTimeout)
+                {
+                    break;
+                }
             }
             else
             {
@@ -330,11 +1020,18 @@ void IOManager::idle()
 
         for (int i = 0; i < numEvents; ++i)
         {
-            epoll_event* event = events_[static_cast<size_t>(i)];
-            if (event->data.fd == weakupFds_[0])
+            epoll_event* event = &events[static_cast<size_t>(i)];
+            if (event->data.fd == loop->weakupFd_)
             {
-                char dummy[256];
-                while (read(weakupFds_[0], dummy, sizeof(dummy)) > 0) { /*EPOLLET*/ }
+                uint64_t count = 0;
+                while (read(loop->weakupFd_, &count, sizeof(count)) > 0) { /*EPOLLET*/ }
+                loop->weakupPending_.set(0);
+                continue;
+            }
+
+            if (uring_ && event->data.fd == uring_->fd())
+            {
+                uringReap();
                 continue;
             }
 
@@ -342,20 +1039,21 @@ void IOManager::idle()
             {
                 char dummy[256];
                 while (read(timerfd(), dummy, sizeof(dummy)) > 0) { /*EPOLLET*/ }
-                std::vector<std::function<void()>> cbs;
-                listExpiredCallback(cbs);
-                if (!cbs.empty())
-                {
-                    schedule(cbs.begin(), cbs.end());
-                }
+                timerFired = true;
                 continue;
             }
 
             Channel*      channel = static_cast<Channel*>(event->data.ptr);
             SpinLockGuard _(channel->lock_);
+            if (channel->loop_ != loop->index_ || (persistent_ && !channel->registered_))
+            {
+                // stale, the fd was closed or went to another loop after this event was fetched
+                continue;
+            }
             if (event->events & (EPOLLERR | EPOLLHUP))
             {
-                event->events |= (EPOLLIN | EPOLLOUT) & channel->events_;
+                // a later waiter in persistent mode sees the error too
+                event->events |= (EPOLLIN | EPOLLOUT) & (persistent_ ? ~0u : static_cast<uint32_t>(channel->events_));
             }
             int revents = Channel::NONE;
             if (event->events & EPOLLIN)
@@ -367,40 +1065,104 @@ void IOManager::idle()
                 revents |= Channel::WRITE;
             }
 
-            if ((channel->events_ & revents) == Channel::NONE)
+            if (persistent_)
             {
-                // do nothing
-                continue;
+                // stays registered, keep the edges nobody waits for
+                channel->ready_ = static_cast<Channel::Event>(channel->ready_ | (revents & ~channel->events_));
+                revents &= channel->events_;
+            }
+            else if ((channel->events_ & revents) != Channel::NONE)
+            {
+                uint32_t levents = (channel->events_ & ~revents);
+                if (control(channel, levents ? EPOLL_CTL_MOD : EPOLL_CTL_DEL, levents))
+                {
+                    continue;
+                }
             }
 
-            // TODO: use EPOLLONESHOT
-            uint32_t levents = (channel->events_ & ~revents);
-            int      op      = levents ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-            event->events    = EPOLLET | levents;
-
-            if (epoll_ctl(epollFd_, op, channel->fd_, event))
+            if ((channel->events_ & revents) == Channel::NONE)
             {
-                ELOG_ERROR(logger) << " (" << errno << ") (" << strerror(errno) << ")";
+                // do nothing
                 continue;
             }
 
+            // a parked fiber resumes on the thread of its loop
+            int threadId = loopThread(channel);
             if (revents & Channel::READ)
             {
-                channel->handleEvent(Channel::READ);
+                channel->handleEvent(Channel::READ, threadId);
                 pendingEventCount_.decrement();
             }
             if (revents & Channel::WRITE)
             {
-                channel->handleEvent(Channel::WRITE);
+                channel->handleEvent(Channel::WRITE, threadId);
                 pendingEventCount_.decrement();
             }
         }
+        if (static_cast<size_t>(numEvents) == events.size())
+        {
+            events.resize(events.size() << 1);
+        }
+
+        if (timerFired)
+        {
+            std::vector<std::function<void()>> cbs;
+            std::vector<std::function<void()>> inline_cbs;
+            std::vector<int>                   threadIds;
+            expiring_.increment();
+            listExpiredCallback(cbs, inline_cbs, &threadIds);
+            if (loopPerThread())
+            {
+                // back to the loops that added them, the timer loop does not run them all
+                for (size_t i = 0; i < cbs.size(); ++i)
+                {
+                    schedule(std::move(cbs[i]), threadIds[i]);
+                }
+            }
+            else if (!cbs.empty())
+            {
+                schedule(cbs.begin(), cbs.end());
+            }
+            if (!inline_cbs.empty())
+            {
+                scheduleInline(inline_cbs.begin(), inline_cbs.end());
+            }
+            expiring_.decrement();
+        }
+
+        if (perThreadTimers_)
+        {
+            std::vector<std::function<void()>> cbs;
+            std::vector<std::function<void()>> inline_cbs;
+            listLocalExpiredCallback(cbs, inline_cbs);
+            // the callbacks stay on the thread of the timer
+            if (!cbs.empty())
+            {
+                schedule(cbs.begin(), cbs.end(), loop->threadId_.get());
+            }
+            if (!inline_cbs.empty())
+            {
+                scheduleInline(inline_cbs.begin(), inline_cbs.end(), loop->threadId_.get());
+            }
+        }
+
         Fiber::ptr cur     = Fiber::GetThis();
         auto       raw_ptr = cur.get();
         cur.reset();
         // back at scheduler::handleFiber co->sched_rsume()
         raw_ptr->sched_yield();
     }
+    detachThread();
+    Timestamp::setLoopTime(Timestamp());
+    // stopping, wakeups are coalesced, so pass it on to the next sleeping thread
+    if (loopPerThread())
+    {
+        weakupAny(false);
+    }
+    else
+    {
+        notify(loop);
+    }
 }
 
 }  // namespace easy
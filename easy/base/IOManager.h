@@ -7,11 +7,16 @@
 #include "easy/base/Scheduler.h"
 #include "easy/base/Timer.h"
 
+#include <sys/epoll.h>
+#include <sys/socket.h>
 #include <functional>
+#include <memory>
 #include <vector>
 
 namespace easy
 {
+class Uring;
+
 class IOManager : public Scheduler, public TimerManager
 {
   public:
@@ -19,6 +24,25 @@ class IOManager : public Scheduler, public TimerManager
 
     ~IOManager();
 
+    struct Stats
+    {
+        uint64_t epollWaits  = 0;
+        uint64_t epollCtls   = 0;
+        uint64_t wakeups     = 0;  // eventfd writes
+        uint64_t uringEnters = 0;  // io_uring_enter to submit
+        uint64_t uringSqes   = 0;  // sqes submitted, linked timeouts included
+        uint64_t timerfdSets = 0;  // timerfd_settime
+    };
+
+    enum IoOp
+    {
+        IO_READ,
+        IO_WRITE,
+        IO_RECV,
+        IO_SEND,
+    };
+
+    // 0 parked, -1 error, 1 the event already fired in persistent mode, nothing is registered, retry the io
     int addEvent(int fd, Channel::Event event, std::function<void()> cb = nullptr);
 
     bool removeEvent(int fd, Channel::Event event);
@@ -29,28 +53,129 @@ class IOManager : public Scheduler, public TimerManager
     // trigger and cancel
     bool cancelAll(int fd);
 
+    // iomanager.loop_per_thread: every thread waits on its own epoll fd
+    bool loopPerThread() const { return loops_.size() > 1; }
+
+    // round robin over the loop threads, -1 if there is a shared loop or no thread has claimed its loop yet
+    // a fiber scheduled there keeps its fds on that thread
+    int nextLoopThread();
+
+    // iomanager.epoll_timers: the earliest timer is the epoll_wait timeout instead of a timerfd_settime per change
+    bool epollTimers() const { return epollTimers_; }
+
+    // iomanager.per_thread_timers: a worker thread queues and fires the timers it adds, see TimerManager::attachThread
+    bool perThreadTimers() const { return perThreadTimers_; }
+
+    // iomanager.persistent_events: fds stay registered edge triggered, no epoll_ctl per event
+    bool persistentEvents() const { return persistent_; }
+
+    // iomanager.io_uring: hooked socket io that would block completes through io_uring, false if the kernel lacks it
+    bool uringEnabled() const { return uring_ != nullptr; }
+
+    // io_uring mode, parks the fiber until the completion, which is the result, no readiness and retry
+    // -1 and errno like the syscall, ETIMEDOUT after timeout_ms (-1UL for none), ENOSYS when it has to go through epoll
+    ssize_t uringIo(IoOp op, int fd, void* buf, size_t len, int flags, uint64_t timeout_ms);
+
+    // a multishot accept is armed once per listening fd, the new fds are queued on its Channel
+    int uringAccept(int fd, uint64_t timeout_ms);
+
+    int uringConnect(int fd, const sockaddr* addr, socklen_t addrlen, uint64_t timeout_ms);
+
     static IOManager* GetThis();
 
+    // all IOManagers of the process
+    static Stats GetStats();
+
   protected:
-    void weakup() override;
+    void weakup(int threadId = -1) override;
 
     bool canStop() override;
 
+    void onLocalTimerMessage(int threadId) override;
+
+    bool needTimerfd(bool earlier) override;
+
+    int timerThread() override;
+
     void idle() override;
 
     void resizeChannels(size_t size);
 
-    void resizeRevent(size_t size);
+  private:
+    // an epoll instance with its wakeup eventfd, shared by all threads or owned by one
+    struct Loop : easy::noncopyable
+    {
+        IOManager*     owner_{nullptr};
+        int            index_{0};          // in loops_, see Channel::loop_
+        int            epollFd_{-1};
+        int            weakupFd_{-1};      // eventfd
+        AtomicInt<int> threadId_{-1};      // owner thread, loop per thread only, read by the threads that wake it
+        AtomicInt<int> weakupPending_{0};  // an eventfd write is not consumed yet
+        AtomicInt<int> idle_{0};           // owner thread is in epoll_wait, loop per thread only
+    };
+
+    static Loop*& CurrentLoop();
+
+    // loop a channel without events gets registered in
+    int pickLoop();
+
+    // thread a channel event resumes on
+    int loopThread(Channel* channel) const { return loopPerThread() ? loops_[static_cast<size_t>(channel->loop_)]->threadId_.get() : -1; }
+
+    // the loop that waits on the timerfd and expires the shared timers, the first one
+    bool timerLoop(const Loop* loop) const { return loop == loops_[0].get(); }
+
+    // nullptr if fd has no Channel and create is false
+    Channel* getChannel(int fd, bool create);
+
+    // a parked io_uring request, on the stack of its fiber
+    struct UringOp;
+
+    ssize_t uringWait(UringOp& op, uint64_t timeout_ms);
+
+    // queue the multishot accept of channel, channel->lock_ held
+    bool uringArmAccept(Channel* channel);
+
+    // io_uring_enter for the queued sqes, sqLock_ held
+    void uringSubmit();
+
+    // completions to fibers, the ring fd is readable
+    void uringReap();
+
+    // the fd is closed, drop queued accepts and cancel the requests in flight
+    void uringCancel(Channel* channel);
+
+    // epoll_ctl on the loop of the channel
+    int control(Channel* channel, int op, uint32_t events);
+
+    // epoll_pwait2 when timeout_us is not whole ms and the kernel has it, epoll_wait otherwise
+    int waitEvents(Loop* loop, std::vector<epoll_event>& events, int64_t timeout_us);
+
+    // write the eventfd, not coalesced
+    void notify(Loop* loop);
+
+    // wake one idle loop that has no wakeup in flight, false if there is none
+    bool weakupAny(bool force);
 
   private:
-    const int kEPollTimeMs = 10000;
-
-    int                       epollFd_;
-    int                       weakupFds_[2];
-    AtomicInt<int>            pendingEventCount_;
-    ReadWriteLock             lock_;
-    std::vector<epoll_event*> events_;  // events from epoll_wait
-    std::vector<Channel*>     channels_;
+    const int             kEPollTimeMs   = 10000;
+    const size_t          kInitEventSize = 32;
+    static const unsigned kSubmitBatch   = 32;  // sqes queued before a fiber submits itself instead of the next idle
+
+    bool                               persistent_{false};
+    bool                               epollTimers_{false};      // iomanager.epoll_timers
+    bool                               perThreadTimers_{false};  // iomanager.per_thread_timers
+    std::vector<std::unique_ptr<Loop>> loops_;
+    AtomicInt<size_t>                  nextLoop_{0};     // next loop claimed by a thread
+    AtomicInt<size_t>                  nextChannel_{0};  // round robin for channels and nextLoopThread
+    AtomicInt<int>                     pendingEventCount_;
+    AtomicInt<int>                     expiring_{0};  // shared timers taken off the queue, their callbacks not scheduled yet
+    ReadWriteLock                      lock_;
+    std::vector<Channel*>              channels_;
+    std::unique_ptr<Uring>             uring_;               // io_uring mode only
+    MutexLock                          sqLock_;              // protect submissions to uring_
+    MutexLock                          cqLock_;              // protect reaping of uring_
+    AtomicInt<int>                     multishotAccept_{1};  // 0 after the kernel rejected it, before 5.19
 };
 
 }  // namespace easy
@@ -1,10 +1,16 @@
 #include "easy/base/LogAppender.h"
+#include "easy/base/BinaryLog.h"
 #include "easy/base/FileUtil.h"
 #include "easy/base/LogFormatter.h"
 #include "easy/base/Logger.h"
 #include "easy/base/Mutex.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <yaml-cpp/yaml.h>
+#include <algorithm>
 #include <iostream>
 
 namespace easy
@@ -29,13 +35,33 @@ std::shared_ptr<LogFormatter> LogAppender::getFormatter()
     return formatter_;
 }
 
-bool LogAppender::shouldLog(LogLevel level) const { return level >= level_; }
+void LogAppender::logBinary(const std::shared_ptr<Logger>& logger, const BinaryLogRecord& record)
+{
+    const BinaryLogSite& site = *record.site;
+    if (shouldLog(site.getLevel()))
+    {
+        LogRecord text(record.logger,
+            site.getLevel(),
+            site.getFile(),
+            site.getLine(),
+            site.getFunction(),
+            0,
+            record.threadId,
+            record.fiberId,
+            record.time,
+            record.threadName);
+        BinaryLog::FormatArgs(text.getSS(), site.getFormat(), record.args->data(), record.args->length());
+        log(logger, site.getLevel(), LogRecord::ptr(LogRecord::ptr(), &text));
+    }
+}
 
-void ConsoleLogAppender::log(std::shared_ptr<Logger> logger, LogLevel level, LogRecord::ptr record)
+void ConsoleLogAppender::log(const std::shared_ptr<Logger>& logger, LogLevel level, const LogRecord::ptr& record)
 {
     if (shouldLog(level))
     {
+        LocalLogLine  line;
         SpinLockGuard _(lock_);
+        formatter_->format(*line, logger, level, record);
 
         // add color
         if (level == LogLevel::WARN)
@@ -45,11 +71,12 @@ void ConsoleLogAppender::log(std::shared_ptr<Logger> logger, LogLevel level, Log
         if (level == LogLevel::FATAL)
             std::cout << "\x1B[97m\x1B[41m";
 
-        formatter_->format(std::cout, logger, level, record);
+        std::cout.write(line->data(), static_cast<std::streamsize>(line->length()));
 
         // clean color
         if (level >= LogLevel::WARN)
             std::cout << "\x1B[0m\x1B[0K";
+        std::cout.flush();
     }
 }
 
@@ -71,9 +98,34 @@ std::string ConsoleLogAppender::toYamlString()
     return ss.str();
 }
 
-FileLogAppender::FileLogAppender(const std::string& filename) : filename_(filename) { reopen(); }
+// the inode of filename, 0 if it is not there
+static ino_t InodeOf(const std::string& filename)
+{
+    struct stat st;
+    return ::stat(filename.c_str(), &st) == 0 ? st.st_ino : 0;
+}
+
+static void RollToYaml(YAML::Node& node, const LogRollOptions& roll)
+{
+    if (roll.enabled())
+    {
+        node["max_size"]      = roll.maxSize;
+        node["roll_interval"] = LogFileRoller::IntervalToString(roll.interval);
+        node["max_files"]     = roll.maxFiles;
+        node["compress"]      = roll.compress;
+    }
+}
+
+FileLogAppender::FileLogAppender(const std::string& filename, const LogRollOptions& roll) : filename_(filename)
+{
+    if (roll.enabled())
+    {
+        roller_.reset(new LogFileRoller(filename, roll));
+    }
+    reopen();
+}
 
-void FileLogAppender::log(std::shared_ptr<Logger> logger, LogLevel level, LogRecord::ptr record)
+void FileLogAppender::log(const std::shared_ptr<Logger>& logger, LogLevel level, const LogRecord::ptr& record)
 {
     if (shouldLog(level))
     {
@@ -81,15 +133,78 @@ void FileLogAppender::log(std::shared_ptr<Logger> logger, LogLevel level, LogRec
         if (timeDifference(now, lastTime_) >= kRoutineIntervalMs)
         {
             // 把文件 mov 后，进程已经打开的文件 inode 不会改变
-            // 需要重新打开才会创建新的文件，inode 才会替换
-            reopen();
-            lastTime_ = now;
+            // 需要重新打开才会创建新的文件，inode 才会替换，inode 没变时不用 open/close
+            lastTime_   = now;
+            ino_t inode = InodeOf(filename_);
+            bool  moved;
+            {
+                SpinLockGuard _(lock_);
+                moved = (inode == 0 || inode != inode_) && !rolling_;
+            }
+            if (moved)
+            {
+                reopen();
+            }
         }
-        SpinLockGuard _(lock_);
-        if (!formatter_->format(filestream_, logger, level, record))
+        LocalLogLine line;
         {
-            std::cout << "error" << std::endl;
+            SpinLockGuard _(lock_);
+            formatter_->format(*line, logger, level, record);
+            if (!roller_ || rolling_ || !roller_->due(line->length(), now))
+            {
+                write(*line);
+                return;
+            }
+            rolling_ = true;
         }
+        roll(*line, now);
+    }
+}
+
+void FileLogAppender::write(const LogLine& line)
+{
+    filestream_.write(line.data(), static_cast<std::streamsize>(line.length()));
+    if (line.length() && line.data()[line.length() - 1] == '\n')
+    {
+        filestream_.flush();  // %n was std::endl
+    }
+    if (!filestream_)
+    {
+        std::cout << "error" << std::endl;
+    }
+    if (roller_)
+    {
+        roller_->wrote(line.length());
+    }
+}
+
+void FileLogAppender::roll(const LogLine& line, Timestamp now)
+{
+    std::string   path = roller_->roll(now);
+    std::ofstream next;
+    FileUtil::OpenForWrite(next, filename_, std::ios::app);
+    {
+        SpinLockGuard _(lock_);
+        filestream_.swap(next);
+        opened();
+        rolling_ = false;
+        write(line);
+    }
+    next.close();  // the rolled file, nobody writes to it any more
+    if (!path.empty())
+    {
+        roller_->rolled(path);
+    }
+}
+
+void FileLogAppender::opened()
+{
+    struct stat st;
+    bool        ok = ::stat(filename_.c_str(), &st) == 0;
+    inode_         = ok ? st.st_ino : 0;
+    if (roller_)
+    {
+        roller_->opened(ok ? static_cast<size_t>(st.st_size) : 0, Timestamp(ok ? st.st_mtime * Timestamp::kMicroSecondsPerSecond : 0));
     }
 }
 
@@ -99,6 +214,10 @@ std::string FileLogAppender::toYamlString()
     YAML::Node    node;
     node["type"] = "FileLogAppender";
     node["file"] = filename_;
+    if (roller_)
+    {
+        RollToYaml(node, roller_->options());
+    }
     if (level_ != LogLevel::OFF)
     {
         node["level"] = toString(level_);
@@ -119,7 +238,392 @@ bool FileLogAppender::reopen()
     {
         filestream_.close();
     }
-    return FileUtil::OpenForWrite(filestream_, filename_, std::ios::app);
+    bool ok = FileUtil::OpenForWrite(filestream_, filename_, std::ios::app);
+    opened();
+    return ok;
+}
+
+AsyncFileLogAppender::AsyncFileLogAppender(const std::string& filename, size_t bufferSize, int flushInterval, size_t maxBuffers, Overflow overflow,
+    Mode mode, const LogRollOptions& roll)
+    : filename_(filename),
+      bufferSize_(bufferSize),
+      flushInterval_(flushInterval),
+      maxBuffers_(std::max<size_t>(maxBuffers, 2)),
+      overflow_(overflow),
+      mode_(mode),
+      cond_(mutex_),
+      spaceCond_(mutex_),
+      current_(new Buffer(bufferSize)),
+      allocated_(2)
+{
+    emptyBuffers_.emplace_back(new Buffer(bufferSize));
+    if (roll.enabled())
+    {
+        roller_.reset(new LogFileRoller(filename, roll));
+    }
+    openFile();
+    thread_ = std::make_shared<Thread>(std::bind(&AsyncFileLogAppender::run, this), "AsyncLogging");
+}
+
+AsyncFileLogAppender::~AsyncFileLogAppender()
+{
+    {
+        MutexLockGuard _(mutex_);
+        running_ = false;
+        cond_.notify();
+    }
+    thread_->join();
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+void AsyncFileLogAppender::log(const std::shared_ptr<Logger>& logger, LogLevel level, const LogRecord::ptr& record)
+{
+    if (shouldLog(level))
+    {
+        LocalLogLine line;
+        if (mode_ == BINARY)
+        {
+            Logger* owner = record->getLogger().get();
+            BinaryLog::EncodeText(*line,
+                owner->getId(),
+                level,
+                record->getLine(),
+                record->getTimestamp(),
+                record->getThreadId(),
+                record->getFiberId(),
+                record->getThreadName(),
+                record->getFileName(),
+                record->getFunction(),
+                record->getStream().data(),
+                record->getStream().length());
+            appendBinary(nullptr, owner, line->data(), line->length());
+            return;
+        }
+        else
+        {
+            // formatted outside any lock, the callers only serialize on the memcpy
+            getFormatter()->format(*line, logger, level, record);
+        }
+        append(line->data(), line->length());
+    }
+}
+
+void AsyncFileLogAppender::logBinary(const std::shared_ptr<Logger>& logger, const BinaryLogRecord& record)
+{
+    if (mode_ == TEXT)
+    {
+        LogAppender::logBinary(logger, record);
+        return;
+    }
+    if (shouldLog(record.site->getLevel()))
+    {
+        LocalLogLine line;
+        BinaryLog::EncodeRecord(*line, record);
+        appendBinary(record.site, record.logger, line->data(), line->length());
+    }
+}
+
+void AsyncFileLogAppender::append(const char* data, size_t len)
+{
+    len = std::min(len, bufferSize_);  // a longer message is cut
+
+    MutexLockGuard _(mutex_);
+    if (reserve(len))
+    {
+        current_->append(data, len);
+    }
+}
+
+void AsyncFileLogAppender::appendBinary(const BinaryLogSite* site, Logger* logger, const char* data, size_t len)
+{
+    if (len > bufferSize_)
+    {
+        dropped_.increment();  // an entry is never cut
+        return;
+    }
+
+    MutexLockGuard _(mutex_);
+    uint32_t siteId    = site ? site->getId() : 0;
+    uint32_t loggerId  = logger->getId();
+    bool     newSite   = site && (siteId >= sites_.size() || !sites_[siteId]);
+    bool     newLogger = loggerId >= loggersDefined_.size() || !loggersDefined_[loggerId];
+    if (newSite || newLogger)
+    {
+        // once per appender, under the mutex so that it is in the file before the record
+        LocalLogLine defines;
+        if (newSite)
+        {
+            BinaryLog::EncodeSite(*defines, *site);
+        }
+        if (newLogger)
+        {
+            BinaryLog::EncodeLogger(*defines, loggerId, logger->getName());
+        }
+        if (!reserve(defines->length()))
+        {
+            return;
+        }
+        current_->append(defines->data(), defines->length());
+        if (newSite)
+        {
+            sites_.resize(std::max<size_t>(sites_.size(), siteId + 1));
+            sites_[siteId] = site;
+        }
+        if (newLogger)
+        {
+            loggersDefined_.resize(std::max<size_t>(loggersDefined_.size(), loggerId + 1));
+            loggersDefined_[loggerId] = true;
+            loggerNames_[loggerId]    = logger->getName();
+        }
+    }
+    if (reserve(len))
+    {
+        current_->append(data, len);
+    }
+}
+
+bool AsyncFileLogAppender::reserve(size_t len)
+{
+    while (!current_ || current_->avail() < len)
+    {
+        BufferPtr next;
+        if (!emptyBuffers_.empty())
+        {
+            next = std::move(emptyBuffers_.back());
+            emptyBuffers_.pop_back();
+        }
+        else if (allocated_ < maxBuffers_)
+        {
+            next.reset(new Buffer(bufferSize_));
+            ++allocated_;
+        }
+        else if (overflow_ == DROP)
+        {
+            dropped_.increment();
+            return false;
+        }
+        else
+        {
+            // backpressure, the disk is slower than the callers
+            cond_.notify();
+            spaceCond_.wait();
+            continue;
+        }
+        if (current_)
+        {
+            buffers_.push_back(std::move(current_));
+            cond_.notify();
+        }
+        current_ = std::move(next);
+    }
+    return true;
+}
+
+void AsyncFileLogAppender::flush()
+{
+    MutexLockGuard _(mutex_);
+    uint64_t       request = ++flushRequest_;
+    cond_.notify();
+    while (flushDone_ < request)
+    {
+        spaceCond_.wait();
+    }
+}
+
+bool AsyncFileLogAppender::reopen()
+{
+    reopen_.set(1);
+    return true;
+}
+
+void AsyncFileLogAppender::run()
+{
+    Timestamp              lastCheck = Timestamp::now();
+    std::vector<BufferPtr> toWrite;
+    bool                   stop = false;
+    while (!stop)
+    {
+        uint64_t request = 0;
+        {
+            MutexLockGuard _(mutex_);
+            if (buffers_.empty() && running_ && flushRequest_ == flushDone_)
+            {
+                cond_.waitForMilliSeconds(flushInterval_);
+            }
+            if (current_ && current_->len_)
+            {
+                // a caller takes an empty one when it logs next
+                buffers_.push_back(std::move(current_));
+            }
+            toWrite.swap(buffers_);
+            request = flushRequest_;
+            stop    = !running_;
+        }
+
+        Timestamp now = Timestamp::now();
+        if (reopen_.compareAndSet(1, 0))
+        {
+            openFile();
+            lastCheck = now;
+        }
+        else if (timeDifference(now, lastCheck) >= kRoutineIntervalMs)
+        {
+            // 把文件 mov 后，进程已经打开的文件 inode 不会改变
+            // 需要重新打开才会创建新的文件，inode 才会替换，inode 没变时不用 open/close
+            ino_t inode = InodeOf(filename_);
+            if (inode == 0 || inode != inode_)
+            {
+                openFile();
+            }
+            lastCheck = now;
+        }
+
+        uint64_t dropped = dropped_.get() - droppedWritten_;
+        if (dropped)
+        {
+            droppedWritten_ += dropped;
+            if (mode_ == BINARY)
+            {
+                LocalLogLine line;
+                BinaryLog::EncodeDropped(*line, dropped);
+                write(line->data(), line->length());
+            }
+            else
+            {
+                char buf[64];
+                int  n = snprintf(buf, sizeof(buf), "dropped %lu log messages\n", dropped);
+                write(buf, static_cast<size_t>(n));
+            }
+        }
+        for (auto& buffer : toWrite)
+        {
+            if (roller_ && roller_->due(buffer->len_, now))
+            {
+                rollFile(now);
+            }
+            write(buffer->data_.get(), buffer->len_);
+            buffer->len_ = 0;
+        }
+
+        MutexLockGuard _(mutex_);
+        for (auto& buffer : toWrite)
+        {
+            emptyBuffers_.push_back(std::move(buffer));
+        }
+        toWrite.clear();
+        flushDone_ = request;
+        spaceCond_.notifyAll();
+    }
+}
+
+void AsyncFileLogAppender::write(const char* data, size_t len)
+{
+    if (roller_)
+    {
+        roller_->wrote(len);
+    }
+    while (len > 0 && fd_ >= 0)
+    {
+        ssize_t n = ::write(fd_, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::cout << "AsyncFileLogAppender write " << filename_ << " error: " << strerror(errno) << std::endl;
+            return;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+}
+
+void AsyncFileLogAppender::openFile()
+{
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+    fd_ = ::open(filename_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+    {
+        FileUtil::Mkdir(FileUtil::Dirname(filename_));
+        fd_ = ::open(filename_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    }
+
+    struct stat st;
+    bool        ok = fd_ >= 0 && ::fstat(fd_, &st) == 0;
+    inode_         = ok ? st.st_ino : 0;
+    if (roller_)
+    {
+        roller_->opened(ok ? static_cast<size_t>(st.st_size) : 0, Timestamp(ok ? st.st_mtime * Timestamp::kMicroSecondsPerSecond : 0));
+    }
+    if (mode_ == BINARY && ok && st.st_size == 0)
+    {
+        // a new file after a rotation, the records still to write may use what the old one defined
+        LocalLogLine defines;
+        {
+            MutexLockGuard _(mutex_);
+            for (const BinaryLogSite* site : sites_)
+            {
+                if (site)
+                {
+                    BinaryLog::EncodeSite(*defines, *site);
+                }
+            }
+            for (auto& logger : loggerNames_)
+            {
+                BinaryLog::EncodeLogger(*defines, logger.first, logger.second);
+            }
+        }
+        write(defines->data(), defines->length());
+    }
+}
+
+void AsyncFileLogAppender::rollFile(Timestamp now)
+{
+    // the callers only append to the buffers, they never wait for the rename
+    std::string path = roller_->roll(now);
+    openFile();
+    if (!path.empty())
+    {
+        roller_->rolled(path);
+    }
+}
+
+std::string AsyncFileLogAppender::toYamlString()
+{
+    SpinLockGuard _(lock_);
+    YAML::Node    node;
+    node["type"]           = "AsyncFileLogAppender";
+    node["file"]           = filename_;
+    node["buffer_size"]    = bufferSize_;
+    node["flush_interval"] = flushInterval_;
+    node["max_buffers"]    = maxBuffers_;
+    node["overflow"]       = overflow_ == DROP ? "drop" : "block";
+    if (mode_ == BINARY)
+    {
+        node["mode"] = "binary";
+    }
+    if (roller_)
+    {
+        RollToYaml(node, roller_->options());
+    }
+    if (level_ != LogLevel::OFF)
+    {
+        node["level"] = toString(level_);
+    }
+    if (hasFormatter_ && formatter_)
+    {
+        node["formatter"] = formatter_->getPattern();
+    }
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
 }
 
 }  // namespace easy
@@ -1,18 +1,29 @@
 #ifndef __EASY_LOG_SINK_H__
 #define __EASY_LOG_SINK_H__
 
+#include "easy/base/Atomic.h"
+#include "easy/base/Condition.h"
 #include "easy/base/LogLevel.h"
+#include "easy/base/LogRoller.h"
 #include "easy/base/Mutex.h"
+#include "easy/base/Thread.h"
 #include "easy/base/Timestamp.h"
 
+#include <string.h>
+#include <sys/types.h>
 #include <fstream>
+#include <map>
 #include <memory>
+#include <vector>
 
 namespace easy
 {
 class Logger;
 class LogRecord;
 class LogFormatter;
+class LogLine;
+class BinaryLogSite;
+struct BinaryLogRecord;
 
 // 抽象类
 class LogAppender
@@ -25,7 +36,11 @@ class LogAppender
     LogAppender()          = default;
     virtual ~LogAppender() = default;
 
-    virtual void log(std::shared_ptr<Logger> logger, LogLevel level, std::shared_ptr<LogRecord> event) = 0;
+    // logger and event are non owning, valid for the call only
+    virtual void log(const std::shared_ptr<Logger>& logger, LogLevel level, const std::shared_ptr<LogRecord>& event) = 0;
+
+    // ELOG_BIN_*, formatted into a record for log() unless the appender keeps it binary
+    virtual void logBinary(const std::shared_ptr<Logger>& logger, const BinaryLogRecord& record);
 
     virtual std::string toYamlString() = 0;
 
@@ -33,7 +48,7 @@ class LogAppender
 
     std::shared_ptr<LogFormatter> getFormatter();
 
-    bool shouldLog(LogLevel) const;
+    bool shouldLog(LogLevel level) const { return level >= level_; }
 
     LogLevel getLevel() const { return level_; }
 
@@ -54,29 +69,155 @@ class ConsoleLogAppender : public LogAppender
   public:
     typedef std::shared_ptr<ConsoleLogAppender> ptr;
 
-    void log(std::shared_ptr<Logger> logger, LogLevel level, std::shared_ptr<LogRecord> event) override;
+    void log(const std::shared_ptr<Logger>& logger, LogLevel level, const std::shared_ptr<LogRecord>& event) override;
 
     std::string toYamlString() override;
 };
 
 // 输出到文件
+// rolls by size and time when roll is enabled, the caller that rolls renames and opens outside the lock
 class FileLogAppender : public LogAppender
 {
   public:
     typedef std::shared_ptr<FileLogAppender> ptr;
 
-    FileLogAppender(const std::string& filename);
+    FileLogAppender(const std::string& filename, const LogRollOptions& roll = LogRollOptions());
 
-    void log(std::shared_ptr<Logger> logger, LogLevel level, std::shared_ptr<LogRecord> event) override;
+    void log(const std::shared_ptr<Logger>& logger, LogLevel level, const std::shared_ptr<LogRecord>& event) override;
 
     std::string toYamlString() override;
 
     bool reopen() override;
 
   private:
-    std::string   filename_;
-    std::ofstream filestream_;
-    Timestamp     lastTime_;
+    // lock_ held
+    void write(const LogLine& line);
+
+    // renames the file and writes line to a new one, the other callers write to the renamed one meanwhile
+    void roll(const LogLine& line, Timestamp now);
+
+    // lock_ held
+    void opened();
+
+  private:
+    std::string                    filename_;
+    std::ofstream                  filestream_;
+    Timestamp                      lastTime_;
+    ino_t                          inode_{0};  // of the open file
+    std::unique_ptr<LogFileRoller> roller_;    // nullptr if it does not roll
+    bool                           rolling_{false};
+
+    static const int kRoutineIntervalMs = 3000;
+};
+
+// 异步输出到文件，muduo AsyncLogging 式的双缓冲
+// the callers format and append to the current buffer under a mutex, a full one is swapped for an empty one
+// a background thread writes the full ones when one fills up or every flushInterval ms
+// in BINARY mode nothing is formatted, the records are written as BinaryLog entries for BinaryLogDecoder
+// the background thread rolls the file between two buffers, a file may go over maxSize by one buffer
+class AsyncFileLogAppender : public LogAppender
+{
+  public:
+    typedef std::shared_ptr<AsyncFileLogAppender> ptr;
+
+    // what a caller does when maxBuffers are full and waiting for the disk
+    enum Overflow
+    {
+        BLOCK,  // waits for the background thread, nothing is lost
+        DROP,   // drops the message, the count is written to the file later
+    };
+
+    enum Mode
+    {
+        TEXT,    // the lines of the formatter
+        BINARY,  // BinaryLog entries, the formatter is not used
+    };
+
+    AsyncFileLogAppender(const std::string& filename, size_t bufferSize = kDefaultBufferSize, int flushInterval = 1000, size_t maxBuffers = 16,
+        Overflow overflow = BLOCK, Mode mode = TEXT, const LogRollOptions& roll = LogRollOptions());
+
+    // the buffered messages are written
+    ~AsyncFileLogAppender();
+
+    void log(const std::shared_ptr<Logger>& logger, LogLevel level, const std::shared_ptr<LogRecord>& event) override;
+
+    void logBinary(const std::shared_ptr<Logger>& logger, const BinaryLogRecord& record) override;
+
+    std::string toYamlString() override;
+
+    // done by the background thread before its next write
+    bool reopen() override;
+
+    // the messages logged so far are on disk when it returns
+    void flush();
+
+    uint64_t dropped() const { return dropped_.get(); }
+
+    static const size_t kDefaultBufferSize = 4 * 1024 * 1024;
+
+  private:
+    struct Buffer : noncopyable
+    {
+        explicit Buffer(size_t size) : data_(new char[size]), size_(size) {}
+
+        size_t avail() const { return size_ - len_; }
+
+        void append(const char* data, size_t len)
+        {
+            memcpy(data_.get() + len_, data, len);
+            len_ += len;
+        }
+
+        std::unique_ptr<char[]> data_;
+        size_t                  size_;
+        size_t                  len_{0};
+    };
+
+    typedef std::unique_ptr<Buffer> BufferPtr;
+
+    void append(const char* data, size_t len);
+
+    // an entry of BINARY mode, the site and the logger are defined before their first record
+    void appendBinary(const BinaryLogSite* site, Logger* logger, const char* data, size_t len);
+
+    // a current buffer with len bytes free, mutex_ held, false if the message is dropped
+    bool reserve(size_t len);
+
+    void run();
+
+    void write(const char* data, size_t len);
+
+    void openFile();
+
+    void rollFile(Timestamp now);
+
+  private:
+    std::string                       filename_;
+    const size_t                      bufferSize_;
+    const int                         flushInterval_;  // ms
+    const size_t                      maxBuffers_;     // full and current ones
+    const Overflow                    overflow_;
+    const Mode                        mode_;
+    bool                              running_{true};
+    MutexLock                         mutex_;
+    Condition                         cond_;       // buffers_ not empty, a flush or stop asked
+    Condition                         spaceCond_;  // buffers were written
+    BufferPtr                         current_;
+    std::vector<BufferPtr>            buffers_;       // full, to write
+    std::vector<BufferPtr>            emptyBuffers_;  // written, to reuse
+    size_t                            allocated_{0};
+    uint64_t                          flushRequest_{0};  // mutex_ held
+    uint64_t                          flushDone_{0};
+    AtomicInt<uint64_t>               dropped_{0};
+    uint64_t                          droppedWritten_{0};  // background thread only
+    AtomicInt<int>                    reopen_{0};
+    int                               fd_{-1};          // background thread only
+    ino_t                             inode_{0};        // background thread only
+    std::unique_ptr<LogFileRoller>    roller_;          // background thread only, nullptr if it does not roll
+    std::vector<const BinaryLogSite*> sites_;           // BINARY, the defined ones by id
+    std::vector<bool>                 loggersDefined_;  // BINARY, by Logger id
+    std::map<uint32_t, std::string>   loggerNames_;     // BINARY, for a new file
+    Thread::ptr                       thread_;
 
     static const int kRoutineIntervalMs = 3000;
 };
@@ -1,31 +1,162 @@
 #include "easy/base/LogFormatter.h"
+#include "easy/base/Atomic.h"
 #include "easy/base/Logger.h"
 
-#include <functional>
-#include <map>
+#include <algorithm>
 #include <string>
+#include <tuple>
+#include <vector>
 
 namespace easy
 {
+LogLine::LogLine() : data_(new char[kInitSize]), cur_(data_.get()), end_(data_.get() + kInitSize) {}
+
+void LogLine::grow(size_t n)
+{
+    size_t len      = length();
+    size_t capacity = std::max(2 * static_cast<size_t>(end_ - data_.get()), len + n);
+    std::unique_ptr<char[]> data(new char[capacity]);
+    memcpy(data.get(), data_.get(), len);
+    data_ = std::move(data);
+    cur_  = data_.get() + len;
+    end_  = data_.get() + capacity;
+}
+
+LogLine* LogLine::Acquire()
+{
+    static thread_local LogLine t_line;
+    if (t_line.inUse_)
+    {
+        return nullptr;
+    }
+    t_line.inUse_ = true;
+    t_line.clear();
+    return &t_line;
+}
+
 LogFormatter::LogFormatter(const std::string& pattern) : pattern_(pattern) { compile(pattern); }
 
-std::string LogFormatter::format(std::shared_ptr<Logger> logger, LogLevel level, LogRecord::ptr record)
+std::string LogFormatter::format(const std::shared_ptr<Logger>& logger, LogLevel level, const LogRecord::ptr& record)
+{
+    LocalLogLine line;
+    format(*line, logger, level, record);
+    return std::string(line->data(), line->length());
+}
+
+std::ostream& LogFormatter::format(std::ostream& ofs, const std::shared_ptr<Logger>& logger, LogLevel level, const LogRecord::ptr& record)
+{
+    LocalLogLine line;
+    format(*line, logger, level, record);
+    return ofs.write(line->data(), static_cast<std::streamsize>(line->length()));
+}
+
+void LogFormatter::run(LogLine& line, LogLevel level, const LogRecord& record) const
+{
+    for (const Instruction& i : instructions_)
+    {
+        switch (i.op)
+        {
+            case LITERAL: line.append(i.arg); break;
+            case MESSAGE: line.append(record.getStream().data(), record.getStream().length()); break;
+            case LEVEL: AppendLevel(line, level); break;
+            case ELAPSE: line.appendDecimal(static_cast<uint64_t>(record.getElapse())); break;
+            case NAME: line.append(record.getLogger()->getName()); break;
+            case THREAD_ID: line.appendDecimal(static_cast<uint64_t>(record.getThreadId())); break;
+            case FIBER_ID: line.appendDecimal(static_cast<uint64_t>(record.getFiberId())); break;
+            case THREAD_NAME: line.append(record.getThreadName()); break;
+            case DATETIME: AppendDateTime(line, i.id, i.arg.c_str(), record.getTimestamp()); break;
+            case FILENAME: line.append(record.getFileName()); break;
+            case FUNCTION: line.append(record.getFunction()); break;
+            case LINE: line.appendDecimal(static_cast<int64_t>(record.getLine())); break;
+        }
+    }
+}
+
+namespace
+{
+struct DateTimeCache
+{
+    uint64_t id;
+    int64_t  second;
+    size_t   length;
+    char     buf[64];
+};
+
+// a few per thread so that two formats of a thread do not evict each other
+thread_local DateTimeCache t_dateTimes[4];
+
+struct LevelName
+{
+    const char* name;
+    size_t      length;
+};
+
+const LevelName kLevelNames[] = {
+#define XX(name) {#name, sizeof(#name) - 1}
+    XX(OFF),
+    XX(TRACE),
+    XX(DEBUG),
+    XX(INFO),
+    XX(WARN),
+    XX(ERROR),
+    XX(FATAL),
+#undef XX
+};
+}  // namespace
+
+void LogFormatter::AppendDateTime(LogLine& line, uint64_t id, const char* format, Timestamp time)
 {
-    std::stringstream ss;
-    for (auto& i : units_)
+    int64_t seconds = time.seconds();
+    int64_t micros  = time.microSecondsRemainder();
+    if (micros < 0)
+    {
+        micros += Timestamp::kMicroSecondsPerSecond;
+        --seconds;
+    }
+
+    DateTimeCache& cache = t_dateTimes[id % (sizeof(t_dateTimes) / sizeof(t_dateTimes[0]))];
+    if (cache.id != id || cache.second != seconds)
     {
-        i->format(ss, logger, level, record);
+        time_t    t = static_cast<time_t>(seconds);
+        struct tm tm;
+        localtime_r(&t, &tm);
+        cache.length = strftime(cache.buf, sizeof(cache.buf), format, &tm);
+        cache.id     = id;
+        cache.second = seconds;
     }
-    return ss.str();
+
+    // ".%06d" of the microseconds
+    char* p = line.reserve(cache.length + 7);
+    memcpy(p, cache.buf, cache.length);
+    p += cache.length;
+    *p++       = '.';
+    size_t us  = static_cast<size_t>(micros);
+    size_t hi  = us / 10000 * 2;
+    size_t mid = us / 100 % 100 * 2;
+    size_t lo  = us % 100 * 2;
+    p[0]       = kDigitPairs[hi];
+    p[1]       = kDigitPairs[hi + 1];
+    p[2]       = kDigitPairs[mid];
+    p[3]       = kDigitPairs[mid + 1];
+    p[4]       = kDigitPairs[lo];
+    p[5]       = kDigitPairs[lo + 1];
+    line.commit(cache.length + 7);
 }
 
-std::ostream& LogFormatter::format(std::ostream& ofs, std::shared_ptr<Logger> logger, LogLevel level, LogRecord::ptr record)
+void LogFormatter::AppendLevel(LogLine& line, LogLevel level)
 {
-    for (auto& i : units_)
+    size_t i = static_cast<size_t>(level);
+    if (i >= sizeof(kLevelNames) / sizeof(kLevelNames[0]))
     {
-        i->format(ofs, logger, level, record);
+        i = 0;
     }
-    return ofs;
+    line.append(kLevelNames[i].name, kLevelNames[i].length);
+}
+
+uint64_t LogFormatter::NextDateTimeId()
+{
+    static AtomicInt<uint64_t> s_id;
+    return static_cast<uint64_t>(s_id.incrementAndFetch());  // 0 is an empty cache slot
 }
 
 enum STATUS
@@ -82,47 +213,62 @@ void LogFormatter::compile(const std::string& pattern)
         }
     }
 
-    static std::map<std::string, std::function<FormatUnit::ptr(const std::string& str)>> s_format_units = {
-#define XX(str, C)                                                                             \
-    {                                                                                          \
-        #str, [](const std::string& fmt) { return FormatUnit::ptr(std::make_shared<C>(fmt)); } \
-    }
-        XX(m, MessageFormatUnit),     // m:消息
-        XX(p, LevelFormatUnit),       // p:日志级别
-        XX(r, ElapseFormatUnit),      // r:累计毫秒数
-        XX(c, NameFormatUnit),        // c:日志名称
-        XX(t, ThreadIdFormatUnit),    // t:线程id
-        XX(n, NewLineFormatUnit),     // n:换行
-        XX(d, DateTimeFormatUnit),    // d:时间
-        XX(F, FilenameFormatUnit),    // F:文件名
-        XX(f, FunctionFormatUnit),    // f:函数名
-        XX(L, LineFormatUnit),        // L:行号
-        XX(T, TabFormatUnit),         // T:Tab
-        XX(b, SpaceFormatUnit),       // b:空格
-        XX(C, FiberIdFormatUnit),     // C:协程id
-        XX(N, ThreadNameFormatUnit),  // N:线程名称
-#undef XX
+    auto literal = [this](const std::string& text) {
+        if (!instructions_.empty() && instructions_.back().op == LITERAL)
+        {
+            instructions_.back().arg += text;  // one copy for the run
+        }
+        else
+        {
+            instructions_.push_back(Instruction{LITERAL, text, 0});
+        }
     };
 
     for (auto& unit : units)
     {
+        const std::string& name = std::get<0>(unit);
         if (std::get<2>(unit) == STR)
         {
-            units_.emplace_back(std::make_shared<StringFormatUnit>(std::get<0>(unit)));
+            literal(name);
+            continue;
         }
-        else
+        Op op;
+        switch (name[0])
         {
-            auto it = s_format_units.find(std::get<0>(unit));
-            if (it == s_format_units.end())
-            {
-                units_.emplace_back(std::make_shared<StringFormatUnit>("<<error_format %" + std::get<0>(unit) + ">>"));
+            case 'm': op = MESSAGE; break;      // m:消息
+            case 'p': op = LEVEL; break;        // p:日志级别
+            case 'r': op = ELAPSE; break;       // r:累计毫秒数
+            case 'c': op = NAME; break;         // c:日志名称
+            case 't': op = THREAD_ID; break;    // t:线程id
+            case 'd': op = DATETIME; break;     // d:时间
+            case 'F': op = FILENAME; break;     // F:文件名
+            case 'f': op = FUNCTION; break;     // f:函数名
+            case 'L': op = LINE; break;         // L:行号
+            case 'C': op = FIBER_ID; break;     // C:协程id
+            case 'N': op = THREAD_NAME; break;  // N:线程名称
+            case 'n': literal("\n"); continue; // n:换行
+            case 'T': literal("\t"); continue; // T:Tab
+            case 'b': literal(" "); continue;   // b:空格
+            default:
+                literal("<<error_format %" + name + ">>");
                 error_ = true;
-            }
-            else
-            {
-                units_.push_back(it->second(std::get<1>(unit)));
-            }
+                continue;
         }
+        if (op == DATETIME)
+        {
+            const std::string& format = std::get<1>(unit).empty() ? std::string("%Y-%m-%d %H:%M:%S") : std::get<1>(unit);
+            instructions_.push_back(Instruction{op, format, NextDateTimeId()});
+        }
+        else
+        {
+            instructions_.push_back(Instruction{op, std::string(), 0});
+        }
+    }
+
+    static const std::string s_default = DefaultLogFormatter::pattern();
+    if (pattern == s_default)
+    {
+        fixed_ = &DefaultLogFormatter::format;
     }
 }
 
@@ -3,200 +3,331 @@
 
 #include "easy/base/LogRecord.h"
 #include "easy/base/Logger.h"
+#include "easy/base/noncopyable.h"
 
 #include <inttypes.h>
 #include <memory.h>
 #include <ctime>
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace easy
 {
-class LogFormatter
+// a formatted line, a char buffer that only grows
+class LogLine : noncopyable
 {
   public:
-    typedef std::shared_ptr<LogFormatter> ptr;
+    static const size_t kInitSize = 4096;
 
-    explicit LogFormatter(const std::string& pattern);
-    ~LogFormatter() = default;
+    LogLine();
 
-    std::string format(Logger::ptr logger, LogLevel level, LogRecord::ptr record);
+    const char* data() const { return data_.get(); }
 
-    std::ostream& format(std::ostream& ofs, Logger::ptr logger, LogLevel level, LogRecord::ptr record);
+    char* data() { return data_.get(); }
 
-  public:
-    class FormatUnit
-    {
-      public:
-        typedef std::shared_ptr<FormatUnit> ptr;
-        virtual ~FormatUnit()                                                                            = default;
-        virtual void format(std::ostream& os, Logger::ptr logger, LogLevel level, LogRecord::ptr record) = 0;
-    };
+    size_t length() const { return static_cast<size_t>(cur_ - data_.get()); }
 
-    bool error() const { return error_; }
+    void clear() { cur_ = data_.get(); }
 
-    const std::string getPattern() const { return pattern_; }
-
-  private:
-    void compile(const std::string& pattern);
+    // room for n more bytes at the returned pointer
+    char* reserve(size_t n)
+    {
+        if (static_cast<size_t>(end_ - cur_) < n)
+        {
+            grow(n);
+        }
+        return cur_;
+    }
 
-  private:
-    std::string                  pattern_;
-    std::vector<FormatUnit::ptr> units_;
-    bool                         error_ = false;
-};
+    // n bytes were written at reserve()
+    void commit(size_t n) { cur_ += n; }
 
-class MessageFormatUnit : public LogFormatter::FormatUnit
-{
-  public:
-    MessageFormatUnit(const std::string& str = "") {}
+    void append(const char* s, size_t n)
+    {
+        memcpy(reserve(n), s, n);
+        cur_ += n;
+    }
 
-    void format(std::ostream& os, Logger::ptr logger, LogLevel level, LogRecord::ptr record) override { os << record->getContent(); }
-};
+    void append(const std::string& s) { append(s.data(), s.size()); }
 
-class LevelFormatUnit : public LogFormatter::FormatUnit
-{
-  public:
-    LevelFormatUnit(const std::string& str = "") {}
+    void append(const char* s) { append(s, strlen(s)); }
 
-    void format(std::ostream& os, Logger::ptr logger, LogLevel level, LogRecord::ptr record) override { os << toString(level); }
-};
+    void append(char c)
+    {
+        *reserve(1) = c;
+        ++cur_;
+    }
 
-class ElapseFormatUnit : public LogFormatter::FormatUnit
-{
-  public:
-    ElapseFormatUnit(const std::string& str = "") {}
+    void appendDecimal(uint64_t v) { cur_ = FormatDecimal(reserve(20), v); }
 
-    void format(std::ostream& os, Logger::ptr logger, LogLevel level, LogRecord::ptr record) override { os << record->getElapse(); }
-};
+    void appendDecimal(int64_t v)
+    {
+        if (v < 0)
+        {
+            append('-');
+            appendDecimal(static_cast<uint64_t>(0) - static_cast<uint64_t>(v));
+            return;
+        }
+        appendDecimal(static_cast<uint64_t>(v));
+    }
 
-class NameFormatUnit : public LogFormatter::FormatUnit
-{
-  public:
-    NameFormatUnit(const std::string& str = "") {}
+    // the line of this thread, nullptr while it is in use
+    static LogLine* Acquire();
 
-    void format(std::ostream& os, Logger::ptr logger, LogLevel level, LogRecord::ptr record) override { os << record->getLogger()->getName(); }
-};
+    static void Release(LogLine* line) { line->inUse_ = false; }
 
-class ThreadIdFormatUnit : public LogFormatter::FormatUnit
-{
-  public:
-    ThreadIdFormatUnit(const std::string& str = "") {}
+  private:
+    void grow(size_t n);
 
-    void format(std::ostream& os, Logger::ptr logger, LogLevel level, LogRecord::ptr record) override { os << record->getThreadId(); }
+    std::unique_ptr<char[]> data_;
+    char*                   cur_;
+    char*                   end_;
+    bool                    inUse_{false};  // the thread local one only
 };
 
-class FiberIdFormatUnit : public LogFormatter::FormatUnit
+// the line of this thread, an own one while a caller up the stack formats into it
+class LocalLogLine : noncopyable
 {
   public:
-    FiberIdFormatUnit(const std::string& str = "") {}
+    LocalLogLine() : line_(LogLine::Acquire())
+    {
+        if (!line_)
+        {
+            owned_.reset(new LogLine);
+            line_ = owned_.get();
+        }
+    }
 
-    void format(std::ostream& os, Logger::ptr logger, LogLevel level, LogRecord::ptr record) override { os << record->getFiberId(); }
-};
+    ~LocalLogLine()
+    {
+        if (!owned_)
+        {
+            LogLine::Release(line_);
+        }
+    }
 
-class ThreadNameFormatUnit : public LogFormatter::FormatUnit
-{
-  public:
-    ThreadNameFormatUnit(const std::string& str = "") {}
+    LogLine& operator*() { return *line_; }
+
+    LogLine* operator->() { return line_; }
 
-    void format(std::ostream& os, Logger::ptr logger, LogLevel level, LogRecord::ptr record) override { os << record->getThreadName(); }
+  private:
+    LogLine*                 line_;
+    std::unique_ptr<LogLine> owned_;
 };
 
-class DateTimeFormatUnit : public LogFormatter::FormatUnit
+// the pattern is compiled into a flat list of instructions, a format is one switch per instruction into a LogLine
+// adjacent literals, %b, %T and %n are merged into one, %d keeps the strftime part per second and thread
+class LogFormatter
 {
   public:
-    DateTimeFormatUnit(const std::string& format = "%Y-%m-%d %H:%M:%S") : format_(format) {}
+    typedef std::shared_ptr<LogFormatter> ptr;
 
-    void format(std::ostream& os, Logger::ptr logger, LogLevel level, LogRecord::ptr record) override
-    {
-        static thread_local char   timeBuf[32];
-        static thread_local time_t lastSecond;
+    explicit LogFormatter(const std::string& pattern);
+    ~LogFormatter() = default;
 
-        time_t seconds = record->getTimestamp().seconds();
+    std::string format(const Logger::ptr& logger, LogLevel level, const LogRecord::ptr& record);
 
-        char buf[32];
-        snprintf(buf, sizeof(buf), ".%06ld", record->getTimestamp().microSecondsRemainder());
+    std::ostream& format(std::ostream& ofs, const Logger::ptr& logger, LogLevel level, const LogRecord::ptr& record);
 
-        if (lastSecond == seconds)
+    // appends to line
+    void format(LogLine& line, const Logger::ptr& logger, LogLevel level, const LogRecord::ptr& record) const
+    {
+        if (fixed_)
         {
-            os << timeBuf << buf;
+            fixed_(line, level, *record);  // the default pattern, unrolled at compile time
             return;
         }
+        run(line, level, *record);
+    }
+
+    bool error() const { return error_; }
+
+    const std::string getPattern() const { return pattern_; }
 
-        struct tm tm;
-        localtime_r(&seconds, &tm);
-        strftime(timeBuf, sizeof(timeBuf), format_.c_str(), &tm);
-        os << timeBuf << buf;
+    // the datetime of %d, the strftime part is kept per thread and id until the second changes
+    static void AppendDateTime(LogLine& line, uint64_t id, const char* format, Timestamp time);
 
-        lastSecond = seconds;
-    }
+    static void AppendLevel(LogLine& line, LogLevel level);
+
+    // an id for the cache of AppendDateTime
+    static uint64_t NextDateTimeId();
+
+  private:
+    enum Op
+    {
+        LITERAL,
+        MESSAGE,
+        LEVEL,
+        ELAPSE,
+        NAME,
+        THREAD_ID,
+        FIBER_ID,
+        THREAD_NAME,
+        DATETIME,
+        FILENAME,
+        FUNCTION,
+        LINE,
+    };
+
+    struct Instruction
+    {
+        Op          op;
+        std::string arg;  // the text of LITERAL, the strftime format of DATETIME
+        uint64_t    id;   // DATETIME
+    };
+
+    typedef void (*FixedFormat)(LogLine& line, LogLevel level, const LogRecord& record);
+
+    void compile(const std::string& pattern);
+
+    void run(LogLine& line, LogLevel level, const LogRecord& record) const;
 
   private:
-    std::string format_;
+    std::string              pattern_;
+    std::vector<Instruction> instructions_;
+    FixedFormat              fixed_ = nullptr;
+    bool                     error_ = false;
 };
 
-class FilenameFormatUnit : public LogFormatter::FormatUnit
+// the units of FixedLogFormatter, a pattern known at compile time
+namespace fixed
 {
-  public:
-    FilenameFormatUnit(const std::string& str = "") {}
-
-    void format(std::ostream& os, Logger::ptr logger, LogLevel level, LogRecord::ptr record) override { os << record->getFileName(); }
+struct Message
+{
+    static void format(LogLine& line, LogLevel, const LogRecord& record) { line.append(record.getStream().data(), record.getStream().length()); }
+    static void pattern(std::string& out) { out += "%m"; }
 };
 
-class LineFormatUnit : public LogFormatter::FormatUnit
+struct Level
 {
-  public:
-    LineFormatUnit(const std::string& str = "") {}
+    static void format(LogLine& line, LogLevel level, const LogRecord&) { LogFormatter::AppendLevel(line, level); }
+    static void pattern(std::string& out) { out += "%p"; }
+};
 
-    void format(std::ostream& os, Logger::ptr logger, LogLevel level, LogRecord::ptr record) override { os << record->getLine(); }
+struct Elapse
+{
+    static void format(LogLine& line, LogLevel, const LogRecord& record) { line.appendDecimal(static_cast<uint64_t>(record.getElapse())); }
+    static void pattern(std::string& out) { out += "%r"; }
 };
 
-class FunctionFormatUnit : public LogFormatter::FormatUnit
+struct Name
 {
-  public:
-    FunctionFormatUnit(const std::string& str = "") {}
+    static void format(LogLine& line, LogLevel, const LogRecord& record) { line.append(record.getLogger()->getName()); }
+    static void pattern(std::string& out) { out += "%c"; }
+};
 
-    void format(std::ostream& os, Logger::ptr logger, LogLevel level, LogRecord::ptr record) override { os << record->getFunction(); }
+struct ThreadId
+{
+    static void format(LogLine& line, LogLevel, const LogRecord& record) { line.appendDecimal(static_cast<uint64_t>(record.getThreadId())); }
+    static void pattern(std::string& out) { out += "%t"; }
 };
 
-class NewLineFormatUnit : public LogFormatter::FormatUnit
+struct FiberId
 {
-  public:
-    NewLineFormatUnit(const std::string& str = "") {}
+    static void format(LogLine& line, LogLevel, const LogRecord& record) { line.appendDecimal(static_cast<uint64_t>(record.getFiberId())); }
+    static void pattern(std::string& out) { out += "%C"; }
+};
 
-    void format(std::ostream& os, Logger::ptr logger, LogLevel level, LogRecord::ptr record) override { os << std::endl; }
+struct ThreadName
+{
+    static void format(LogLine& line, LogLevel, const LogRecord& record) { line.append(record.getThreadName()); }
+    static void pattern(std::string& out) { out += "%N"; }
 };
 
-class StringFormatUnit : public LogFormatter::FormatUnit
+struct Filename
 {
-  public:
-    StringFormatUnit(const std::string& str) : str_(str) {}
+    static void format(LogLine& line, LogLevel, const LogRecord& record) { line.append(record.getFileName()); }
+    static void pattern(std::string& out) { out += "%F"; }
+};
 
-    void format(std::ostream& os, Logger::ptr logger, LogLevel level, LogRecord::ptr record) override { os << str_; }
+struct Function
+{
+    static void format(LogLine& line, LogLevel, const LogRecord& record) { line.append(record.getFunction()); }
+    static void pattern(std::string& out) { out += "%f"; }
+};
 
-  private:
-    std::string str_;
+struct Line
+{
+    static void format(LogLine& line, LogLevel, const LogRecord& record) { line.appendDecimal(static_cast<int64_t>(record.getLine())); }
+    static void pattern(std::string& out) { out += "%L"; }
 };
 
-class TabFormatUnit : public LogFormatter::FormatUnit
+struct DefaultDateTimeFormat
 {
-  public:
-    TabFormatUnit(const std::string& str = "") {}
+    static const char* value() { return "%Y-%m-%d %H:%M:%S"; }
+};
 
-    void format(std::ostream& os, Logger::ptr logger, LogLevel level, LogRecord::ptr record) override { os << "\t"; }
+// Format::value() is the strftime format
+template <typename Format = DefaultDateTimeFormat>
+struct DateTime
+{
+    static void format(LogLine& line, LogLevel, const LogRecord& record)
+    {
+        static const uint64_t id = LogFormatter::NextDateTimeId();
+        LogFormatter::AppendDateTime(line, id, Format::value(), record.getTimestamp());
+    }
+    static void pattern(std::string& out)
+    {
+        out += "%d{";
+        out += Format::value();
+        out += "}";
+    }
+};
 
-  private:
-    std::string str_;
+// literal text, %b, %T and %n are Text<' '>, Text<'\t'> and Text<'\n'>
+template <char... C>
+struct Text
+{
+    static void format(LogLine& line, LogLevel, const LogRecord&)
+    {
+        static const char s[] = {C...};
+        line.append(s, sizeof(s));
+    }
+    static void pattern(std::string& out)
+    {
+        static const char s[] = {C...};
+        for (char c : s)
+        {
+            switch (c)
+            {
+                case ' ': out += "%b"; break;
+                case '\t': out += "%T"; break;
+                case '\n': out += "%n"; break;
+                default: out += c; break;
+            }
+        }
+    }
 };
+}  // namespace fixed
 
-class SpaceFormatUnit : public LogFormatter::FormatUnit
+// a pattern as a list of fixed:: units, every unit is inlined into one function
+template <typename... Units>
+class FixedLogFormatter
 {
   public:
-    SpaceFormatUnit(const std::string& str = "") {}
+    static void format(LogLine& line, LogLevel level, const LogRecord& record)
+    {
+        int expand[] = {(Units::format(line, level, record), 0)...};
+        (void)expand;
+    }
 
-    void format(std::ostream& os, Logger::ptr logger, LogLevel level, LogRecord::ptr record) override { os << " "; }
+    // the same pattern for LogFormatter
+    static std::string pattern()
+    {
+        std::string out;
+        int         expand[] = {(Units::pattern(out), 0)...};
+        (void)expand;
+        return out;
+    }
 };
 
+// "[%d{%Y-%m-%d %H:%M:%S}]%b%t%b%N%b%C%b[%p]%b[%c]%b%f%b%F:%L%b%m%n", the pattern of a new Logger
+typedef FixedLogFormatter<fixed::Text<'['>, fixed::DateTime<>, fixed::Text<']', ' '>, fixed::ThreadId, fixed::Text<' '>, fixed::ThreadName,
+    fixed::Text<' '>, fixed::FiberId, fixed::Text<' ', '['>, fixed::Level, fixed::Text<']', ' ', '['>, fixed::Name, fixed::Text<']', ' '>,
+    fixed::Function, fixed::Text<' '>, fixed::Filename, fixed::Text<':'>, fixed::Line, fixed::Text<' '>, fixed::Message, fixed::Text<'\n'>>
+    DefaultLogFormatter;
+
 }  // namespace easy
 
 #endif
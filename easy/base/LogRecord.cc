@@ -1,12 +1,13 @@
 #include "easy/base/LogRecord.h"
 #include "easy/base/Logger.h"
 
-#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 namespace easy
 {
-LogRecord::LogRecord(Logger::ptr logger, LogLevel level, const char* file, int32_t line, const char* function, uint32_t elapse, uint32_t threadId,
-    uint32_t fiberId, Timestamp time, const std::string& threadName)
+LogRecord::LogRecord(Logger* logger, LogLevel level, const char* file, int32_t line, const char* function, uint32_t elapse, uint32_t threadId,
+    uint32_t fiberId, Timestamp time, const char* threadName)
     : fileName_(get_base_name(file)),
       line_(line),
       function_(function),
@@ -15,9 +16,30 @@ LogRecord::LogRecord(Logger::ptr logger, LogLevel level, const char* file, int32
       fiberId_(fiberId),
       timestamp_(time),
       threadName_(threadName),
+      stream_(LogStream::Acquire()),
       logger_(logger),
       level_(level)
-{}
+{
+    if (!stream_)
+    {
+        owned_.reset(new LogStream);
+        stream_ = owned_.get();
+    }
+}
+
+LogRecord::~LogRecord()
+{
+    if (!owned_)
+    {
+        LogStream::Release(stream_);
+    }
+}
+
+std::shared_ptr<Logger> LogRecord::getLogger() const
+{
+    // aliasing an empty ptr, no control block and no refcount, valid while the record is
+    return std::shared_ptr<Logger>(std::shared_ptr<Logger>(), logger_);
+}
 
 void LogRecord::format(const char* fmt, ...)
 {
@@ -29,25 +51,37 @@ void LogRecord::format(const char* fmt, ...)
 
 void LogRecord::format(const char* fmt, va_list al)
 {
-    char* buf = nullptr;
-    int   len = vasprintf(&buf, fmt, al);
+    char    buf[1024];
+    va_list copy;
+    va_copy(copy, al);
+    int len = vsnprintf(buf, sizeof(buf), fmt, copy);
+    va_end(copy);
+    if (len < 0)
+    {
+        return;
+    }
+    if (static_cast<size_t>(len) < sizeof(buf))
+    {
+        *stream_ << buf;
+        return;
+    }
+    char* big = nullptr;
+    len       = vasprintf(&big, fmt, al);
     if (len != -1)
     {
-        ss_ << std::string(buf, static_cast<size_t>(len));
-        free(buf);
+        stream_->write(big, len);
+        free(big);
     }
 }
 
-LogRecordRAII::LogRecordRAII(LogRecord::ptr record) : record_(record) {}
-
 LogRecordRAII::~LogRecordRAII()
 {
-    record_->getLogger()->log(record_->getLevel(), record_);
+    LogRecord::ptr record(LogRecord::ptr(), &record_);  // non owning, see getLogger
+    record_.getLogger()->log(record_.getLevel(), record);
     // if (record_->level() == LogLevel::FATAL)
     // {
     //   abort();
     // }
 }
 
-std::stringstream& LogRecordRAII::getSS() { return record_->getSS(); }
 }  // namespace easy
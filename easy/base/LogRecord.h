@@ -2,25 +2,31 @@
 #define __EASY_LOG_RECORD_H__
 
 #include "easy/base/LogLevel.h"
+#include "easy/base/LogStream.h"
 #include "easy/base/Timestamp.h"
+#include "easy/base/noncopyable.h"
 
+#include <stdarg.h>
 #include <string.h>  // strrchr
 #include <memory>
 #include <sstream>
+#include <string>
 
 namespace easy
 {
 class Logger;
 
-class LogRecord
+// lives on the stack of the ELOG_* statement, the appenders get a non owning ptr to it
+class LogRecord : noncopyable
 {
   public:
     typedef std::shared_ptr<LogRecord> ptr;
 
-    explicit LogRecord(std::shared_ptr<Logger> logger, LogLevel level, const char* file, int32_t line, const char* function, uint32_t elapse,
-        uint32_t threadId, uint32_t fiberIId, Timestamp time, const std::string& thread_name);
+    // logger and threadName outlive the record
+    explicit LogRecord(Logger* logger, LogLevel level, const char* file, int32_t line, const char* function, uint32_t elapse, uint32_t threadId,
+        uint32_t fiberIId, Timestamp time, const char* thread_name);
 
-    ~LogRecord() = default;
+    ~LogRecord();
 
     const char*             getFileName() const { return fileName_; }
     int32_t                 getLine() const { return line_; }
@@ -29,41 +35,52 @@ class LogRecord
     uint32_t                getThreadId() const { return threadId_; }
     uint32_t                getFiberId() const { return fiberId_; }
     Timestamp               getTimestamp() const { return timestamp_; }
-    const std::string&      getThreadName() const { return threadName_; }
-    std::string             getContent() const { return ss_.str(); }
-    std::shared_ptr<Logger> getLogger() const { return logger_; }
+    const char*             getThreadName() const { return threadName_; }
+    std::string             getContent() const { return stream_->str(); }
+    const LogStream&        getStream() const { return *stream_; }
+    std::shared_ptr<Logger> getLogger() const;
     LogLevel                getLevel() const { return level_; }
-    std::stringstream&      getSS() { return ss_; }
+    LogStream&              getSS() { return *stream_; }
 
     void format(const char* fmt, ...);
     void format(const char* fmt, va_list al);
 
   private:
-    inline const char* get_base_name(const char* filename) { return strrchr(filename, '/') ? strrchr(filename, '/') + 1 : filename; }
+    inline const char* get_base_name(const char* filename)
+    {
+        const char* slash = strrchr(filename, '/');
+        return slash ? slash + 1 : filename;
+    }
 
-    const char*             fileName_ = nullptr;  // 文件名
-    int32_t                 line_     = 0;        // 行号
-    const char*             function_ = nullptr;  // 函数名
-    uint32_t                elapse_   = 0;        // 程序启动开始到现在的毫秒数
-    uint32_t                threadId_ = 0;        // 线程id
-    uint32_t                fiberId_  = 0;        // 协程id
-    Timestamp               timestamp_;           // 时间戳
-    std::string             threadName_;          // 线程名
-    std::stringstream       ss_;                  // 日志内容流
-    std::shared_ptr<Logger> logger_;              // 日志事件归属的日志器
-    LogLevel                level_;
+    const char*                fileName_ = nullptr;  // 文件名
+    int32_t                    line_     = 0;        // 行号
+    const char*                function_ = nullptr;  // 函数名
+    uint32_t                   elapse_   = 0;        // 程序启动开始到现在的毫秒数
+    uint32_t                   threadId_ = 0;        // 线程id
+    uint32_t                   fiberId_  = 0;        // 协程id
+    Timestamp                  timestamp_;           // 时间戳
+    const char*                threadName_;          // 线程名
+    LogStream*                 stream_;              // 日志内容流，线程局部的或 owned_
+    std::unique_ptr<LogStream> owned_;               // 线程局部的流正被占用时
+    Logger*                    logger_;              // 日志事件归属的日志器
+    LogLevel                   level_;
 };
 
-class LogRecordRAII
+// the record is logged when the statement ends
+class LogRecordRAII : noncopyable
 {
   public:
-    LogRecordRAII(LogRecord::ptr e);
+    LogRecordRAII(Logger* logger, LogLevel level, const char* file, int32_t line, const char* function, uint32_t elapse, int threadId,
+        uint64_t fiberId, Timestamp time, const char* threadName)
+        : record_(logger, level, file, line, function, elapse, static_cast<uint32_t>(threadId), static_cast<uint32_t>(fiberId), time, threadName)
+    {}
+
     ~LogRecordRAII();
-    LogRecord::ptr     getRecord() const { return record_; }
-    std::stringstream& getSS();
+    LogRecord*  getRecord() { return &record_; }
+    LogStream&  getSS() { return record_.getSS(); }
 
   private:
-    LogRecord::ptr record_;
+    LogRecord record_;
 };
 
 }  // namespace easy
@@ -0,0 +1,346 @@
+#include "easy/base/LogRoller.h"
+#include "easy/base/Condition.h"
+#include "easy/base/FileUtil.h"
+#include "easy/base/Mutex.h"
+#include "easy/base/Thread.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <vector>
+
+#ifdef EASY_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+namespace easy
+{
+namespace
+{
+const size_t kStampSize = 15;  // YYYYmmdd-HHMMSS
+
+// gzip of from at to, from is removed if it worked
+bool Compress(const std::string& from, const std::string& to)
+{
+#ifdef EASY_HAS_ZLIB
+    int fd = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    gzFile gz = gzopen(to.c_str(), "wb");
+    if (!gz)
+    {
+        ::close(fd);
+        return false;
+    }
+    char    buf[64 * 1024];
+    bool    ok = true;
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof(buf))) != 0)
+    {
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            ok = false;
+            break;
+        }
+        if (gzwrite(gz, buf, static_cast<unsigned>(n)) != n)
+        {
+            ok = false;
+            break;
+        }
+    }
+    ::close(fd);
+    if (gzclose(gz) != Z_OK || !ok)
+    {
+        std::cout << "LogFileRoller compress " << from << " error" << std::endl;
+        ::unlink(to.c_str());
+        return false;
+    }
+    ::unlink(from.c_str());
+    return true;
+#else
+    static bool s_warned = false;  // the archiver thread only
+    if (!s_warned)
+    {
+        s_warned = true;
+        std::cout << "LogFileRoller built without zlib, rolled files are not compressed" << std::endl;
+    }
+    return false;
+#endif
+}
+
+// the stamp and the .N of a rolled file of base, false if name is not one
+bool ParseRolled(const std::string& name, const std::string& base, std::string& stamp, long& seq)
+{
+    size_t p = base.size() + 1;
+    if (name.size() < p + kStampSize || name.compare(0, base.size(), base) != 0 || name[base.size()] != '.')
+    {
+        return false;
+    }
+    for (size_t i = 0; i < kStampSize; ++i)
+    {
+        char c = name[p + i];
+        if (i == 8 ? c != '-' : !isdigit(static_cast<unsigned char>(c)))
+        {
+            return false;
+        }
+    }
+    stamp = name.substr(p, kStampSize);
+    p += kStampSize;
+
+    size_t end = name.size();
+    if (end - p >= 3 && name.compare(end - 3, 3, ".gz") == 0)
+    {
+        end -= 3;
+    }
+    seq = 0;
+    if (p == end)
+    {
+        return true;
+    }
+    if (name[p] != '.' || p + 1 == end)
+    {
+        return false;
+    }
+    for (size_t i = p + 1; i < end; ++i)
+    {
+        if (!isdigit(static_cast<unsigned char>(name[i])))
+        {
+            return false;
+        }
+    }
+    seq = strtol(name.c_str() + p + 1, nullptr, 10);
+    return true;
+}
+
+// removes the oldest rolled files of filename beyond maxFiles
+void Prune(const std::string& filename, size_t maxFiles)
+{
+    struct Rolled
+    {
+        std::string stamp;
+        long        seq;
+        std::string path;
+
+        bool operator<(const Rolled& oth) const { return stamp != oth.stamp ? stamp < oth.stamp : seq < oth.seq; }
+    };
+
+    std::string dirname = FileUtil::Dirname(filename);
+    std::string base    = FileUtil::Basename(filename);
+    DIR*        dir     = opendir(dirname.c_str());
+    if (!dir)
+    {
+        return;
+    }
+    std::vector<Rolled> files;
+    struct dirent*      dp = nullptr;
+    while ((dp = readdir(dir)) != nullptr)
+    {
+        Rolled rolled;
+        if (ParseRolled(dp->d_name, base, rolled.stamp, rolled.seq))
+        {
+            rolled.path = dirname + "/" + dp->d_name;
+            files.push_back(rolled);
+        }
+    }
+    closedir(dir);
+
+    if (files.size() > maxFiles)
+    {
+        std::sort(files.begin(), files.end());
+        for (size_t i = 0; i < files.size() - maxFiles; ++i)
+        {
+            FileUtil::Unlink(files[i].path);
+        }
+    }
+}
+
+// 压缩和清理滚动出来的文件，所有的 appender 共用一个线程
+class Archiver : noncopyable
+{
+  public:
+    struct Task
+    {
+        std::string path;  // the rolled file
+        std::string filename;
+        size_t      maxFiles;
+        bool        compress;
+    };
+
+    // never destroyed, an appender may roll while the process exits
+    static Archiver& Instance()
+    {
+        static Archiver* s_archiver = new Archiver;
+        return *s_archiver;
+    }
+
+    void add(const Task& task)
+    {
+        MutexLockGuard _(mutex_);
+        tasks_.push_back(task);
+        ++queued_;
+        cond_.notify();
+    }
+
+    void drain()
+    {
+        MutexLockGuard _(mutex_);
+        uint64_t       target = queued_;
+        while (done_ < target)
+        {
+            doneCond_.wait();
+        }
+    }
+
+  private:
+    Archiver() : cond_(mutex_), doneCond_(mutex_)
+    {
+        thread_ = std::make_shared<Thread>(std::bind(&Archiver::run, this), "LogArchiver");
+    }
+
+    void run()
+    {
+        while (true)
+        {
+            Task task;
+            {
+                MutexLockGuard _(mutex_);
+                while (tasks_.empty())
+                {
+                    cond_.wait();
+                }
+                task = tasks_.front();
+                tasks_.pop_front();
+            }
+
+            if (task.compress)
+            {
+                Compress(task.path, task.path + ".gz");
+            }
+            if (task.maxFiles > 0)
+            {
+                Prune(task.filename, task.maxFiles);
+            }
+
+            MutexLockGuard _(mutex_);
+            ++done_;
+            doneCond_.notifyAll();
+        }
+    }
+
+  private:
+    MutexLock        mutex_;
+    Condition        cond_;      // tasks_ not empty
+    Condition        doneCond_;  // a task was done
+    std::deque<Task> tasks_;
+    uint64_t         queued_{0};
+    uint64_t         done_{0};
+    Thread::ptr      thread_;
+};
+}  // namespace
+
+LogFileRoller::LogFileRoller(const std::string& filename, const LogRollOptions& options) : filename_(filename), options_(options) {}
+
+void LogFileRoller::opened(size_t size, Timestamp mtime)
+{
+    size_ = size;
+    if (options_.interval > 0)
+    {
+        // the next multiple of the interval in local time, a daily file rolls at the local midnight
+        time_t    seconds = static_cast<time_t>((size ? mtime : Timestamp::now()).seconds());
+        struct tm tm;
+        localtime_r(&seconds, &tm);
+        int64_t local = static_cast<int64_t>(seconds) + tm.tm_gmtoff;
+        int64_t next  = (local / options_.interval + 1) * options_.interval - tm.tm_gmtoff;
+        nextRoll_     = next * Timestamp::kMicroSecondsPerSecond;
+    }
+}
+
+std::string LogFileRoller::roll(Timestamp now) const
+{
+    time_t    seconds = static_cast<time_t>(now.seconds());
+    struct tm tm;
+    char      stamp[32];
+    localtime_r(&seconds, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+
+    std::string path = filename_ + "." + stamp;
+    for (int i = 1; ::access(path.c_str(), F_OK) == 0 || ::access((path + ".gz").c_str(), F_OK) == 0; ++i)
+    {
+        path = filename_ + "." + stamp + "." + std::to_string(i);
+    }
+    if (::rename(filename_.c_str(), path.c_str()) != 0)
+    {
+        if (errno != ENOENT)
+        {
+            std::cout << "LogFileRoller rename " << filename_ << " error: " << strerror(errno) << std::endl;
+        }
+        return "";
+    }
+    return path;
+}
+
+void LogFileRoller::rolled(const std::string& path) const
+{
+    if (options_.compress || options_.maxFiles > 0)
+    {
+        Archiver::Instance().add(Archiver::Task{path, filename_, options_.maxFiles, options_.compress});
+    }
+}
+
+void LogFileRoller::Drain() { Archiver::Instance().drain(); }
+
+bool LogFileRoller::ParseInterval(const std::string& str, int& interval)
+{
+    if (str == "none")
+    {
+        interval = 0;
+    }
+    else if (str == "hourly")
+    {
+        interval = Timestamp::kSecondsPerHour;
+    }
+    else if (str == "daily")
+    {
+        interval = 24 * Timestamp::kSecondsPerHour;
+    }
+    else
+    {
+        char* end   = nullptr;
+        long  value = strtol(str.c_str(), &end, 10);
+        if (str.empty() || *end || value < 0 || value > 366 * 24 * Timestamp::kSecondsPerHour)
+        {
+            return false;
+        }
+        interval = static_cast<int>(value);
+    }
+    return true;
+}
+
+std::string LogFileRoller::IntervalToString(int interval)
+{
+    if (interval == Timestamp::kSecondsPerHour)
+    {
+        return "hourly";
+    }
+    if (interval == 24 * Timestamp::kSecondsPerHour)
+    {
+        return "daily";
+    }
+    return interval > 0 ? std::to_string(interval) : "none";
+}
+
+}  // namespace easy
@@ -0,0 +1,77 @@
+#ifndef __EASY_LOG_ROLLER_H__
+#define __EASY_LOG_ROLLER_H__
+
+#include "easy/base/Timestamp.h"
+#include "easy/base/noncopyable.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace easy
+{
+// 日志文件滚动的配置，maxSize 和 interval 都为 0 时不滚动
+struct LogRollOptions
+{
+    size_t maxSize  = 0;      // bytes of a file, 0 no limit
+    int    interval = 0;      // seconds of a file in local time, 3600 hourly, 86400 daily, 0 no limit
+    size_t maxFiles = 0;      // rolled files kept, 0 all
+    bool   compress = false;  // gzip a rolled file
+
+    bool enabled() const { return maxSize > 0 || interval > 0; }
+
+    bool operator==(const LogRollOptions& oth) const
+    {
+        return maxSize == oth.maxSize && interval == oth.interval && maxFiles == oth.maxFiles && compress == oth.compress;
+    }
+};
+
+// 按大小和时间滚动日志文件
+// a rolled file is renamed to filename.YYYYmmdd-HHMMSS, the local time it was rolled, a .N is added if that exists
+// one background thread for all the appenders compresses it and removes the oldest beyond maxFiles
+// opened(), wrote() and due() are called by the writer of the file, roll() and rolled() only read the options
+class LogFileRoller : noncopyable
+{
+  public:
+    LogFileRoller(const std::string& filename, const LogRollOptions& options);
+
+    const LogRollOptions& options() const { return options_; }
+
+    // the file was opened with size bytes, modified last at mtime
+    // a file left from an earlier interval rolls before its first write
+    void opened(size_t size, Timestamp mtime);
+
+    void wrote(size_t len) { size_ += len; }
+
+    // writing len more bytes goes over maxSize, or the interval of the file is over, an empty file never rolls
+    bool due(size_t len, Timestamp now) const
+    {
+        return size_ > 0 && ((options_.maxSize > 0 && size_ + len > options_.maxSize) ||
+                                (options_.interval > 0 && now.microSecondsSinceEpoch() >= nextRoll_));
+    }
+
+    // renames the file, the writers may go on with the renamed one until they open a new file
+    // the new name, empty if there was nothing to rename
+    std::string roll(Timestamp now) const;
+
+    // the writers closed the file from roll(), it is compressed and the old ones removed in the background
+    void rolled(const std::string& path) const;
+
+    // waits for the background work queued so far
+    static void Drain();
+
+    // "hourly", "daily", "none" or seconds
+    static bool ParseInterval(const std::string& str, int& interval);
+
+    static std::string IntervalToString(int interval);
+
+  private:
+    std::string    filename_;
+    LogRollOptions options_;
+    size_t         size_{0};
+    int64_t        nextRoll_{0};  // us, the end of the interval of the file
+};
+
+}  // namespace easy
+
+#endif
@@ -0,0 +1,121 @@
+#include "easy/base/LogStream.h"
+
+#include <string.h>
+#include <type_traits>
+
+namespace easy
+{
+const char kDigitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+void LogStream::Buffer::unspill()
+{
+    spilled_ = false;
+    if (spill_.capacity() > 16 * kSize)
+    {
+        std::string().swap(spill_);  // one huge message does not pin its memory
+    }
+    spill_.clear();
+}
+
+void LogStream::Buffer::spill()
+{
+    if (!spilled_)
+    {
+        spill_.assign(pbase(), pptr());
+        spilled_ = true;
+        setp(nullptr, nullptr);  // every write goes to overflow or xsputn from now on
+    }
+}
+
+void LogStream::Buffer::appendSlow(const char* s, size_t n)
+{
+    spill();
+    spill_.append(s, n);
+}
+
+LogStream::Buffer::int_type LogStream::Buffer::overflow(int_type c)
+{
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        return traits_type::not_eof(c);
+    }
+    spill();
+    spill_.push_back(traits_type::to_char_type(c));
+    return c;
+}
+
+std::streamsize LogStream::Buffer::xsputn(const char* s, std::streamsize n)
+{
+    append(s, static_cast<size_t>(n));
+    return n;
+}
+
+LogStream::LogStream() : std::ostream(nullptr) { rdbuf(&buf_); }
+
+LogStream& LogStream::ThreadLocal()
+{
+    static thread_local LogStream t_stream;
+    return t_stream;
+}
+
+void LogStream::resetFormat()
+{
+    clear();
+    flags(skipws | dec);
+    width(0);
+    precision(6);
+    fill(' ');
+}
+
+
+LogStream& LogStream::operator<<(const char* v)
+{
+    if (!v || width() != 0)
+    {
+        return fallback(v);  // sets badbit for nullptr like std::ostream
+    }
+    buf_.append(v, strlen(v));
+    return *this;
+}
+
+template <typename T>
+LogStream& LogStream::formatInteger(T v)
+{
+    if ((flags() & (basefield | showpos)) != dec || width() != 0)
+    {
+        return fallback(v);
+    }
+    typedef typename std::make_unsigned<T>::type U;
+    char                                         buf[32];
+    char*                                        p = buf;
+    U                                            u = static_cast<U>(v);
+    if (v < static_cast<T>(0))
+    {
+        *p++ = '-';
+        u    = static_cast<U>(0 - u);  // the magnitude in unsigned so that the minimum works
+    }
+    char* last = FormatDecimal(p, static_cast<uint64_t>(u));
+    buf_.append(buf, static_cast<size_t>(last - buf));
+    return *this;
+}
+
+template LogStream& LogStream::formatInteger(short);
+template LogStream& LogStream::formatInteger(unsigned short);
+template LogStream& LogStream::formatInteger(int);
+template LogStream& LogStream::formatInteger(unsigned int);
+template LogStream& LogStream::formatInteger(long);
+template LogStream& LogStream::formatInteger(unsigned long);
+template LogStream& LogStream::formatInteger(long long);
+template LogStream& LogStream::formatInteger(unsigned long long);
+
+}  // namespace easy
@@ -0,0 +1,192 @@
+#ifndef __EASY_LOG_STREAM_H__
+#define __EASY_LOG_STREAM_H__
+
+#include "easy/base/noncopyable.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <ostream>
+#include <string>
+
+namespace easy
+{
+extern const char kDigitPairs[201];  // "00" "01" ... "99"
+
+// v in decimal at buf, two digits per division, returns the end, at most 20 chars
+inline char* FormatDecimal(char* buf, uint64_t v)
+{
+    size_t digits = 1;
+    for (uint64_t x = v; x >= 10; x /= 10)
+    {
+        ++digits;
+    }
+    char* last = buf + digits;
+    char* p    = last;
+    while (v >= 100)
+    {
+        size_t i = static_cast<size_t>(v % 100) * 2;
+        v /= 100;
+        *--p = kDigitPairs[i + 1];
+        *--p = kDigitPairs[i];
+    }
+    if (v >= 10)
+    {
+        size_t i = static_cast<size_t>(v) * 2;
+        *--p     = kDigitPairs[i + 1];
+        *--p     = kDigitPairs[i];
+    }
+    else
+    {
+        *--p = static_cast<char>('0' + v);
+    }
+    return last;
+}
+
+// the message of a log record, muduo LogStream style
+// an ostream over a fixed buffer, a message that does not fit goes on in a string
+// one per thread is reused, a message under kSize bytes does not allocate
+class LogStream : public std::ostream, noncopyable
+{
+  public:
+    static const size_t kSize = 4000;
+
+    LogStream();
+
+    const char* data() const { return buf_.data(); }
+
+    size_t length() const { return buf_.length(); }
+
+    std::string str() const { return std::string(data(), length()); }
+
+    // empty, with the default format flags
+    void reset()
+    {
+        buf_.reset();
+        // the last message may have used manipulators, the setters are only called then
+        if (rdstate() != goodbit || flags() != (skipws | dec) || width() != 0 || precision() != 6 || fill() != ' ')
+        {
+            resetFormat();
+        }
+    }
+
+    // the stream of this thread, nullptr while a record of this thread still uses it
+    static LogStream* Acquire()
+    {
+        LogStream& stream = ThreadLocal();
+        if (stream.inUse_)
+        {
+            return nullptr;  // logging while formatting a record, or another fiber is in the middle of one
+        }
+        stream.inUse_ = true;
+        stream.reset();
+        return &stream;
+    }
+
+    static void Release(LogStream* stream) { stream->inUse_ = false; }
+
+    // fast paths, they return LogStream& so that a chain stays on them
+    // the integers fall back to std::ostream when a manipulator changed the base, width or sign
+    using std::ostream::operator<<;
+
+    LogStream& operator<<(const char* v);
+    LogStream& operator<<(const std::string& v)
+    {
+        if (width() != 0)
+        {
+            return fallback(v);
+        }
+        buf_.append(v.data(), v.size());
+        return *this;
+    }
+    LogStream& operator<<(char v)
+    {
+        if (width() != 0)
+        {
+            return fallback(v);
+        }
+        buf_.append(&v, 1);
+        return *this;
+    }
+    // characters like std::ostream, not integers, uint8_t and int8_t are ambiguous without them
+    LogStream& operator<<(signed char v) { return *this << static_cast<char>(v); }
+    LogStream& operator<<(unsigned char v) { return *this << static_cast<char>(v); }
+    LogStream& operator<<(short v) { return formatInteger(v); }
+    LogStream& operator<<(unsigned short v) { return formatInteger(v); }
+    LogStream& operator<<(int v) { return formatInteger(v); }
+    LogStream& operator<<(unsigned int v) { return formatInteger(v); }
+    LogStream& operator<<(long v) { return formatInteger(v); }
+    LogStream& operator<<(unsigned long v) { return formatInteger(v); }
+    LogStream& operator<<(long long v) { return formatInteger(v); }
+    LogStream& operator<<(unsigned long long v) { return formatInteger(v); }
+
+  private:
+    class Buffer : public std::streambuf
+    {
+      public:
+        Buffer() { reset(); }
+
+        const char* data() const { return spilled_ ? spill_.data() : pbase(); }
+
+        size_t length() const { return spilled_ ? spill_.size() : static_cast<size_t>(pptr() - pbase()); }
+
+        void reset()
+        {
+            if (spilled_)
+            {
+                unspill();
+            }
+            setp(data_, data_ + kSize);
+        }
+
+        // no virtual call while it fits
+        void append(const char* s, size_t n)
+        {
+            if (static_cast<size_t>(epptr() - pptr()) >= n)  // 0 once spilled
+            {
+                memcpy(pptr(), s, n);
+                pbump(static_cast<int>(n));
+                return;
+            }
+            appendSlow(s, n);
+        }
+
+      protected:
+        int_type overflow(int_type c) override;
+
+        std::streamsize xsputn(const char* s, std::streamsize n) override;
+
+      private:
+        void appendSlow(const char* s, size_t n);
+
+        void spill();
+
+        void unspill();
+
+      private:
+        char        data_[kSize];
+        std::string spill_;
+        bool        spilled_{false};
+    };
+
+    static LogStream& ThreadLocal();
+
+    void resetFormat();
+
+    // through std::ostream, honours width and the flags
+    template <typename T>
+    LogStream& fallback(const T& v)
+    {
+        static_cast<std::ostream&>(*this) << v;
+        return *this;
+    }
+
+    template <typename T>
+    LogStream& formatInteger(T v);
+
+    Buffer buf_;
+    bool   inUse_{false};  // the thread local one only
+};
+
+}  // namespace easy
+
+#endif
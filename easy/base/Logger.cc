@@ -12,6 +12,8 @@ namespace easy
 
 Logger::Logger(const std::string& name) : name_(name), level_(LogLevel::TRACE)
 {
+    static AtomicInt<uint32_t> s_id;
+    id_        = s_id.incrementAndFetch();
     formatter_ = std::make_shared<LogFormatter>("[%d{%Y-%m-%d %H:%M:%S}]%b%t%b%N%b%C%b[%p]%b[%c]%b%f%b%F:%L%b%m%n");
 }
 
@@ -111,9 +113,9 @@ void Logger::clearAppender()
     appenders_.clear();
 }
 
-void Logger::log(LogLevel level, LogRecord::ptr record)
+void Logger::log(LogLevel level, const LogRecord::ptr& record)
 {
-    auto          self = shared_from_this();
+    Logger::ptr   self(Logger::ptr(), this);  // non owning, no refcount, the caller holds the logger
     ReadLockGuard _(lock_);
     if (!appenders_.empty())
     {
@@ -129,17 +131,46 @@ void Logger::log(LogLevel level, LogRecord::ptr record)
     }
 }
 
-void Logger::trace(LogRecord::ptr record) { log(LogLevel::TRACE, record); }
+void Logger::logBinary(const BinaryLogSite& site, const BinaryLogArgs& args)
+{
+    BinaryLogRecord record{&site,
+        this,
+        Timestamp::now(),
+        static_cast<uint32_t>(Thread::GetCurrentThreadId()),
+        static_cast<uint32_t>(Fiber::CurrentFiberId()),
+        Thread::GetCurrentThreadName(),
+        &args};
+    logBinary(record);
+}
 
-void Logger::debug(LogRecord::ptr record) { log(LogLevel::DEBUG, record); }
+void Logger::logBinary(const BinaryLogRecord& record)
+{
+    Logger::ptr   self(Logger::ptr(), this);
+    ReadLockGuard _(lock_);
+    if (!appenders_.empty())
+    {
+        for (auto& i : appenders_)
+        {
+            i->logBinary(self, record);
+        }
+    }
+    else if (root_)
+    {
+        root_->logBinary(record);
+    }
+}
+
+void Logger::trace(const LogRecord::ptr& record) { log(LogLevel::TRACE, record); }
 
-void Logger::info(LogRecord::ptr record) { log(LogLevel::INFO, record); }
+void Logger::debug(const LogRecord::ptr& record) { log(LogLevel::DEBUG, record); }
 
-void Logger::warn(LogRecord::ptr record) { log(LogLevel::WARN, record); }
+void Logger::info(const LogRecord::ptr& record) { log(LogLevel::INFO, record); }
 
-void Logger::error(LogRecord::ptr record) { log(LogLevel::ERROR, record); }
+void Logger::warn(const LogRecord::ptr& record) { log(LogLevel::WARN, record); }
 
-void Logger::fatal(LogRecord::ptr record) { log(LogLevel::FATAL, record); }
+void Logger::error(const LogRecord::ptr& record) { log(LogLevel::ERROR, record); }
+
+void Logger::fatal(const LogRecord::ptr& record) { log(LogLevel::FATAL, record); }
 
 LoggerManager::LoggerManager()
 {
@@ -190,17 +221,48 @@ std::string LoggerManager::toYamlString()
 
 struct LogAppenderDefine
 {
-    int         type  = 0;  // 1 File, 2 Console
-    LogLevel    level = LogLevel::OFF;
-    std::string formatter;
-    std::string file;
+    int            type  = 0;  // 1 File, 2 Console, 3 AsyncFile
+    LogLevel       level = LogLevel::OFF;
+    std::string    formatter;
+    std::string    file;
+    size_t         bufferSize    = AsyncFileLogAppender::kDefaultBufferSize;  // AsyncFile only
+    int            flushInterval = 1000;
+    size_t         maxBuffers    = 16;
+    std::string    overflow      = "block";
+    std::string    mode          = "text";
+    LogRollOptions roll;  // File and AsyncFile
 
     bool operator==(const LogAppenderDefine& oth) const
     {
-        return type == oth.type && level == oth.level && formatter == oth.formatter && file == oth.file;
+        return type == oth.type && level == oth.level && formatter == oth.formatter && file == oth.file && bufferSize == oth.bufferSize &&
+               flushInterval == oth.flushInterval && maxBuffers == oth.maxBuffers && overflow == oth.overflow && mode == oth.mode &&
+               roll == oth.roll;
     }
 };
 
+// max_size, roll_interval, max_files and compress of a file appender, false if one is invalid
+static bool ParseRoll(const YAML::Node& a, LogRollOptions& roll)
+{
+    if (a["max_size"].IsDefined())
+    {
+        roll.maxSize = a["max_size"].as<size_t>();
+    }
+    if (a["roll_interval"].IsDefined() && !LogFileRoller::ParseInterval(a["roll_interval"].as<std::string>(), roll.interval))
+    {
+        std::cout << "log config error: roll_interval is invalid, " << a << std::endl;
+        return false;
+    }
+    if (a["max_files"].IsDefined())
+    {
+        roll.maxFiles = a["max_files"].as<size_t>();
+    }
+    if (a["compress"].IsDefined())
+    {
+        roll.compress = a["compress"].as<bool>();
+    }
+    return true;
+}
+
 struct LogDefine
 {
     std::string                    name;
@@ -259,6 +321,58 @@ class LexicalCast<std::string, LogDefine>
                         continue;
                     }
                     lad.file = a["file"].as<std::string>();
+                    if (!ParseRoll(a, lad.roll))
+                    {
+                        continue;
+                    }
+                    if (a["formatter"].IsDefined())
+                    {
+                        lad.formatter = a["formatter"].as<std::string>();
+                    }
+                }
+                else if (type == "AsyncFileLogAppender")
+                {
+                    lad.type = 3;
+                    if (!a["file"].IsDefined())
+                    {
+                        std::cout << "log config error: asyncfileappender file is null, " << a << std::endl;
+                        continue;
+                    }
+                    lad.file = a["file"].as<std::string>();
+                    if (a["buffer_size"].IsDefined())
+                    {
+                        lad.bufferSize = a["buffer_size"].as<size_t>();
+                    }
+                    if (a["flush_interval"].IsDefined())
+                    {
+                        lad.flushInterval = a["flush_interval"].as<int>();
+                    }
+                    if (a["max_buffers"].IsDefined())
+                    {
+                        lad.maxBuffers = a["max_buffers"].as<size_t>();
+                    }
+                    if (a["overflow"].IsDefined())
+                    {
+                        lad.overflow = a["overflow"].as<std::string>();
+                        if (lad.overflow != "block" && lad.overflow != "drop")
+                        {
+                            std::cout << "log config error: asyncfileappender overflow is invalid, " << a << std::endl;
+                            continue;
+                        }
+                    }
+                    if (a["mode"].IsDefined())
+                    {
+                        lad.mode = a["mode"].as<std::string>();
+                        if (lad.mode != "text" && lad.mode != "binary")
+                        {
+                            std::cout << "log config error: asyncfileappender mode is invalid, " << a << std::endl;
+                            continue;
+                        }
+                    }
+                    if (!ParseRoll(a, lad.roll))
+                    {
+                        continue;
+                    }
                     if (a["formatter"].IsDefined())
                     {
                         lad.formatter = a["formatter"].as<std::string>();
@@ -314,6 +428,23 @@ class LexicalCast<LogDefine, std::string>
             {
                 na["type"] = "ConsoleLogAppender";
             }
+            else if (a.type == 3)
+            {
+                na["type"]           = "AsyncFileLogAppender";
+                na["file"]           = a.file;
+                na["buffer_size"]    = a.bufferSize;
+                na["flush_interval"] = a.flushInterval;
+                na["max_buffers"]    = a.maxBuffers;
+                na["overflow"]       = a.overflow;
+                na["mode"]           = a.mode;
+            }
+            if ((a.type == 1 || a.type == 3) && a.roll.enabled())
+            {
+                na["max_size"]      = a.roll.maxSize;
+                na["roll_interval"] = LogFileRoller::IntervalToString(a.roll.interval);
+                na["max_files"]     = a.roll.maxFiles;
+                na["compress"]      = a.roll.compress;
+            }
             if (a.level != LogLevel::OFF)
             {
                 na["level"] = toString(a.level);
@@ -373,7 +504,17 @@ struct LogIniter
                     LogAppender::ptr ap;
                     if (a.type == 1)
                     {
-                        ap = std::make_shared<FileLogAppender>(a.file);
+                        ap = std::make_shared<FileLogAppender>(a.file, a.roll);
+                    }
+                    else if (a.type == 3)
+                    {
+                        ap = std::make_shared<AsyncFileLogAppender>(a.file,
+                            a.bufferSize,
+                            a.flushInterval,
+                            a.maxBuffers,
+                            a.overflow == "drop" ? AsyncFileLogAppender::DROP : AsyncFileLogAppender::BLOCK,
+                            a.mode == "binary" ? AsyncFileLogAppender::BINARY : AsyncFileLogAppender::TEXT,
+                            a.roll);
                     }
                     else if (a.type == 2)
                     {
@@ -418,4 +559,6 @@ struct LogIniter
         });
     }
 };
+
+static LogIniter s_log_initer;
 }  // namespace easy
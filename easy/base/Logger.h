@@ -5,6 +5,7 @@
 #include <map>
 #include <memory>
 
+#include "easy/base/BinaryLog.h"
 #include "easy/base/Fiber.h"
 #include "easy/base/LogRecord.h"
 #include "easy/base/LogLevel.h"
@@ -15,16 +16,16 @@
 
 #define ELOG_LEVEL(obj, level)                                     \
     if (obj->getLevel() <= level)                                  \
-    easy::LogRecordRAII(std::make_shared<easy::LogRecord>(obj,     \
-                            level,                                 \
-                            __FILE__,                              \
-                            __LINE__,                              \
-                            __FUNCTION__,                          \
-                            0,                                     \
-                            easy::Thread::GetCurrentThreadId(),    \
-                            easy::Fiber::CurrentFiberId(),         \
-                            easy::Timestamp::now(),                \
-                            easy::Thread::GetCurrentThreadName())) \
+    easy::LogRecordRAII((obj).get(),                               \
+        level,                                                     \
+        __FILE__,                                                  \
+        __LINE__,                                                  \
+        __FUNCTION__,                                              \
+        0,                                                         \
+        easy::Thread::GetCurrentThreadId(),                        \
+        easy::Fiber::CurrentFiberId(),                             \
+        easy::Timestamp::now(),                                    \
+        easy::Thread::GetCurrentThreadName())                      \
         .getSS()
 
 #define ELOG_TRACE(obj) ELOG_LEVEL(obj, easy::LogLevel::TRACE)
@@ -36,16 +37,16 @@
 
 #define ELOG_FMT_LEVEL(obj, level, fmt, ...)                       \
     if (obj->getLevel() <= level)                                  \
-    easy::LogRecordRAII(std::make_shared<easy::LogRecord>(obj,     \
-                            level,                                 \
-                            __FILE__,                              \
-                            __LINE__,                              \
-                            __FUNCTION__,                          \
-                            0,                                     \
-                            easy::Thread::GetCurrentThreadId(),    \
-                            easy::Fiber::CurrentFiberId(),         \
-                            easy::Timestamp::now(),                \
-                            easy::Thread::GetCurrentThreadName())) \
+    easy::LogRecordRAII((obj).get(),                               \
+        level,                                                     \
+        __FILE__,                                                  \
+        __LINE__,                                                  \
+        __FUNCTION__,                                              \
+        0,                                                         \
+        easy::Thread::GetCurrentThreadId(),                        \
+        easy::Fiber::CurrentFiberId(),                             \
+        easy::Timestamp::now(),                                    \
+        easy::Thread::GetCurrentThreadName())                      \
         .getRecord()                                               \
         ->format(fmt, __VA_ARGS__)
 
@@ -56,6 +57,29 @@
 #define ELOG_FMT_ERROR(obj, fmt, ...) ELOG_FMT_LEVEL(obj, easy::LogLevel::ERROR, fmt, __VA_ARGS__)
 #define ELOG_FMT_FATAL(obj, fmt, ...) ELOG_FMT_LEVEL(obj, easy::LogLevel::FATAL, fmt, __VA_ARGS__)
 
+// binary, the hot thread records the site and the raw arguments, the text is made by the appender or offline
+// the arguments are printf ones, a string is copied, the level is fixed by the first run of the statement
+#define ELOG_BIN_LEVEL(obj, level, fmt, ...)                                                          \
+    do                                                                                                \
+    {                                                                                                 \
+        if (obj->getLevel() <= level)                                                                 \
+        {                                                                                             \
+            static const easy::BinaryLogSite _elogSite(level, __FILE__, __LINE__, __FUNCTION__, fmt); \
+            (obj)->logBinary(_elogSite, easy::BinaryLogArgs(__VA_ARGS__));                            \
+        }                                                                                             \
+        if (false)                                                                                    \
+        {                                                                                             \
+            easy::BinaryLog::CheckFormat(fmt, __VA_ARGS__);                                           \
+        }                                                                                             \
+    } while (0)
+
+#define ELOG_BIN_TRACE(obj, fmt, ...) ELOG_BIN_LEVEL(obj, easy::LogLevel::TRACE, fmt, __VA_ARGS__)
+#define ELOG_BIN_DEBUG(obj, fmt, ...) ELOG_BIN_LEVEL(obj, easy::LogLevel::DEBUG, fmt, __VA_ARGS__)
+#define ELOG_BIN_INFO(obj, fmt, ...) ELOG_BIN_LEVEL(obj, easy::LogLevel::INFO, fmt, __VA_ARGS__)
+#define ELOG_BIN_WARN(obj, fmt, ...) ELOG_BIN_LEVEL(obj, easy::LogLevel::WARN, fmt, __VA_ARGS__)
+#define ELOG_BIN_ERROR(obj, fmt, ...) ELOG_BIN_LEVEL(obj, easy::LogLevel::ERROR, fmt, __VA_ARGS__)
+#define ELOG_BIN_FATAL(obj, fmt, ...) ELOG_BIN_LEVEL(obj, easy::LogLevel::FATAL, fmt, __VA_ARGS__)
+
 #define ELOG_ROOT() easy::LoggerMgr::GetInstance()->getLogger("root")
 #define ELOG_NAME(name) easy::LoggerMgr::GetInstance()->getLogger(name)
 
@@ -73,14 +97,18 @@ class Logger : public std::enable_shared_from_this<Logger>
 
     explicit Logger(const std::string& name = "root");
 
-    void log(LogLevel level, std::shared_ptr<LogRecord> record);
+    void log(LogLevel level, const std::shared_ptr<LogRecord>& record);
+
+    // ELOG_BIN_*, the appenders in binary mode copy it as is, the others format it
+    void logBinary(const BinaryLogSite& site, const BinaryLogArgs& args);
+    void logBinary(const BinaryLogRecord& record);
 
-    void trace(std::shared_ptr<LogRecord> record);
-    void debug(std::shared_ptr<LogRecord> record);
-    void info(std::shared_ptr<LogRecord> record);
-    void warn(std::shared_ptr<LogRecord> record);
-    void error(std::shared_ptr<LogRecord> record);
-    void fatal(std::shared_ptr<LogRecord> record);
+    void trace(const std::shared_ptr<LogRecord>& record);
+    void debug(const std::shared_ptr<LogRecord>& record);
+    void info(const std::shared_ptr<LogRecord>& record);
+    void warn(const std::shared_ptr<LogRecord>& record);
+    void error(const std::shared_ptr<LogRecord>& record);
+    void fatal(const std::shared_ptr<LogRecord>& record);
 
     void addAppender(std::shared_ptr<LogAppender> sink);
     void deleteAppender(std::shared_ptr<LogAppender> sink);
@@ -91,6 +119,9 @@ class Logger : public std::enable_shared_from_this<Logger>
 
     const std::string& getName() const { return name_; }
 
+    // unique in the process, names the logger in a binary log
+    uint32_t getId() const { return id_; }
+
     void setFormatter(std::shared_ptr<LogFormatter> val);
     void setFormatter(const std::string& val);
 
@@ -102,6 +133,7 @@ class Logger : public std::enable_shared_from_this<Logger>
 
   private:
     std::string                             name_;   // 日志名称
+    uint32_t                                id_;     // 日志器编号
     LogLevel                                level_;  // 日志级别
     ReadWriteLock                           lock_;
     std::list<std::shared_ptr<LogAppender>> appenders_;  // appenders 集合
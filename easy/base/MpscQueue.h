@@ -0,0 +1,69 @@
+#ifndef __EASY_MPSC_QUEUE_H__
+#define __EASY_MPSC_QUEUE_H__
+
+#include "easy/base/noncopyable.h"
+
+#include <atomic>
+
+namespace easy
+{
+// intrusive unbounded multi producer single consumer queue, T has a std::atomic<T*> next_
+// push is one exchange, lock free and wait free, see Vyukov's intrusive MPSC node based queue
+template <typename T>
+class MpscQueue : noncopyable
+{
+  public:
+    MpscQueue() : head_(&stub_), tail_(&stub_) { stub_.next_.store(nullptr, std::memory_order_relaxed); }
+
+    // any thread
+    void push(T* item)
+    {
+        item->next_.store(nullptr, std::memory_order_relaxed);
+        T* prev = head_.exchange(item, std::memory_order_acq_rel);
+        prev->next_.store(item, std::memory_order_release);
+    }
+
+    // consumer only, FIFO, nullptr if empty or a push is halfway, the pusher is done right after
+    T* pop()
+    {
+        T* tail = tail_;
+        T* next = tail->next_.load(std::memory_order_acquire);
+        if (tail == &stub_)
+        {
+            if (!next)
+            {
+                return nullptr;
+            }
+            tail_ = next;
+            tail  = next;
+            next  = next->next_.load(std::memory_order_acquire);
+        }
+        if (next)
+        {
+            tail_ = next;
+            return tail;
+        }
+        if (tail != head_.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+        // tail is the last one, put the stub behind it so it can be taken
+        push(&stub_);
+        next = tail->next_.load(std::memory_order_acquire);
+        if (next)
+        {
+            tail_ = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+  private:
+    std::atomic<T*> head_;  // last pushed
+    T*              tail_;  // next to pop, consumer only
+    T               stub_;
+};
+
+}  // namespace easy
+
+#endif
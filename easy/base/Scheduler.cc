@@ -1,8 +1,10 @@
 #include "easy/base/Scheduler.h"
+#include "easy/base/Config.h"
 #include "easy/base/Fiber.h"
 #include "easy/base/Logger.h"
 #include "easy/base/Macro.h"
 #include "easy/base/Mutex.h"
+#include "easy/base/Timestamp.h"
 #include "easy/base/hook.h"
 
 #include <functional>
@@ -14,6 +16,170 @@ static Logger::ptr logger = ELOG_NAME("system");
 
 static thread_local Scheduler* t_scheduler       = nullptr;
 static thread_local Fiber*     t_scheduler_fiber = nullptr;
+static thread_local bool       t_inline_task     = false;
+
+static ConfigVar<uint32_t>::ptr scheduler_inline_warn_us =
+    Config::Lookup<uint32_t>("scheduler.inline_warn_us", 10000, "report inline tasks running longer than this, 0 to disable");
+
+static uint32_t s_inline_warn_us = 0;
+
+struct __SchedulerIniter
+{
+    __SchedulerIniter()
+    {
+        s_inline_warn_us = scheduler_inline_warn_us->value();
+        scheduler_inline_warn_us->addListener([](const uint32_t& old_val, const uint32_t& new_val) { s_inline_warn_us = new_val; });
+    }
+};
+
+static __SchedulerIniter s_scheduler_initer;
+
+// tasks are usually freed by another thread than the one that posted them, so a thread
+// cache over the limit hands a batch to a global list where posting threads refill from
+struct Scheduler::TaskCache : noncopyable
+{
+    static const size_t kMaxThreadCache = 256;
+    static const size_t kBatch          = 64;
+    static const size_t kMaxGlobalCache = 64 * 1024;
+
+    struct Global
+    {
+        MutexLock lock_;
+        Task*     head_{nullptr};
+        size_t    size_{0};
+    };
+
+    ~TaskCache()
+    {
+        t_dead = true;
+        give(size_);
+    }
+
+    // nullptr while the thread is exiting
+    static TaskCache* Get()
+    {
+        if (EASY_UNLIKELY(t_dead))
+        {
+            return nullptr;
+        }
+        static thread_local TaskCache t_cache;
+        return &t_cache;
+    }
+
+    static Global* GetGlobal()
+    {
+        // never destroyed, tasks may still be freed during static destruction
+        static Global* global = new Global;
+        return global;
+    }
+
+    // move up to n tasks from the global list
+    void take(size_t n)
+    {
+        Global* global = GetGlobal();
+        Task*   first  = nullptr;
+        Task*   last   = nullptr;
+        size_t  count  = 0;
+        {
+            MutexLockGuard _(global->lock_);
+            first = global->head_;
+            for (last = first; last && count + 1 < n && last->next_; last = last->next_)
+            {
+                ++count;
+            }
+            if (!last)
+            {
+                return;
+            }
+            ++count;
+            global->head_ = last->next_;
+            global->size_ -= count;
+        }
+        last->next_ = head_;
+        head_       = first;
+        size_ += count;
+    }
+
+    // move n tasks to the global list, delete what does not fit
+    void give(size_t n)
+    {
+        if (!n)
+        {
+            return;
+        }
+        Task* first = head_;
+        Task* last  = first;
+        for (size_t i = 1; i < n; ++i)
+        {
+            last = last->next_;
+        }
+        head_ = last->next_;
+        size_ -= n;
+        {
+            Global*        global = GetGlobal();
+            MutexLockGuard _(global->lock_);
+            if (global->size_ + n <= kMaxGlobalCache)
+            {
+                last->next_   = global->head_;
+                global->head_ = first;
+                global->size_ += n;
+                return;
+            }
+        }
+        last->next_ = nullptr;
+        while (first)
+        {
+            Task* next = first->next_;
+            delete first;
+            first = next;
+        }
+    }
+
+    static thread_local bool t_dead;
+
+    Task*  head_{nullptr};
+    size_t size_{0};
+};
+
+thread_local bool Scheduler::TaskCache::t_dead = false;
+
+Scheduler::Task* Scheduler::Task::Alloc()
+{
+    TaskCache* cache = TaskCache::Get();
+    if (cache)
+    {
+        if (!cache->head_)
+        {
+            cache->take(TaskCache::kBatch);
+        }
+        if (cache->head_)
+        {
+            Task* task   = cache->head_;
+            cache->head_ = task->next_;
+            --cache->size_;
+            task->next_ = nullptr;
+            return task;
+        }
+    }
+    return new Task;
+}
+
+void Scheduler::Task::Free(Task* task)
+{
+    task->reset();
+    TaskCache* cache = TaskCache::Get();
+    if (!cache)
+    {
+        delete task;
+        return;
+    }
+    task->next_  = cache->head_;
+    cache->head_ = task;
+    if (++cache->size_ > TaskCache::kMaxThreadCache)
+    {
+        cache->give(TaskCache::kBatch);
+    }
+}
 
 Scheduler::Scheduler(int threadNums, bool use_caller, const std::string& name) : name_(name)
 {
@@ -30,13 +196,15 @@ Scheduler::Scheduler(int threadNums, bool use_caller, const std::string& name) :
         t_scheduler = this;
 
         // stacksize > 0
-        callerFiber_.reset(NewFiber(std::bind(&Scheduler::run, this), 0, true), FreeFiber);
+        callerFiber_ = MakeFiber(std::bind(&Scheduler::run, this), 0, true);
 
         t_scheduler_fiber = callerFiber_.get();
 
         callerTid_ = Thread::GetCurrentThreadId();
 
         threadIds_.push_back(callerTid_);
+
+        workers_.emplace_back(new Worker(this, callerTid_));
     }
     else
     {
@@ -56,21 +224,66 @@ Scheduler::~Scheduler()
     {
         t_scheduler = nullptr;
     }
+    for (auto& w : workers_)
+    {
+        while (Task* task = w->queue_.pop())
+        {
+            Task::Free(task);
+        }
+        while (Task* task = w->inbox_.pop_front())
+        {
+            Task::Free(task);
+        }
+    }
+    while (Task* task = globalTasks_.pop_front())
+    {
+        Task::Free(task);
+    }
 }
 
 bool Scheduler::canStop()  // virtual
 {
-    ReadLockGuard _(lock_);
-    return !running_ && tasks_.empty() && activeThreadNums_.get() == 0;
+    // a parked fiber is requeued before it is uncounted, read it first
+    return !running_ && parkedFibers_.get() == 0 && pendingTasks_.get() == 0 && activeThreadNums_.get() == 0;
 }
 
-void Scheduler::weakup()  // virtual
+void Scheduler::weakup(int threadId)  // virtual
 {}
 
+bool Scheduler::hasWork()
+{
+    Worker* self = CurrentWorker();
+    if (globalSize_.get())
+    {
+        return true;
+    }
+    return self && self->scheduler_ == this && (self->inboxSize_.get() || !self->queue_.empty());
+}
+
+bool Scheduler::inWorkerThread()
+{
+    Worker* self = CurrentWorker();
+    return self && self->scheduler_ == this;
+}
+
 Scheduler* Scheduler::GetThis() { return t_scheduler; }
 
+bool Scheduler::InInlineTask() { return t_inline_task; }
+
 Fiber* Scheduler::GetSchedulerFiber() { return t_scheduler_fiber; }
 
+int Scheduler::CurrentThreadId()
+{
+    Worker* self = CurrentWorker();
+    return self ? self->threadId_ : -1;
+}
+
+Scheduler::Worker*& Scheduler::CurrentWorker()
+{
+    static thread_local Worker* t_worker = nullptr;
+    return t_worker;
+}
+
 void Scheduler::start()
 {
     WriteLockGuard _(lock_);
@@ -81,9 +294,27 @@ void Scheduler::start()
     running_ = true;
     EASY_ASSERT(threads_.empty());
     threads_.resize(threadNums_);
+
+    // all workers exist before any thread runs, thieves walk workers_ without lock
+    size_t first = workers_.size();
     for (size_t i = 0; i < threadNums_; i++)
     {
-        threads_[i] = std::make_shared<Thread>(std::bind(&Scheduler::run, this), name_ + "_" + std::to_string(i));
+        workers_.emplace_back(new Worker(this, -1));
+    }
+    for (size_t i = 0; i < threadNums_; i++)
+    {
+        Worker* worker = workers_[first + i].get();
+        threads_[i]    = std::make_shared<Thread>(
+            [this, worker]() {
+                CurrentWorker() = worker;
+                {
+                    // start() sets threadId_ after the thread is up, wait for it under lock_
+                    ReadLockGuard started(lock_);
+                }
+                run();
+            },
+            name_ + "_" + std::to_string(i));
+        worker->threadId_ = threads_[i]->id();
         threadIds_.push_back(threads_[i]->id());
     }
 }
@@ -154,28 +385,179 @@ void Scheduler::handleFiber(Fiber::ptr& fiber)
     }
 }
 
-Scheduler::Task::ptr Scheduler::take()
+Scheduler::Worker* Scheduler::findWorker(int threadId)
 {
-    WriteLockGuard _(lock_);
-    for (auto cur = tasks_.begin(); cur != tasks_.end(); ++cur)
+    ReadLockGuard _(lock_);
+    for (auto& w : workers_)
     {
-        auto task = *cur;
-        if (task->threadId_ != -1 && task->threadId_ != Thread::GetCurrentThreadId())
+        if (w->threadId_ == threadId)
         {
-            // designate thread
-            continue;
+            return w.get();
         }
-        EASY_ASSERT(task->fiber_ || task->cb_);
-        if (task->fiber_ && task->fiber_->state() == Fiber::EXEC)
+    }
+    return nullptr;
+}
+
+bool Scheduler::pushGlobal(Task* task)
+{
+    MutexLockGuard _(globalLock_);
+    globalTasks_.push_back(task);
+    return globalSize_.fetchAndAdd(1) == 0;
+}
+
+bool Scheduler::push(Task* task)
+{
+    pendingTasks_.increment();
+
+    Worker* self = CurrentWorker();
+    if (self && self->scheduler_ != this)
+    {
+        self = nullptr;  // worker of another scheduler
+    }
+
+    if (task->threadId_ != -1)
+    {
+        // pinned task, never in a deque where it could be stolen
+        Worker* owner = (self && self->threadId_ == task->threadId_) ? self : findWorker(task->threadId_);
+        if (!owner)
+        {
+            return pushGlobal(task);  // owner not started yet, forwarded by take()
+        }
+        SpinLockGuard _(owner->inboxLock_);
+        owner->inbox_.push_back(task);
+        return owner->inboxSize_.fetchAndAdd(1) == 0;
+    }
+
+    if (self)
+    {
+        bool was_empty = self->queue_.empty();
+        if (self->queue_.push(task))
+        {
+            return was_empty;
+        }
+    }
+    return pushGlobal(task);
+}
+
+Scheduler::Task* Scheduler::steal(Worker* self)
+{
+    static thread_local uint32_t t_seed = 0;
+
+    size_t n = workers_.size();
+    if (n <= 1)
+    {
+        return nullptr;
+    }
+    if (EASY_UNLIKELY(!t_seed))
+    {
+        t_seed = static_cast<uint32_t>(Thread::GetCurrentThreadId()) | 1;
+    }
+    // xorshift32, random victim
+    t_seed ^= t_seed << 13;
+    t_seed ^= t_seed >> 17;
+    t_seed ^= t_seed << 5;
+
+    size_t start = t_seed % n;
+    for (size_t i = 0; i < n; ++i)
+    {
+        Worker* victim = workers_[(start + i) % n].get();
+        if (victim == self)
         {
             continue;
         }
-        tasks_.erase(cur);
-        return task;
+        Task* task = victim->queue_.steal();
+        if (task)
+        {
+            return task;
+        }
     }
     return nullptr;
 }
 
+Scheduler::Task* Scheduler::take()
+{
+    Worker* self = CurrentWorker();
+    EASY_ASSERT(self && self->scheduler_ == this);
+
+    Task* task = nullptr;
+    if (self->inboxSize_.get())
+    {
+        SpinLockGuard _(self->inboxLock_);
+        task = self->inbox_.pop_front();
+        if (task)
+        {
+            self->inboxSize_.decrement();
+        }
+    }
+    if (!task)
+    {
+        task = self->queue_.pop();
+    }
+    while (!task && globalSize_.get())
+    {
+        {
+            MutexLockGuard _(globalLock_);
+            task = globalTasks_.pop_front();
+            if (!task)
+            {
+                break;
+            }
+            globalSize_.decrement();
+        }
+        if (task->threadId_ != -1 && task->threadId_ != self->threadId_)
+        {
+            // pinned to another thread, hand it over
+            pendingTasks_.decrement();
+            push(task);
+            task = nullptr;
+            break;
+        }
+    }
+    if (!task)
+    {
+        task = steal(self);
+    }
+    if (task)
+    {
+        pendingTasks_.decrement();
+    }
+    return task;
+}
+
+void Scheduler::runInline(Task* task)
+{
+    EASY_ASSERT_MESSAGE(task->cb_ && !task->fiber_, "only callbacks can run inline");
+    // a blocking call must not park the scheduler fiber, with hooks off it blocks the thread instead
+    bool hook_enable = IsHookEnable();
+    SetHookEnable(false);
+    t_inline_task = true;
+
+    Timestamp start = s_inline_warn_us ? Timestamp::now(Timestamp::MONOTONIC) : Timestamp();
+    try
+    {
+        task->cb_();
+    }
+    catch (std::exception& ex)
+    {
+        ELOG_ERROR(logger) << "inline task except: " << ex.what() << std::endl << easy::BacktraceToString();
+    }
+    catch (...)
+    {
+        ELOG_ERROR(logger) << "inline task except" << std::endl << easy::BacktraceToString();
+    }
+    if (s_inline_warn_us)
+    {
+        int64_t elapsed = Timestamp::now(Timestamp::MONOTONIC).microSecondsSinceEpoch() - start.microSecondsSinceEpoch();
+        if (EASY_UNLIKELY(elapsed > static_cast<int64_t>(s_inline_warn_us)))
+        {
+            ELOG_WARN(logger) << "inline task blocked the scheduler for " << elapsed << "us, schedule it as a fiber instead";
+        }
+    }
+
+    t_inline_task = false;
+    SetHookEnable(hook_enable);
+}
+
 void Scheduler::run()
 {
     SetHookEnable(true);  // enable hook
@@ -186,16 +568,16 @@ void Scheduler::run()
         // thread in pool should create a main fiber as scheduler fiber
         t_scheduler_fiber = Fiber::GetThis().get();
     }
+    else
+    {
+        CurrentWorker() = findWorker(callerTid_);
+    }
 
-    Fiber::ptr idle(NewFiber(std::bind(&Scheduler::idle, this)), FreeFiber);
+    Fiber::ptr idle = MakeFiber(std::bind(&Scheduler::idle, this));
 
-    while (true)
+    while (!idle->finish())
     {
-        auto task = take();
-        if (idle->finish())
-        {
-            break;
-        }
+        Task* task = take();
         if (!task)
         {
             idleThreadNums_.increment();
@@ -203,20 +585,39 @@ void Scheduler::run()
             idleThreadNums_.decrement();
             continue;
         }
+        if (pendingTasks_.get() > 0 && hasIdleThread())
+        {
+            // more work than busy threads, wake one more, it does the same
+            weakup();
+        }
+        if (task->fiber_ && task->fiber_->state() == Fiber::EXEC)
+        {
+            // still running on another thread, it has not yielded yet
+            pendingTasks_.increment();
+            pushGlobal(task);
+            continue;
+        }
+        if (task->inline_)
+        {
+            activeThreadNums_.increment();
+            runInline(task);
+            activeThreadNums_.decrement();
+            Task::Free(task);
+            continue;
+        }
         if (task->cb_)
         {
             EASY_ASSERT(!task->fiber_);
-            Fiber::ptr fiber(NewFiber(task->cb_), FreeFiber);
-            task->fiber_ = std::move(fiber);
-            task->cb_    = nullptr;
+            task->fiber_ = MakeFiber(std::move(task->cb_));
         }
         if (task->fiber_ && !task->fiber_->finish())
         {
             activeThreadNums_.increment();
             handleFiber(task->fiber_);
             activeThreadNums_.decrement();
-            task->fiber_ = nullptr;
         }
+        Task::Free(task);
     }
+    CurrentWorker() = nullptr;
 }
 }  // namespace easy
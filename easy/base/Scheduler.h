@@ -2,13 +2,14 @@
 #define __EASY_SCHEDULER_H__
 
 #include "easy/base/Atomic.h"
+#include "easy/base/Callback.h"
 #include "easy/base/Fiber.h"
 #include "easy/base/Mutex.h"
 #include "easy/base/Thread.h"
+#include "easy/base/WorkStealingQueue.h"
 #include "easy/base/noncopyable.h"
 
 #include <functional>
-#include <list>
 #include <memory>
 #include <string>
 #include <vector>
@@ -19,6 +20,7 @@ namespace easy
 class Scheduler : noncopyable
 {
     friend class Fiber;
+    friend struct FiberWaiter;
 
   public:
     Scheduler(int threadNums = 1, bool use_caller = true, const std::string& name = "");
@@ -40,90 +42,192 @@ class Scheduler : noncopyable
     template <typename T>
     void schedule(T co, int threadId = -1)
     {
-        bool should_weakup = false;
+        if (scheduleNonBlock(std::move(co), threadId))
         {
-            WriteLockGuard _(lock_);
-            should_weakup = scheduleNonBlock(co, threadId);
+            weakup(threadId);
         }
-        if (should_weakup)
+    }
+
+    // the tasks are moved out of the range, one wakeup for the whole batch
+    template <typename TaskIterator>
+    void schedule(TaskIterator begin, TaskIterator end, int threadId = -1)
+    {
+        bool need_weakup = false;
+        while (begin != end)
+        {
+            need_weakup = scheduleNonBlock(std::move(*begin), threadId) || need_weakup;
+            ++begin;
+        }
+        if (need_weakup)
+        {
+            weakup(threadId);
+        }
+    }
+
+    // run cb directly on the scheduler fiber, no Fiber is created for it
+    // cb must not block: hooks are off inside it, a yield asserts and a long run is reported
+    template <typename T>
+    void scheduleInline(T cb, int threadId = -1)
+    {
+        if (scheduleNonBlock(std::move(cb), threadId, true))
         {
-            weakup();
+            weakup(threadId);
         }
     }
 
     template <typename TaskIterator>
-    void schedule(TaskIterator begin, TaskIterator end)
+    void scheduleInline(TaskIterator begin, TaskIterator end, int threadId = -1)
     {
         bool need_weakup = false;
+        while (begin != end)
         {
-            WriteLockGuard _(lock_);
-            while (begin != end)
-            {
-                need_weakup = scheduleNonBlock(*begin) || need_weakup;
-                ++begin;
-            }
+            need_weakup = scheduleNonBlock(std::move(*begin), threadId, true) || need_weakup;
+            ++begin;
         }
         if (need_weakup)
         {
-            weakup();
+            weakup(threadId);
         }
     }
 
+    // true while an inline task runs on this thread
+    static bool InInlineTask();
+
     static Scheduler* GetThis();
 
     static Fiber* GetSchedulerFiber();
 
-  private:
-    virtual void weakup();
+    // the id a task is pinned to the calling worker thread with, -1 outside a scheduler
+    static int CurrentThreadId();
+
+  protected:
+    // threadId: the task is pinned to this thread, -1 for any thread
+    virtual void weakup(int threadId = -1);
+
+    // a task is queued where the current thread takes from first, inbox, own deque or global queue
+    bool hasWork();
+
+    // the calling thread runs this scheduler, it goes idle when it runs out of tasks
+    bool inWorkerThread();
 
+  private:
     void handleFiber(Fiber::ptr& fiber);
 
     virtual void idle();
 
     template <typename T>
-    bool scheduleNonBlock(T&& fiber, long thread_id = -1)
+    bool scheduleNonBlock(T&& fiber, int thread_id = -1, bool inline_task = false)
     {
-        bool should_weakup = tasks_.empty();
-        auto task          = std::make_shared<Task>(std::forward<T>(fiber), thread_id);
-        if (task->fiber_ || task->cb_)
+        Task* task = Task::Alloc();
+        task->set(std::forward<T>(fiber));
+        if (!task->fiber_ && !task->cb_)
         {
-            tasks_.push_back(std::move(task));
+            Task::Free(task);
+            return false;
         }
-        return should_weakup;
+        task->threadId_ = thread_id;
+        task->inline_   = inline_task;
+        return push(task);
     }
 
   private:
-    struct Task
+    // intrusive, recycled through a per thread free list, posting a small callable does not allocate
+    struct Task : noncopyable
     {
-        typedef std::shared_ptr<Task> ptr;
-        Task() {}
-
-        Task(const Task& rhs) = default;
-
-        Task(Fiber::ptr fiber, int threadId) : fiber_(fiber), threadId_(threadId) {}
-
-        Task(const std::function<void()>& cb, int threadId) : cb_(cb), threadId_(threadId) {}
+        void set(Fiber::ptr fiber) { fiber_ = std::move(fiber); }
 
-        Task(const std::function<void()>&& cb,
-            int                            threadId) noexcept  // noexcept for std::move
-            : cb_(std::move(cb)), threadId_(threadId)
-        {}
-
-        Task& operator=(const Task& other) = default;
+        template <typename F>
+        void set(F&& cb)
+        {
+            cb_ = Callback(std::forward<F>(cb));
+        }
 
         void reset()
         {
+            next_     = nullptr;
             fiber_    = nullptr;
             cb_       = nullptr;
             threadId_ = -1;
+            inline_   = false;
         }
 
-        Fiber::ptr            fiber_;
-        std::function<void()> cb_;
-        int                   threadId_{-1};  // -1 could be scheduled by any thread
+        static Task* Alloc();
+
+        static void Free(Task* task);
+
+        Task*      next_{nullptr};  // free list or TaskList link
+        Fiber::ptr fiber_;
+        Callback   cb_;
+        int        threadId_{-1};  // -1 could be scheduled by any thread
+        bool       inline_{false};  // cb_ runs on the scheduler fiber
+    };
+
+    struct TaskCache;
+
+    // intrusive FIFO, no allocation on push
+    struct TaskList
+    {
+        bool empty() const { return !head_; }
+
+        void push_back(Task* task)
+        {
+            task->next_ = nullptr;
+            if (tail_)
+            {
+                tail_->next_ = task;
+            }
+            else
+            {
+                head_ = task;
+            }
+            tail_ = task;
+        }
+
+        Task* pop_front()
+        {
+            Task* task = head_;
+            if (task)
+            {
+                head_ = task->next_;
+                if (!head_)
+                {
+                    tail_ = nullptr;
+                }
+                task->next_ = nullptr;
+            }
+            return task;
+        }
+
+        Task* head_{nullptr};
+        Task* tail_{nullptr};
+    };
+
+    // per thread run queue, pinned tasks go to the inbox since the deque can be stolen from
+    struct Worker : noncopyable
+    {
+        Worker(Scheduler* scheduler, int threadId) : scheduler_(scheduler), threadId_(threadId) {}
+
+        Scheduler*              scheduler_;
+        int                     threadId_;
+        WorkStealingQueue<Task> queue_;
+        SpinLock                inboxLock_;
+        TaskList                inbox_;
+        AtomicInt<size_t>       inboxSize_{0};
     };
 
-    Scheduler::Task::ptr take();
+    static Worker*& CurrentWorker();
+
+    bool push(Task* task);
+
+    bool pushGlobal(Task* task);
+
+    Worker* findWorker(int threadId);
+
+    Task* take();
+
+    Task* steal(Worker* self);
+
+    void runInline(Task* task);
 
   private:
     std::string      name_;                 // 调度器名
@@ -135,10 +239,15 @@ class Scheduler : noncopyable
     bool             running_{false};       // 执行状态
 
   private:
-    ReadWriteLock            lock_;
-    std::vector<Thread::ptr> threads_;      // 线程对象列表
-    std::list<Task::ptr>     tasks_;        // 任务集合
-    Fiber::ptr               callerFiber_;  // use_caller only
+    ReadWriteLock                        lock_;              // protect workers_
+    std::vector<Thread::ptr>             threads_;           // 线程对象列表
+    std::vector<std::unique_ptr<Worker>> workers_;           // 每个线程的任务队列
+    MutexLock                            globalLock_;        // protect globalTasks_
+    TaskList                             globalTasks_;       // 非调度线程提交的任务
+    AtomicInt<size_t>                    globalSize_{0};     // globalTasks_.size()
+    AtomicInt<int64_t>                   pendingTasks_{0};   // 所有队列中的任务数
+    AtomicInt<int64_t>                   parkedFibers_{0};   // FiberMutex 等上挂起的协程数
+    Fiber::ptr                           callerFiber_;       // use_caller only
 };
 
 }  // namespace easy
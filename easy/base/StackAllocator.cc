@@ -0,0 +1,327 @@
+#include "easy/base/StackAllocator.h"
+#include "easy/base/Atomic.h"
+#include "easy/base/Config.h"
+#include "easy/base/Macro.h"
+#include "easy/base/Mutex.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <vector>
+
+namespace easy
+{
+static ConfigVar<uint32_t>::ptr stack_pool_thread_cache =
+    Config::Lookup<uint32_t>("fiber.stack_pool.thread_cache", 64, "max cached stacks per thread and size class");
+
+static ConfigVar<uint32_t>::ptr stack_pool_global_cache =
+    Config::Lookup<uint32_t>("fiber.stack_pool.global_cache", 1024, "max cached stacks in the global pool per size class");
+
+static ConfigVar<bool>::ptr stack_pool_lazy_commit = Config::Lookup<bool>("fiber.stack_pool.lazy_commit",
+    false,
+    "map stacks with MAP_NORESERVE and a guard page, return touched pages on recycle, fixed at the first allocation");
+
+static uint32_t s_thread_cache = 0;
+static uint32_t s_global_cache = 0;
+
+struct __StackPoolIniter
+{
+    __StackPoolIniter()
+    {
+        s_thread_cache = stack_pool_thread_cache->value();
+        s_global_cache = stack_pool_global_cache->value();
+        stack_pool_thread_cache->addListener([](const uint32_t& old_val, const uint32_t& new_val) { s_thread_cache = new_val; });
+        stack_pool_global_cache->addListener([](const uint32_t& old_val, const uint32_t& new_val) { s_global_cache = new_val; });
+    }
+};
+
+static __StackPoolIniter s_stack_pool_initer;
+
+static AtomicInt<uint64_t> s_thread_hits{0};
+static AtomicInt<uint64_t> s_global_hits{0};
+static AtomicInt<uint64_t> s_misses{0};
+static AtomicInt<uint64_t> s_releases{0};
+static AtomicInt<uint64_t> s_max_high_water{0};
+
+static size_t PageSize()
+{
+    static const size_t kPageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return kPageSize;
+}
+
+void* MallocStackAllocator::Alloc(size_t size) { return malloc(size); }
+
+void MallocStackAllocator::Dealloc(void* vp, size_t size) { free(vp); }
+
+bool MMapStackAllocator::IsLazyCommit()
+{
+    static const bool s_lazy_commit = stack_pool_lazy_commit->value();
+    return s_lazy_commit;
+}
+
+void* MMapStackAllocator::Alloc(size_t size)
+{
+    if (!IsLazyCommit())
+    {
+        void* vp = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        EASY_ASSERT_MESSAGE(vp != MAP_FAILED, "mmap stack size=" << size << " errno=" << errno);
+        return vp;
+    }
+    // guard page at the low end, the stack grows down into it on overflow
+    size_t page = PageSize();
+    char*  vp   = static_cast<char*>(mmap(NULL, size + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0));
+    EASY_ASSERT_MESSAGE(vp != MAP_FAILED, "mmap stack size=" << size << " errno=" << errno);
+    EASY_CHECK(mprotect(vp, page, PROT_NONE));
+    return vp + page;
+}
+
+void MMapStackAllocator::Dealloc(void* vp, size_t size)
+{
+    if (!IsLazyCommit())
+    {
+        EASY_CHECK(munmap(vp, size));
+        return;
+    }
+    size_t page = PageSize();
+    EASY_CHECK(munmap(static_cast<char*>(vp) - page, size + page));
+}
+
+void MMapStackAllocator::Recycle(void* vp, size_t size)
+{
+    // the top page is touched again right away by the next owner
+    size_t page = PageSize();
+    if (size > page)
+    {
+        EASY_CHECK(madvise(vp, size - page, MADV_DONTNEED));
+    }
+}
+
+using StackAllocator = MMapStackAllocator;
+
+struct StackFreeList
+{
+    size_t             size;
+    std::vector<void*> stacks;
+};
+
+static StackFreeList* FindFreeList(std::vector<StackFreeList>& lists, size_t size)
+{
+    for (auto& i : lists)
+    {
+        if (i.size == size)
+        {
+            return &i;
+        }
+    }
+    lists.push_back(StackFreeList{size, {}});
+    return &lists.back();
+}
+
+class GlobalStackPool : noncopyable
+{
+  public:
+    // move up to n stacks into out, returns the number moved
+    size_t take(size_t size, std::vector<void*>& out, size_t n)
+    {
+        MutexLockGuard _(lock_);
+        StackFreeList* list  = FindFreeList(lists_, size);
+        size_t         count = 0;
+        while (count < n && !list->stacks.empty())
+        {
+            out.push_back(list->stacks.back());
+            list->stacks.pop_back();
+            ++count;
+        }
+        return count;
+    }
+
+    // keep up to n stacks popped from the back of in, release what does not fit
+    void give(size_t size, std::vector<void*>& in, size_t n)
+    {
+        size_t nrelease = 0;
+        {
+            MutexLockGuard _(lock_);
+            StackFreeList* list = FindFreeList(lists_, size);
+            while (n > 0 && list->stacks.size() < s_global_cache)
+            {
+                list->stacks.push_back(in.back());
+                in.pop_back();
+                --n;
+            }
+        }
+        while (nrelease < n)
+        {
+            StackAllocator::Dealloc(in.back(), size);
+            in.pop_back();
+            ++nrelease;
+        }
+        s_releases.add(nrelease);
+    }
+
+  private:
+    MutexLock                  lock_;
+    std::vector<StackFreeList> lists_;
+};
+
+static GlobalStackPool* GetGlobalPool()
+{
+    // never destroyed, fibers may still be freed during static destruction
+    static GlobalStackPool* pool = new GlobalStackPool;
+    return pool;
+}
+
+class ThreadStackCache : noncopyable
+{
+  public:
+    ThreadStackCache();
+
+    ~ThreadStackCache();
+
+    StackFreeList* get(size_t size) { return FindFreeList(lists_, size); }
+
+  private:
+    std::vector<StackFreeList> lists_;
+};
+
+enum CacheState
+{
+    CACHE_NONE,
+    CACHE_ALIVE,
+    CACHE_DEAD,
+};
+
+static thread_local CacheState       t_cache_state = CACHE_NONE;
+static thread_local ThreadStackCache t_cache;
+
+ThreadStackCache::ThreadStackCache() { t_cache_state = CACHE_ALIVE; }
+
+ThreadStackCache::~ThreadStackCache()
+{
+    t_cache_state = CACHE_DEAD;
+    for (auto& i : lists_)
+    {
+        GetGlobalPool()->give(i.size, i.stacks, i.stacks.size());
+    }
+}
+
+static StackFreeList* GetThreadFreeList(size_t size)
+{
+    if (EASY_UNLIKELY(t_cache_state == CACHE_DEAD))
+    {
+        return nullptr;  // thread is exiting
+    }
+    return t_cache.get(size);
+}
+
+size_t StackPool::RoundUp(size_t size)
+{
+    size_t page = PageSize();
+    return (size + page - 1) & ~(page - 1);
+}
+
+void* StackPool::Alloc(size_t size)
+{
+    StackFreeList* list = GetThreadFreeList(size);
+    if (list)
+    {
+        if (list->stacks.empty())
+        {
+            size_t batch = s_thread_cache / 2;
+            GetGlobalPool()->take(size, list->stacks, batch ? batch : 1);
+            if (!list->stacks.empty())
+            {
+                s_global_hits.increment();
+                void* vp = list->stacks.back();
+                list->stacks.pop_back();
+                return vp;
+            }
+        }
+        else
+        {
+            s_thread_hits.increment();
+            void* vp = list->stacks.back();
+            list->stacks.pop_back();
+            return vp;
+        }
+    }
+    else
+    {
+        std::vector<void*> out;
+        if (GetGlobalPool()->take(size, out, 1))
+        {
+            s_global_hits.increment();
+            return out.back();
+        }
+    }
+    s_misses.increment();
+    return StackAllocator::Alloc(size);
+}
+
+void StackPool::Dealloc(void* vp, size_t size)
+{
+    if (StackAllocator::IsLazyCommit())
+    {
+        uint64_t used = HighWater(vp, size);
+        uint64_t max  = s_max_high_water.get();
+        while (used > max && !s_max_high_water.compareAndSet(max, used))
+        {
+            max = s_max_high_water.get();
+        }
+        StackAllocator::Recycle(vp, size);
+    }
+
+    StackFreeList* list = GetThreadFreeList(size);
+    if (list && list->stacks.size() < s_thread_cache)
+    {
+        list->stacks.push_back(vp);
+        return;
+    }
+    if (list)
+    {
+        // thread cache is full, hand half of it over to the global pool
+        list->stacks.push_back(vp);
+        GetGlobalPool()->give(size, list->stacks, (list->stacks.size() + 1) / 2);
+    }
+    else
+    {
+        std::vector<void*> in(1, vp);
+        GetGlobalPool()->give(size, in, 1);
+    }
+}
+
+StackPool::Stats StackPool::GetStats()
+{
+    Stats stats;
+    stats.threadHits   = s_thread_hits.get();
+    stats.globalHits   = s_global_hits.get();
+    stats.misses       = s_misses.get();
+    stats.releases     = s_releases.get();
+    stats.maxHighWater = s_max_high_water.get();
+    return stats;
+}
+
+size_t StackPool::HighWater(void* stack, size_t size)
+{
+    size_t    page   = PageSize();
+    uintptr_t begin  = reinterpret_cast<uintptr_t>(stack) & ~(page - 1);
+    uintptr_t end    = reinterpret_cast<uintptr_t>(stack) + size;
+    size_t    npages = (end - begin + page - 1) / page;
+
+    std::vector<unsigned char> resident(npages);
+    if (mincore(reinterpret_cast<void*>(begin), npages * page, &resident[0]))
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < npages; ++i)
+    {
+        if (resident[i] & 1)
+        {
+            uintptr_t low = begin + i * page;
+            return low < reinterpret_cast<uintptr_t>(stack) ? size : static_cast<size_t>(end - low);
+        }
+    }
+    return 0;
+}
+
+}  // namespace easy
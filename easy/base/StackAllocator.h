@@ -0,0 +1,62 @@
+#ifndef __EASY_STACK_ALLOCATOR_H__
+#define __EASY_STACK_ALLOCATOR_H__
+
+#include <cstddef>
+#include <cstdint>
+
+namespace easy
+{
+class MallocStackAllocator
+{
+  public:
+    static void* Alloc(size_t size);
+
+    static void Dealloc(void* vp, size_t size);
+};
+
+// lazy commit mode (fiber.stack_pool.lazy_commit): stacks are mapped with MAP_NORESERVE
+// below a PROT_NONE guard page, and touched pages are handed back on recycle
+class MMapStackAllocator
+{
+  public:
+    static void* Alloc(size_t size);
+
+    static void Dealloc(void* vp, size_t size);
+
+    // drop the physical pages of a stack that goes back to the pool
+    static void Recycle(void* vp, size_t size);
+
+    static bool IsLazyCommit();
+};
+
+// recycles fiber stacks of the same size class, a per-thread cache backed by a global overflow pool
+class StackPool
+{
+  public:
+    struct Stats
+    {
+        uint64_t threadHits   = 0;  // served from the per-thread cache
+        uint64_t globalHits   = 0;  // served from the global pool
+        uint64_t misses       = 0;  // fresh allocation
+        uint64_t releases     = 0;  // returned to the system, both caches full
+        uint64_t maxHighWater = 0;  // deepest stack use seen on recycle, lazy commit only
+    };
+
+    // size class of a stack, rounded up to page size
+    static size_t RoundUp(size_t size);
+
+    // size must be a size class
+    static void* Alloc(size_t size);
+
+    static void Dealloc(void* vp, size_t size);
+
+    static Stats GetStats();
+
+    // bytes touched from the top of [stack, stack + size), page granularity
+    // exact for lazily committed stacks, otherwise a recycled stack also shows earlier owners
+    static size_t HighWater(void* stack, size_t size);
+};
+
+}  // namespace easy
+
+#endif
@@ -2,23 +2,100 @@
 #include "easy/base/Config.h"
 #include "easy/base/Logger.h"
 #include "easy/base/Macro.h"
+#include "easy/base/MpscQueue.h"
 #include "easy/base/Mutex.h"
+#include "easy/base/TimerWheel.h"
 #include "easy/base/Timestamp.h"
 
+#include <sched.h>
 #include <sys/timerfd.h>
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <ctime>
 #include <functional>
 #include <iostream>
 #include <iterator>
 #include <memory>
+#include <sstream>
 #include <vector>
 
 namespace easy
 {
 auto logger = ELOG_NAME("system");
 
+static ConfigVar<std::string>::ptr timer_clock = Config::Lookup<std::string>("timer.clock",
+    "monotonic",
+    "clock of timer deadlines, monotonic: CLOCK_MONOTONIC, coarse: CLOCK_MONOTONIC_COARSE, a kernel tick late, "
+    "loop: monotonic time read once per IOManager wait, see Timestamp::Clock");
+
+static ConfigVar<std::string>::ptr timer_queue =
+    Config::Lookup<std::string>("timer.queue", "set", "set: ordered std::set, wheel: hierarchical timing wheel with O(1) add and cancel, 1ms ticks");
+
+static ConfigVar<bool>::ptr timer_stats = Config::Lookup<bool>(
+    "timer.stats", true, "TimerManager::timerStats lateness of every fire and run time of one callback in 16");
+
+// counters of the threads that share a slot, relaxed atomics, read by TimerManager::timerStats
+struct TimerShard : noncopyable
+{
+    int64_t                 outstanding{0};
+    uint64_t                added{0};
+    uint64_t                fired{0};
+    uint64_t                cancelled{0};
+    TimerManager::Histogram lateness;
+    TimerManager::Histogram callback;
+    char                    pad_[64];  // the next shard is on another cache line
+};
+
+static const int       kTimerShards = 16;
+static AtomicInt<int>   s_shard_seq{0};
+static thread_local int t_shard = -1;  // threads past kTimerShards share
+
+template <typename T>
+static void RelaxedAdd(T& counter, T delta)
+{
+    __atomic_fetch_add(&counter, delta, __ATOMIC_RELAXED);
+}
+
+template <typename T>
+static T RelaxedGet(const T& counter)
+{
+    return __atomic_load_n(&counter, __ATOMIC_RELAXED);
+}
+
+static void Record(TimerManager::Histogram& histogram, int64_t us)
+{
+    uint64_t value  = us > 0 ? static_cast<uint64_t>(us) : 0;
+    int      bucket = value ? 64 - __builtin_clzll(value) : 0;
+    if (bucket >= TimerManager::Histogram::kBuckets)
+    {
+        bucket = TimerManager::Histogram::kBuckets - 1;
+    }
+    RelaxedAdd(histogram.count, static_cast<uint64_t>(1));
+    RelaxedAdd(histogram.sum, value);
+    RelaxedAdd(histogram.buckets[bucket], static_cast<uint64_t>(1));
+    uint64_t max = RelaxedGet(histogram.max);
+    while (value > max && !__atomic_compare_exchange_n(&histogram.max, &max, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+// one callback in kCallbackSample is timed, the wrapper allocates and costs two clock reads
+static const uint64_t        kCallbackSample = 16;
+static thread_local uint64_t t_fires         = 0;
+
+static bool Sampled() { return t_fires++ % kCallbackSample == 0; }
+
+static void Merge(TimerManager::Histogram& to, const TimerManager::Histogram& from)
+{
+    to.count += RelaxedGet(from.count);
+    to.sum += RelaxedGet(from.sum);
+    to.max = std::max(to.max, RelaxedGet(from.max));
+    for (int i = 0; i < TimerManager::Histogram::kBuckets; ++i)
+    {
+        to.buckets[i] += RelaxedGet(from.buckets[i]);
+    }
+}
+
 bool Timer::Comparator::operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) const
 {
     if (!lhs && !rhs)
@@ -44,22 +121,39 @@ bool Timer::Comparator::operator()(const Timer::ptr& lhs, const Timer::ptr& rhs)
     return lhs.get() < rhs.get();
 }
 
-Timer::Timer(int64_t interval, std::function<void()> cb, bool repeat, TimerManager* manager)
-    : repeat_(repeat), interval_(interval), cb_(cb), manager_(manager)
+Timer::Timer(int64_t interval, std::function<void()> cb, bool repeat, bool nonblocking, TimerManager* manager, int64_t slack)
+    : repeat_(repeat), nonblocking_(nonblocking), interval_(interval), slack_(slack), cb_(cb), manager_(manager)
+{
+    expiration_ = deadline(manager_->now());
+}
+
+Timestamp Timer::deadline(Timestamp start) const
 {
-    expiration_ = addTime(Timestamp::now(), interval);
+    Timestamp expiration = addTime(start, interval_);
+    if (slack_ <= 0)
+    {
+        return expiration;
+    }
+    // on the monotonic clock every timer rounds to the same grid
+    int64_t grid = slack_ * 1000;
+    int64_t us   = expiration.microSecondsSinceEpoch();
+    return Timestamp((us + grid - 1) / grid * grid);
 }
 
 Timer::Timer(Timestamp time) : expiration_(time) {}
 
 bool Timer::cancel()
 {
+    if (local_)
+    {
+        return manager_->cancelLocal(shared_from_this());
+    }
     WriteLockGuard _(manager_->lock_);
     if (cb_)
     {
-        cb_     = nullptr;
-        auto it = manager_->timers_.find(shared_from_this());
-        manager_->timers_.erase(it);
+        cb_ = nullptr;
+        manager_->queue_.erase(shared_from_this());
+        manager_->onCancelled();
         return true;
     }
     return false;
@@ -67,24 +161,31 @@ bool Timer::cancel()
 
 bool Timer::refresh()
 {
+    if (local_)
+    {
+        return manager_->resetLocal(shared_from_this(), -1, true);
+    }
     WriteLockGuard _(manager_->lock_);
     if (!cb_)
     {
         return false;
     }
-    auto it = manager_->timers_.find(shared_from_this());
-    if (it == manager_->timers_.end())
+    if (!manager_->queue_.erase(shared_from_this()))
     {
         return false;
     }
-    manager_->timers_.erase(it);  // ensure modification outside std::set
-    expiration_ = addTime(Timestamp::now(), interval_);
-    manager_->timers_.insert(shared_from_this());
+    // ensure modification outside std::set
+    expiration_ = deadline(manager_->now());
+    manager_->queue_.insert(shared_from_this());
     return true;
 }
 
 bool Timer::reset(int64_t interval, bool from_now)
 {
+    if (local_)
+    {
+        return manager_->resetLocal(shared_from_this(), interval, from_now);
+    }
     if (interval == interval_ && !from_now)
     {
         return true;
@@ -94,26 +195,215 @@ bool Timer::reset(int64_t interval, bool from_now)
     {
         return false;
     }
-    auto it = manager_->timers_.find(shared_from_this());
-    if (it == manager_->timers_.end())
+    if (!manager_->queue_.erase(shared_from_this()))
     {
         return false;
     }
-    manager_->timers_.erase(it);
-    Timestamp start = from_now ? Timestamp::now() : addTime(expiration_, -interval_);
+    Timestamp start = from_now ? manager_->now() : addTime(expiration_, -interval_);
     interval_       = interval;
-    expiration_     = addTime(start, interval_);
+    expiration_     = deadline(start);
     manager_->addTimer(shared_from_this());
     return true;
 }
 
-TimerManager::TimerManager() : timerfd_(createTimerfd()), previous_(Timestamp::now()) {}
+TimerQueue::TimerQueue(Timestamp now) : wheel_(new TimerWheel(TimerWheel::Tick(now)))
+{
+    wheelOnly_ = timer_queue->value() == "wheel";
+}
+
+TimerQueue::~TimerQueue() {}
 
-TimerManager::~TimerManager() { close(timerfd_); }
+bool TimerQueue::insert(const Timer::ptr& timer)
+{
+    Timestamp next = nextExpiration();
+    if (wheelOnly_ || timer->embedded_)
+    {
+        wheel_->insert(timer);
+        return !next.valid() || TimerWheel::Tick(timer->expiration_) < TimerWheel::Tick(next);
+    }
+    timers_.insert(timer);
+    return !next.valid() || timer->expiration_ < next;
+}
 
-Timer::ptr TimerManager::addTimer(uint64_t interval, std::function<void()> cb, bool repeat)
+bool TimerQueue::erase(const Timer::ptr& timer)
 {
-    Timer::ptr     timer = easy::protected_make_shared<Timer>(interval, cb, repeat, this);
+    if (wheelOnly_ || timer->embedded_)
+    {
+        return wheel_->erase(timer.get());
+    }
+    auto it = timers_.find(timer);
+    if (it == timers_.end())
+    {
+        return false;
+    }
+    timers_.erase(it);
+    return true;
+}
+
+bool TimerQueue::empty() const { return wheel_->empty() && timers_.empty(); }
+
+bool TimerQueue::due(Timestamp now) const
+{
+    return !empty() && !(now < nextExpiration());
+}
+
+Timestamp TimerQueue::nextExpiration() const
+{
+    Timestamp next;
+    int64_t   tick = wheel_->nextExpiration();
+    if (tick >= 0)
+    {
+        next = Timestamp(tick * 1000);
+    }
+    if (!timers_.empty() && (!next.valid() || (*timers_.begin())->expiration_ < next))
+    {
+        next = (*timers_.begin())->expiration_;
+    }
+    return next;
+}
+
+void TimerQueue::expire(Timestamp now, std::vector<Timer::ptr>& expired)
+{
+    // monotonic, no rollover
+    wheel_->advance(now.microSecondsSinceEpoch() / 1000, expired);
+    if (timers_.empty() || (*timers_.begin())->expiration_ > now)
+    {
+        // nothing happened
+        return;
+    }
+    Timer::ptr now_timer = easy::protected_make_shared<Timer>(now);
+    auto       end       = timers_.lower_bound(now_timer);
+    while (end != timers_.end() && (*end)->expiration_ == now_timer->expiration_)
+    {
+        ++end;
+    }
+    std::copy(timers_.begin(), end, std::back_inserter(expired));
+    timers_.erase(timers_.begin(), end);
+}
+
+// a cancel or reset of a per thread timer from another thread
+struct TimerOp
+{
+    std::atomic<TimerOp*> next_;
+    Timer::ptr            timer_;
+    bool                  cancel_{false};
+    int64_t               interval_{-1};
+    bool                  fromNow_{false};
+};
+
+struct LocalTimerQueue : noncopyable
+{
+    LocalTimerQueue(TimerManager* manager, int threadId) : manager_(manager), threadId_(threadId), queue_(manager->now()) {}
+
+    TimerManager*      manager_;
+    int                threadId_;
+    TimerQueue         queue_;  // owner thread only
+    MpscQueue<TimerOp> inbox_;
+};
+
+uint64_t TimerManager::Histogram::percentile(double p) const
+{
+    if (!count)
+    {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p * static_cast<double>(count) + 0.5);
+    rank          = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets - 1; ++i)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            return static_cast<uint64_t>(1) << i;
+        }
+    }
+    return max;
+}
+
+static YAML::Node ToYaml(const TimerManager::Histogram& histogram)
+{
+    YAML::Node node;
+    node["count"] = histogram.count;
+    node["mean"]  = histogram.count ? histogram.sum / histogram.count : 0;
+    node["max"]   = histogram.max;
+    node["p50"]   = histogram.percentile(0.5);
+    node["p99"]   = histogram.percentile(0.99);
+    node["p999"]  = histogram.percentile(0.999);
+    for (int i = 0; i < TimerManager::Histogram::kBuckets; ++i)
+    {
+        if (histogram.buckets[i])
+        {
+            // keyed by the upper bound in us
+            bool last = i == TimerManager::Histogram::kBuckets - 1;
+            node["buckets"][last ? std::string("inf") : std::to_string(static_cast<uint64_t>(1) << i)] = histogram.buckets[i];
+        }
+    }
+    return node;
+}
+
+std::string TimerManager::TimerStats::toYamlString() const
+{
+    YAML::Node node;
+    node["outstanding"]  = outstanding;
+    node["added"]        = added;
+    node["fired"]        = fired;
+    node["cancelled"]    = cancelled;
+    node["cancel_ratio"] = cancelRatio();
+    node["lateness_us"]  = ToYaml(lateness);
+    node["callback_us"]  = ToYaml(callback);
+    std::stringstream ss;
+    ss << node;
+    return ss.str();
+}
+
+// one manager per thread, a worker thread belongs to one IOManager
+static thread_local TimerManager*    t_local_manager = nullptr;
+static thread_local LocalTimerQueue* t_local_queue   = nullptr;
+
+static Timestamp::Clock ClockOf(const std::string& name)
+{
+    if (name == "coarse")
+    {
+        return Timestamp::MONOTONIC_COARSE;
+    }
+    if (name == "loop")
+    {
+        return Timestamp::LOOP;
+    }
+    return Timestamp::MONOTONIC;
+}
+
+TimerManager::TimerManager()
+    : clock_(ClockOf(timer_clock->value())), queue_(now()), timerfd_(createTimerfd()), stats_(timer_stats->value()), shards_(new TimerShard[kTimerShards])
+{
+}
+
+TimerManager::~TimerManager()
+{
+    for (auto& local : locals_)
+    {
+        while (TimerOp* op = local->inbox_.pop())
+        {
+            delete op;
+        }
+    }
+    close(timerfd_);
+}
+
+Timer::ptr TimerManager::addTimer(uint64_t interval, std::function<void()> cb, bool repeat, bool nonblocking, uint64_t slack)
+{
+    Timer::ptr timer = easy::protected_make_shared<Timer>(interval, cb, repeat, nonblocking, this, slack);
+    onAdded();
+    if (LocalTimerQueue* local = localQueue())
+    {
+        // the thread is running this, it sees the new deadline before it waits again
+        timer->local_ = local;
+        local->queue_.insert(timer);
+        localTimers_.increment();
+        return timer;
+    }
+    timer->threadId_ = timerThread();
     WriteLockGuard _(lock_);
     addTimer(timer);
     return timer;
@@ -128,126 +418,420 @@ static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> cb)
     }
 }
 
-Timer::ptr TimerManager::addConditionTimer(uint64_t interval, std::function<void()> cb, std::weak_ptr<void> weak_cond, bool repeat)
+Timer::ptr TimerManager::addConditionTimer(
+    uint64_t interval, std::function<void()> cb, std::weak_ptr<void> weak_cond, bool repeat, bool nonblocking, uint64_t slack)
 {
-    return addTimer(interval, std::bind(&OnTimer, weak_cond, cb), repeat);
+    return addTimer(interval, std::bind(&OnTimer, weak_cond, cb), repeat, nonblocking, slack);
 }
 
-void TimerManager::listExpiredCallback(std::vector<std::function<void()>>& cbs)
+void TimerManager::listExpiredCallback(
+    std::vector<std::function<void()>>& cbs, std::vector<std::function<void()>>& inline_cbs, std::vector<int>* threadIds)
 {
-    Timestamp               now = Timestamp::now();
+    Timestamp               now = expireNow();
     std::vector<Timer::ptr> expired;
     {
         ReadLockGuard _(lock_);
-        if (timers_.empty())
+        if (!queue_.due(now))
         {
+            // the earliest timer was cancelled after the timerfd was set for it, the read drained the timerfd
+            Timestamp nextExpire = queue_.nextExpiration();
+            if (nextExpire.valid() && needTimerfd(false))
+            {
+                resetTimerfd(timerfd_, nextExpire);
+            }
             return;
         }
     }
 
+    size_t embedded = 0;  // moved to the front of expired
+    {
+        WriteLockGuard _(lock_);
+        queue_.expire(now, expired);
+
+        cbs.reserve(expired.size());
+        for (auto& timer : expired)
+        {
+            if (timer->embedded_)
+            {
+                // claimed while it cannot be disarmed, disarmTimer waits for fire_ from here on
+                if (timer->done_.compareAndSet(Timer::kPending, Timer::kFiring))
+                {
+                    expired[embedded++].swap(timer);
+                }
+                continue;
+            }
+            onFired(*timer);
+            (timer->nonblocking_ ? inline_cbs : cbs).push_back(expiredCallback(timer->cb_, timer->expiration_, now));
+            if (!timer->nonblocking_ && threadIds)
+            {
+                threadIds->push_back(timer->threadId_);
+            }
+            if (timer->repeat_)
+            {
+                timer->expiration_ = timer->deadline(now);
+                queue_.insert(timer);  // the timerfd is set for all of them below
+            }
+            else
+            {
+                timer->cb_ = nullptr;
+            }
+        }
+
+        Timestamp nextExpire = queue_.nextExpiration();
+        if (nextExpire.valid() && needTimerfd(false))
+        {
+            resetTimerfd(timerfd_, nextExpire);
+        }
+    }
+
+    for (size_t i = 0; i < embedded; ++i)
+    {
+        Timer* timer = expired[i].get();
+        onFired(*timer);
+        if (stats_)
+        {
+            Record(shard().lateness, now.microSecondsSinceEpoch() - timer->expiration_.microSecondsSinceEpoch());
+        }
+        if (stats_ && Sampled())
+        {
+            Timestamp start = Timestamp::now(Timestamp::MONOTONIC);
+            timer->fire_(timer->arg_);
+            Record(shard().callback, Timestamp::now(Timestamp::MONOTONIC).microSecondsSinceEpoch() - start.microSecondsSinceEpoch());
+        }
+        else
+        {
+            timer->fire_(timer->arg_);
+        }
+        timer->done_.set(Timer::kDone);  // the owner may destroy it from here on
+    }
+}
+
+void TimerManager::armTimer(Timer& timer, uint64_t interval, void (*fire)(void*), void* arg, uint64_t slack)
+{
+    timer.embedded_   = true;
+    timer.fire_       = fire;
+    timer.arg_        = arg;
+    timer.manager_    = this;
+    timer.interval_   = static_cast<int64_t>(interval);
+    timer.slack_      = static_cast<int64_t>(slack);
+    timer.expiration_ = timer.deadline(now());
+    timer.done_.set(Timer::kPending);
+    onAdded();
+    Timer::ptr     alias(Timer::ptr(), &timer);  // not owning, no control block
     WriteLockGuard _(lock_);
-    bool           rollover = detectClockRollover(now);
-    if (!rollover && (*timers_.begin())->expiration_ > now)
+    addTimer(alias);
+}
+
+bool TimerManager::disarmTimer(Timer& timer)
+{
+    if (timer.done_.compareAndSet(Timer::kPending, Timer::kDone))
     {
-        // nothing happened
-        return;
+        onCancelled();
+        Timer::ptr     alias(Timer::ptr(), &timer);
+        WriteLockGuard _(lock_);
+        queue_.erase(alias);  // false if an expiring thread has taken it out, it skips a done timer
+        return true;
     }
-    Timer::ptr now_timer = easy::protected_make_shared<Timer>(now);
-    // system time changed, take out all timer
-    auto end = rollover ? timers_.end() : timers_.lower_bound(now_timer);
-    while (end != timers_.end() && (*end)->expiration_ == now_timer->expiration_)
+    while (timer.done_.get() == Timer::kFiring)
     {
-        ++end;
+        sched_yield();  // fire_ is short, it must not block
     }
-    std::copy(timers_.begin(), end, std::back_inserter(expired));
-    timers_.erase(timers_.begin(), end);
+    return false;
+}
+
+void TimerManager::addTimer(Timer::ptr timer)
+{
+    bool earliestChanged = queue_.insert(timer);
+    if (earliestChanged && needTimerfd(true))
+    {
+        resetTimerfd(timerfd_, queue_.nextExpiration());  // the wheel expires on whole ms ticks
+    }
+}
+
+int64_t TimerManager::nextTimeout()
+{
+    Timestamp next;
+    {
+        ReadLockGuard _(lock_);
+        next = queue_.nextExpiration();
+    }
+    if (!next.valid())
+    {
+        return -1;
+    }
+    int64_t us = next.microSecondsSinceEpoch() - waitNow().microSecondsSinceEpoch();
+    return us > 0 ? us : 0;
+}
 
-    cbs.reserve(expired.size());
+bool TimerManager::hasTimer()
+{
+    if (localTimers_.get() > 0)
+    {
+        return true;
+    }
+    ReadLockGuard _(lock_);
+    return !queue_.empty();
+}
+
+void TimerManager::attachThread(int threadId)
+{
+    std::unique_ptr<LocalTimerQueue> local(new LocalTimerQueue(this, threadId));
+    t_local_manager = this;
+    t_local_queue   = local.get();
+    WriteLockGuard _(lock_);
+    locals_.push_back(std::move(local));
+}
+
+void TimerManager::detachThread()
+{
+    if (localQueue())
+    {
+        t_local_manager = nullptr;
+        t_local_queue   = nullptr;
+    }
+}
+
+LocalTimerQueue* TimerManager::localQueue() { return t_local_manager == this ? t_local_queue : nullptr; }
+
+int64_t TimerManager::nextLocalTimeout()
+{
+    LocalTimerQueue* local = localQueue();
+    if (!local)
+    {
+        return -1;
+    }
+    // pairs with the waiter check in onLocalTimerMessage, a message pushed before the thread went idle is seen here
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    drain(local);
+    Timestamp next = local->queue_.nextExpiration();
+    if (!next.valid())
+    {
+        return -1;
+    }
+    int64_t us = next.microSecondsSinceEpoch() - waitNow().microSecondsSinceEpoch();
+    return us > 0 ? us : 0;
+}
+
+void TimerManager::listLocalExpiredCallback(std::vector<std::function<void()>>& cbs, std::vector<std::function<void()>>& inline_cbs)
+{
+    LocalTimerQueue* local = localQueue();
+    if (!local)
+    {
+        return;
+    }
+    drain(local);
+    if (local->queue_.empty())
+    {
+        return;
+    }
+    Timestamp               now = expireNow();
+    std::vector<Timer::ptr> expired;
+    local->queue_.expire(now, expired);
     for (auto& timer : expired)
     {
-        cbs.push_back(timer->cb_);
+        localTimers_.decrement();
         if (timer->repeat_)
         {
-            timer->expiration_ = addTime(now, timer->interval_);
-            addTimer(timer);
+            if (timer->done_.get())
+            {
+                // cancelled by another thread, the message is on the way
+                timer->cb_ = nullptr;
+                continue;
+            }
+            onFired(*timer);
+            (timer->nonblocking_ ? inline_cbs : cbs).push_back(expiredCallback(timer->cb_, timer->expiration_, now));
+            timer->expiration_ = timer->deadline(now);
+            local->queue_.insert(timer);
+            localTimers_.increment();
         }
         else
         {
+            if (timer->done_.compareAndSet(0, 1))
+            {
+                onFired(*timer);
+                (timer->nonblocking_ ? inline_cbs : cbs).push_back(expiredCallback(std::move(timer->cb_), timer->expiration_, now));
+            }
             timer->cb_ = nullptr;
         }
     }
+}
 
-    Timestamp nextExpire;
-    if (!timers_.empty())
+void TimerManager::drain(LocalTimerQueue* local)
+{
+    while (TimerOp* op = local->inbox_.pop())
     {
-        nextExpire = (*timers_.begin())->expiration_;
+        if (op->cancel_)
+        {
+            if (local->queue_.erase(op->timer_))
+            {
+                localTimers_.decrement();
+            }
+            op->timer_->cb_ = nullptr;
+        }
+        else
+        {
+            applyReset(local, op->timer_, op->interval_, op->fromNow_);
+        }
+        delete op;
     }
-    if (nextExpire.valid())
+}
+
+bool TimerManager::cancelLocal(const Timer::ptr& timer)
+{
+    if (!timer->done_.compareAndSet(0, 1))
     {
-        resetTimerfd(timerfd_, nextExpire);
+        return false;
     }
+    onCancelled();
+    LocalTimerQueue* local = timer->local_;
+    if (local == localQueue())
+    {
+        if (local->queue_.erase(timer))
+        {
+            localTimers_.decrement();
+        }
+        timer->cb_ = nullptr;
+        return true;
+    }
+    // done_ already keeps it from firing, the owner drops it from its queue later
+    TimerOp* op = new TimerOp;
+    op->timer_  = timer;
+    op->cancel_ = true;
+    local->inbox_.push(op);
+    onLocalTimerMessage(local->threadId_);
+    return true;
 }
 
-void TimerManager::addTimer(Timer::ptr timer)
+bool TimerManager::resetLocal(const Timer::ptr& timer, int64_t interval, bool from_now)
 {
-    auto it              = timers_.insert(timer).first;
-    bool earliestChanged = (it == timers_.begin());
-    if (earliestChanged)
+    LocalTimerQueue* local = timer->local_;
+    if (local == localQueue())
+    {
+        return applyReset(local, timer, interval, from_now);
+    }
+    if (timer->done_.get())
     {
-        resetTimerfd(timerfd_, timer->expiration_);
+        return false;
     }
+    // may be earlier than what the owner waits for, so it is woken
+    TimerOp* op   = new TimerOp;
+    op->timer_    = timer;
+    op->interval_ = interval;
+    op->fromNow_  = from_now;
+    local->inbox_.push(op);
+    onLocalTimerMessage(local->threadId_);
+    return true;
 }
 
-bool TimerManager::hasTimer()
+bool TimerManager::applyReset(LocalTimerQueue* local, const Timer::ptr& timer, int64_t interval, bool from_now)
 {
-    ReadLockGuard _(lock_);
-    return !timers_.empty();
+    if (timer->done_.get() || !local->queue_.erase(timer))
+    {
+        return false;
+    }
+    if (interval < 0)
+    {
+        interval = timer->interval_;
+    }
+    Timestamp start    = from_now ? now() : addTime(timer->expiration_, -timer->interval_);
+    timer->interval_   = interval;
+    timer->expiration_ = timer->deadline(start);
+    local->queue_.insert(timer);
+    return true;
 }
 
-bool TimerManager::detectClockRollover(Timestamp now)
+TimerShard& TimerManager::shard()
 {
-    bool rollover = false;
-    // rollover > 1 hour
-    if (now < previous_ && now < addTime(previous_, -Timestamp::kSecondsPerHour))
+    if (t_shard < 0)
     {
-        rollover = true;
+        t_shard = s_shard_seq.fetchAndAdd(1) % kTimerShards;
     }
-    previous_ = now;
-    return rollover;
+    return shards_[t_shard];
 }
 
-int TimerManager::createTimerfd()
+void TimerManager::onFired(const Timer& timer)
 {
-    int timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK /*| TFD_CLOEXEC*/);
-    if (timerfd < 0)
+    TimerShard& stats = shard();
+    RelaxedAdd(stats.fired, static_cast<uint64_t>(1));
+    if (!timer.repeat_)
     {
-        ELOG_ERROR(logger) << "Failed in timerfd_create";
+        RelaxedAdd(stats.outstanding, static_cast<int64_t>(-1));
     }
-    return timerfd;
 }
 
-static struct timespec howMuchTimeFromNow(Timestamp when)
+void TimerManager::onAdded()
+{
+    TimerShard& stats = shard();
+    RelaxedAdd(stats.added, static_cast<uint64_t>(1));
+    RelaxedAdd(stats.outstanding, static_cast<int64_t>(1));
+}
+
+void TimerManager::onCancelled()
+{
+    TimerShard& stats = shard();
+    RelaxedAdd(stats.cancelled, static_cast<uint64_t>(1));
+    RelaxedAdd(stats.outstanding, static_cast<int64_t>(-1));
+}
+
+std::function<void()> TimerManager::expiredCallback(std::function<void()> cb, Timestamp expiration, Timestamp now)
+{
+    if (!stats_)
+    {
+        return cb;
+    }
+    Record(shard().lateness, now.microSecondsSinceEpoch() - expiration.microSecondsSinceEpoch());
+    if (!Sampled())
+    {
+        return cb;
+    }
+    // the IOManager runs its tasks before the TimerManager goes away
+    return std::bind(&TimerManager::runTimed, this, std::move(cb));
+}
+
+void TimerManager::runTimed(const std::function<void()>& cb)
+{
+    Timestamp start = Timestamp::now(Timestamp::MONOTONIC);
+    cb();
+    // the fiber may have moved to another thread
+    Record(shard().callback, Timestamp::now(Timestamp::MONOTONIC).microSecondsSinceEpoch() - start.microSecondsSinceEpoch());
+}
+
+TimerManager::TimerStats TimerManager::timerStats() const
+{
+    TimerStats stats;
+    for (int i = 0; i < kTimerShards; ++i)
+    {
+        const TimerShard& shard = shards_[i];
+        stats.outstanding += RelaxedGet(shard.outstanding);
+        stats.added += RelaxedGet(shard.added);
+        stats.fired += RelaxedGet(shard.fired);
+        stats.cancelled += RelaxedGet(shard.cancelled);
+        Merge(stats.lateness, shard.lateness);
+        Merge(stats.callback, shard.callback);
+    }
+    return stats;
+}
+
+int TimerManager::createTimerfd()
 {
-    int64_t microseconds = when.microSecondsSinceEpoch() - Timestamp::now().microSecondsSinceEpoch();
-    if (microseconds < 100)
+    int timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK /*| TFD_CLOEXEC*/);
+    if (timerfd < 0)
     {
-        microseconds = 100;
+        ELOG_ERROR(logger) << "Failed in timerfd_create";
     }
-    struct timespec ts;
-    ts.tv_sec  = static_cast<time_t>(microseconds / Timestamp::kMicroSecondsPerSecond);
-    ts.tv_nsec = static_cast<long>((microseconds % Timestamp::kMicroSecondsPerSecond) * 1000);
-    return ts;
+    return timerfd;
 }
 
 void TimerManager::resetTimerfd(int timerfd, Timestamp expiration)
 {
-    // wake up by timerfd_settime()
+    // expirations are CLOCK_MONOTONIC like the timerfd, an absolute deadline needs no clock read, a past one fires at once
     struct itimerspec newValue;
     struct itimerspec oldValue;
     memset(&newValue, 0, sizeof newValue);
     memset(&oldValue, 0, sizeof oldValue);
-    newValue.it_value = howMuchTimeFromNow(expiration);
-    EASY_CHECK(timerfd_settime(timerfd, 0, &newValue, &oldValue));
+    newValue.it_value.tv_sec  = static_cast<time_t>(expiration.seconds());
+    newValue.it_value.tv_nsec = static_cast<long>(expiration.microSecondsRemainder() * 1000);
+    EASY_CHECK(timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &newValue, &oldValue));
 }
 
 }  // namespace easy
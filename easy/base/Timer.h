@@ -1,6 +1,7 @@
 #ifndef __EASY_TIMER_H__
 #define __EASY_TIMER_H__
 
+#include "easy/base/Atomic.h"
 #include "easy/base/Mutex.h"
 #include "easy/base/Timestamp.h"
 #include "easy/base/noncopyable.h"
@@ -9,23 +10,33 @@
 #include <functional>
 #include <memory>
 #include <set>
+#include <string>
 #include <vector>
 
 namespace easy
 {
 class TimerManager;
+class TimerWheel;
+class TimerQueue;
+struct LocalTimerQueue;
+struct TimerShard;
 
 class Timer : noncopyable, public std::enable_shared_from_this<Timer>
 {
     friend class TimerManager;
+    friend class TimerWheel;
+    friend class TimerQueue;
 
   public:
     typedef std::shared_ptr<Timer> ptr;
 
-    Timer(int64_t interval, std::function<void()> cb, bool repeat, TimerManager* manager);
+    Timer(int64_t interval, std::function<void()> cb, bool repeat, bool nonblocking, TimerManager* manager, int64_t slack = 0);
 
     Timer(Timestamp time);
 
+    // an embedded timer, armed and disarmed without allocation, see TimerManager::armTimer
+    Timer() {}
+
     bool cancel();
 
     bool refresh();
@@ -38,12 +49,77 @@ class Timer : noncopyable, public std::enable_shared_from_this<Timer>
         bool operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) const;
     };
 
+    // interval_ after start, rounded up to a multiple of slack_, timers due within the same slack share it
+    Timestamp deadline(Timestamp start) const;
+
   private:
     bool                  repeat_{false};
-    int64_t               interval_{0};  // ms
+    bool                  nonblocking_{false};  // cb_ runs inline on the scheduler fiber
+    int64_t               interval_{0};         // ms
+    int64_t               slack_{0};            // ms it may fire late, 0 for exact
     Timestamp             expiration_;
     std::function<void()> cb_;
     TimerManager*         manager_ = nullptr;
+
+    // per thread timers only, see TimerManager::attachThread
+    LocalTimerQueue* local_{nullptr};  // the queue of the thread that added it
+
+    // shared queue only, the thread the callback is scheduled on, -1 for any, see TimerManager::timerThread
+    int threadId_{-1};
+
+    // per thread and embedded timers, the expiring and cancelling threads race on it
+    enum State
+    {
+        kPending = 0,
+        kDone    = 1,  // fired or cancelled
+        kFiring  = 2,  // embedded only, fire_ is running
+    };
+    AtomicInt<int> done_{kPending};
+
+    // embedded timers only, always in the wheel of a TimerQueue, no shared ownership
+    bool embedded_{false};
+    void (*fire_)(void*) = nullptr;
+    void* arg_           = nullptr;
+
+    // TimerWheel only
+    Timer*     prev_{nullptr};
+    Timer*     next_{nullptr};
+    Timer::ptr self_;  // the wheel links raw pointers, a queued timer keeps itself alive
+    int64_t    tick_{0};
+    int16_t    slot_{-1};  // level * slots + slot, -1 if not queued
+};
+
+// the timers of a TimerManager or of one of its threads, std::set or TimerWheel by timer.queue
+// embedded timers always go to the wheel, it links them without allocation
+// not thread safe
+class TimerQueue : noncopyable
+{
+  public:
+    explicit TimerQueue(Timestamp now);
+
+    ~TimerQueue();
+
+    // true if timer is the earliest now
+    bool insert(const Timer::ptr& timer);
+
+    // false if timer is not queued
+    bool erase(const Timer::ptr& timer);
+
+    bool empty() const;
+
+    // false if expire would find nothing at now
+    bool due(Timestamp now) const;
+
+    // invalid if there is no timer, may be early with the wheel
+    Timestamp nextExpiration() const;
+
+    // timers due at now
+    void expire(Timestamp now, std::vector<Timer::ptr>& expired);
+
+  private:
+    std::set<Timer::ptr, Timer::Comparator> timers_;
+    std::unique_ptr<TimerWheel>             wheel_;
+    bool                                    wheelOnly_{false};  // timer.queue=wheel
 };
 
 class TimerManager : noncopyable
@@ -51,34 +127,153 @@ class TimerManager : noncopyable
     friend class Timer;
 
   public:
+    // us values in power of 2 buckets
+    struct Histogram
+    {
+        static const int kBuckets = 24;  // bucket i holds values below 2^i us, the last one everything later
+
+        uint64_t count              = 0;
+        uint64_t sum                = 0;  // us
+        uint64_t max                = 0;  // us
+        uint64_t buckets[kBuckets] = {};
+
+        // upper bound in us of the bucket the p quantile falls in, 0 if empty
+        uint64_t percentile(double p) const;
+    };
+
+    // summed over per thread shards of relaxed counters, a snapshot taken under load may be off by a few
+    struct TimerStats
+    {
+        int64_t   outstanding = 0;  // added and not fired once, cancelled or disarmed yet, a repeating timer until cancelled
+        uint64_t  added       = 0;
+        uint64_t  fired       = 0;  // expirations, a repeating timer counts each
+        uint64_t  cancelled   = 0;  // cancelled or disarmed before it fired
+        Histogram lateness;         // expiry minus expiration, timer.stats only
+        Histogram callback;         // wall time of sampled callbacks, a fiber that yields counts its wait, timer.stats only
+
+        double cancelRatio() const { return added ? static_cast<double>(cancelled) / static_cast<double>(added) : 0; }
+
+        std::string toYamlString() const;
+    };
+
     TimerManager();
 
     virtual ~TimerManager();
 
-    Timer::ptr addTimer(uint64_t interval, std::function<void()> cb, bool repeat = false);
+    // nonblocking: cb only does non-blocking work, see Scheduler::scheduleInline
+    // slack: ms the timer may fire late, timers whose deadlines fall into the same slack expire in one wakeup
+    Timer::ptr addTimer(uint64_t interval, std::function<void()> cb, bool repeat = false, bool nonblocking = false, uint64_t slack = 0);
+
+    Timer::ptr addConditionTimer(uint64_t interval, std::function<void()> cb, std::weak_ptr<void> weak_cond, bool repeat = false,
+        bool nonblocking = false, uint64_t slack = 0);
 
-    Timer::ptr addConditionTimer(uint64_t interval, std::function<void()> cb, std::weak_ptr<void> weak_cond, bool repeat = false);
+    // fire(arg) runs on the thread that expires it once interval ms passed, it must not block, like a nonblocking timer
+    // timer is owned by the caller, e.g. on the stack of the fiber that waits, and has to be disarmed before it goes away
+    // always in the shared queue
+    void armTimer(Timer& timer, uint64_t interval, void (*fire)(void*), void* arg, uint64_t slack = 0);
 
-    void listExpiredCallback(std::vector<std::function<void()>>& fns);
+    // false if it fired, fire has returned then, timer can be destroyed or armed again afterwards
+    bool disarmTimer(Timer& timer);
+
+    // expired callbacks of nonblocking timers go to inline_fns
+    // threadIds: the thread each of fns goes back to, -1 for any
+    void listExpiredCallback(
+        std::vector<std::function<void()>>& fns, std::vector<std::function<void()>>& inline_fns, std::vector<int>* threadIds = nullptr);
 
     bool hasTimer();
 
     int timerfd() { return timerfd_; }
 
+    // on the clock of the deadlines, timer.clock
+    Timestamp now() const { return Timestamp::now(clock_); }
+
+    // us until the earliest timer of the shared queue, 0 if one is due, -1 if there is none
+    int64_t nextTimeout();
+
+    TimerStats timerStats() const;
+
   protected:
     void addTimer(Timer::ptr timer);
 
+    // whether the timerfd has to carry a new deadline, earlier: a new earliest timer, otherwise the next one after expiry
+    // false when the threads that wait for timers put nextTimeout into their own wait
+    virtual bool needTimerfd(bool earlier)
+    {
+        (void)earlier;
+        return true;
+    }
+
+    // the thread the callback of a timer added now in the shared queue is scheduled on, -1 for any
+    virtual int timerThread() { return -1; }
+
+    // timers added on the calling thread go to a queue of its own from now on, no lock and no timerfd
+    // the thread folds nextLocalTimeout into its wait and calls listLocalExpiredCallback
+    // other threads cancel or reset them through a message queue, see onLocalTimerMessage
+    void attachThread(int threadId);
+
+    // the calling thread stops using its queue, it has to be empty
+    void detachThread();
+
+    // us until the earliest timer of the calling thread, -1 if it has none or is not attached
+    int64_t nextLocalTimeout();
+
+    // expired timers of the calling thread
+    void listLocalExpiredCallback(std::vector<std::function<void()>>& fns, std::vector<std::function<void()>>& inline_fns);
+
+    // a message for the queue of threadId is pushed, wake the thread if it waits
+    virtual void onLocalTimerMessage(int threadId) { (void)threadId; }
+
   private:
-    bool detectClockRollover(Timestamp now);
+    // the queue of the calling thread, nullptr if it is not attached to this manager
+    LocalTimerQueue* localQueue();
+
+    // apply the cancels and resets other threads sent to local
+    void drain(LocalTimerQueue* local);
+
+    bool cancelLocal(const Timer::ptr& timer);
+
+    // interval < 0 keeps the interval, false if the timer already fired or was cancelled
+    bool resetLocal(const Timer::ptr& timer, int64_t interval, bool from_now);
+
+    // owner thread only
+    bool applyReset(LocalTimerQueue* local, const Timer::ptr& timer, int64_t interval, bool from_now);
+
+    // the clock to compute a wait with, a cached LOOP time may be old
+    Timestamp waitNow() const { return Timestamp::now(clock_ == Timestamp::LOOP ? Timestamp::MONOTONIC : clock_); }
+
+    // the clock to expire with, a coarse read lags the timerfd that woke the thread up and would find nothing due
+    Timestamp expireNow() const { return clock_ == Timestamp::MONOTONIC_COARSE ? Timestamp::now(Timestamp::MONOTONIC) : now(); }
 
     int  createTimerfd();
     void resetTimerfd(int timerfd, Timestamp expiration);
 
+    // the stats shard of the calling thread
+    TimerShard& shard();
+
+    // a timer was added or armed
+    void onAdded();
+
+    // an expired timer went to fns or inline_fns
+    void onFired(const Timer& timer);
+
+    // a timer was cancelled or disarmed before it fired
+    void onCancelled();
+
+    // cb of a timer that expired at expiration and was found at now, its lateness is recorded and some are timed
+    std::function<void()> expiredCallback(std::function<void()> cb, Timestamp expiration, Timestamp now);
+
+    // cb and its run time, on the thread that runs the callback
+    void runTimed(const std::function<void()>& cb);
+
   private:
-    ReadWriteLock                           lock_;
-    std::set<Timer::ptr, Timer::Comparator> timers_;
-    const int                               timerfd_;
-    Timestamp                               previous_;
+    ReadWriteLock                                 lock_;
+    const Timestamp::Clock                        clock_;
+    TimerQueue                                    queue_;  // timers of threads that are not attached
+    const int                                     timerfd_;
+    std::vector<std::unique_ptr<LocalTimerQueue>> locals_;  // lock_ held
+    AtomicInt<int64_t>                            localTimers_{0};  // queued in locals_
+    const bool                                    stats_;            // timer.stats
+    std::unique_ptr<TimerShard[]>                 shards_;
 };
 }  // namespace easy
 
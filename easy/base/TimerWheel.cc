@@ -0,0 +1,205 @@
+#include "easy/base/TimerWheel.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace easy
+{
+TimerWheel::TimerWheel(int64_t now_ms) : current_(now_ms)
+{
+    memset(slots_, 0, sizeof(slots_));
+    memset(occupied_, 0, sizeof(occupied_));
+}
+
+TimerWheel::~TimerWheel()
+{
+    std::vector<Timer::ptr> timers;
+    clear(timers);
+}
+
+void TimerWheel::insert(const Timer::ptr& timer)
+{
+    timer->tick_ = Tick(timer->expiration_);
+    timer->self_ = timer;
+    link(timer.get());
+    ++size_;
+}
+
+bool TimerWheel::erase(Timer* timer)
+{
+    if (timer->slot_ < 0)
+    {
+        return false;
+    }
+    unlink(timer);
+    --size_;
+    Timer::ptr self = std::move(timer->self_);  // may be the last reference, released last
+    return true;
+}
+
+void TimerWheel::link(Timer* timer)
+{
+    // an overdue timer goes to the slot expiring next
+    int64_t tick  = std::max(timer->tick_, current_);
+    int64_t delta = tick - current_;
+    int     level = 0;
+    while (level < kLevels - 1 && delta >= (static_cast<int64_t>(1) << (kBits * (level + 1))))
+    {
+        ++level;
+    }
+    if (level == kLevels - 1 && delta >= (static_cast<int64_t>(1) << (kBits * kLevels)))
+    {
+        tick = current_ + (static_cast<int64_t>(1) << (kBits * kLevels)) - 1;  // parked, linked again on cascade
+    }
+    int slot = static_cast<int>((tick >> (kBits * level)) & kMask);
+
+    Timer*& head  = slots_[level][slot];
+    timer->prev_  = nullptr;
+    timer->next_  = head;
+    if (head)
+    {
+        head->prev_ = timer;
+    }
+    head         = timer;
+    timer->slot_ = static_cast<int16_t>(level * kSlots + slot);
+    occupied_[level] |= static_cast<uint64_t>(1) << slot;
+}
+
+void TimerWheel::unlink(Timer* timer)
+{
+    int level = timer->slot_ / kSlots;
+    int slot  = timer->slot_ % kSlots;
+    if (timer->prev_)
+    {
+        timer->prev_->next_ = timer->next_;
+    }
+    else
+    {
+        slots_[level][slot] = timer->next_;
+        if (!timer->next_)
+        {
+            occupied_[level] &= ~(static_cast<uint64_t>(1) << slot);
+        }
+    }
+    if (timer->next_)
+    {
+        timer->next_->prev_ = timer->prev_;
+    }
+    timer->prev_ = timer->next_ = nullptr;
+    timer->slot_                = -1;
+}
+
+bool TimerWheel::cascade(int level)
+{
+    int    slot  = static_cast<int>((current_ >> (kBits * level)) & kMask);
+    Timer* timer = slots_[level][slot];
+    slots_[level][slot] = nullptr;
+    occupied_[level] &= ~(static_cast<uint64_t>(1) << slot);
+    while (timer)
+    {
+        Timer* next = timer->next_;
+        link(timer);  // a lower level now, current_ is at the start of this slot
+        timer = next;
+    }
+    return slot == 0;
+}
+
+void TimerWheel::advance(int64_t now_ms, std::vector<Timer::ptr>& expired)
+{
+    while (current_ <= now_ms)
+    {
+        if (!size_)
+        {
+            current_ = now_ms + 1;
+            return;
+        }
+        int slot = static_cast<int>(current_ & kMask);
+        if (slot == 0)
+        {
+            for (int level = 1; level < kLevels && cascade(level); ++level) {}
+        }
+        else if (!occupied_[0])
+        {
+            // nothing in level 0, skip to where the next cascade may fill it
+            current_ = std::min(now_ms + 1, (current_ | kMask) + 1);
+            continue;
+        }
+
+        Timer* timer     = slots_[0][slot];
+        slots_[0][slot] = nullptr;
+        occupied_[0] &= ~(static_cast<uint64_t>(1) << slot);
+        while (timer)
+        {
+            Timer* next  = timer->next_;
+            timer->prev_ = timer->next_ = nullptr;
+            timer->slot_                = -1;
+            expired.push_back(std::move(timer->self_));
+            --size_;
+            timer = next;
+        }
+        ++current_;
+    }
+}
+
+void TimerWheel::clear(std::vector<Timer::ptr>& expired)
+{
+    for (int level = 0; level < kLevels; ++level)
+    {
+        for (int slot = 0; slot < kSlots; ++slot)
+        {
+            Timer* timer = slots_[level][slot];
+            while (timer)
+            {
+                Timer* next  = timer->next_;
+                timer->prev_ = timer->next_ = nullptr;
+                timer->slot_                = -1;
+                expired.push_back(std::move(timer->self_));
+                timer = next;
+            }
+            slots_[level][slot] = nullptr;
+        }
+        occupied_[level] = 0;
+    }
+    size_ = 0;
+}
+
+int64_t TimerWheel::nextExpiration() const
+{
+    if (!size_)
+    {
+        return -1;
+    }
+    int64_t next = INT64_MAX;
+    for (int level = 0; level < kLevels; ++level)
+    {
+        uint64_t bits = occupied_[level];
+        if (!bits)
+        {
+            continue;
+        }
+        int     shift = kBits * level;
+        int64_t base  = current_ >> shift;
+        int     idx   = static_cast<int>(base & kMask);
+        // level 0 expires at the slot, an upper slot is moved down when the level below wraps into it
+        bool    pending = level == 0 || (current_ & ((static_cast<int64_t>(1) << shift) - 1)) == 0;
+        uint64_t ahead  = pending ? bits >> idx : (idx == kMask ? 0 : bits >> (idx + 1));
+        int64_t  dist   = 0;
+        if (ahead)
+        {
+            dist = __builtin_ctzll(ahead) + (pending ? 0 : 1);
+        }
+        else
+        {
+            dist = kSlots - idx + __builtin_ctzll(bits);  // wrapped around
+        }
+        int64_t tick = level == 0 ? base + dist : (base + dist) << shift;
+        next         = std::min(next, tick);
+        if (level == 0 && ahead)
+        {
+            break;  // exact, and upper levels are later
+        }
+    }
+    return std::max(next, current_);
+}
+
+}  // namespace easy
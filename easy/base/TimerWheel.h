@@ -0,0 +1,67 @@
+#ifndef __EASY_TIMER_WHEEL_H__
+#define __EASY_TIMER_WHEEL_H__
+
+#include "easy/base/Timer.h"
+#include "easy/base/noncopyable.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace easy
+{
+// hierarchical timing wheel, 1ms ticks, kLevels levels of kSlots slots, O(1) insert and erase
+// a timer in an upper level moves down when the wheel below wraps, see Varghese & Lauck, SOSP'87
+// not thread safe, TimerManager locks
+class TimerWheel : noncopyable
+{
+  public:
+    explicit TimerWheel(int64_t now_ms);
+
+    // queued timers are dropped
+    ~TimerWheel();
+
+    void insert(const Timer::ptr& timer);
+
+    // false if the timer is not queued
+    bool erase(Timer* timer);
+
+    // timers due at now_ms
+    void advance(int64_t now_ms, std::vector<Timer::ptr>& expired);
+
+    // all timers
+    void clear(std::vector<Timer::ptr>& expired);
+
+    // ms, never later than the earliest timer, exact when it is within kSlots ms, -1 if empty
+    int64_t nextExpiration() const;
+
+    bool empty() const { return size_ == 0; }
+
+    size_t size() const { return size_; }
+
+    // the tick a timer is due at
+    static int64_t Tick(Timestamp expiration) { return (expiration.microSecondsSinceEpoch() + 999) / 1000; }
+
+  private:
+    static const int     kBits   = 6;
+    static const int     kSlots  = 1 << kBits;
+    static const int     kLevels = 6;  // 2^36 ms, about 2 years, later timers wait in the top level
+    static const int64_t kMask   = kSlots - 1;
+
+    void link(Timer* timer);
+
+    void unlink(Timer* timer);
+
+    // move the timers of the current slot of level down, true if level wrapped too
+    bool cascade(int level);
+
+  private:
+    Timer*   slots_[kLevels][kSlots];
+    uint64_t occupied_[kLevels];  // bit per non empty slot
+    int64_t  current_;            // next tick to expire, everything before is done
+    size_t   size_{0};
+};
+
+}  // namespace easy
+
+#endif
@@ -2,9 +2,20 @@
 
 #include <memory.h>
 #include <sys/time.h>
+#include <time.h>
 
 namespace easy
 {
+static thread_local int64_t t_loop_time = 0;
+
+static Timestamp ReadClock(clockid_t id)
+{
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    int64_t seconds = ts.tv_sec;
+    return Timestamp(seconds * Timestamp::kMicroSecondsPerSecond + ts.tv_nsec / 1000);
+}
+
 Timestamp Timestamp::now()
 {
     struct timeval tv;
@@ -13,4 +24,23 @@ Timestamp Timestamp::now()
     return Timestamp(seconds * kMicroSecondsPerSecond + tv.tv_usec);
 }
 
+Timestamp Timestamp::now(Clock clock)
+{
+    if (clock == REALTIME)
+    {
+        return now();
+    }
+    if (clock == MONOTONIC_COARSE)
+    {
+        return ReadClock(CLOCK_MONOTONIC_COARSE);
+    }
+    if (clock == LOOP && t_loop_time)
+    {
+        return Timestamp(t_loop_time);
+    }
+    return ReadClock(CLOCK_MONOTONIC);
+}
+
+void Timestamp::setLoopTime(Timestamp time) { t_loop_time = time.microSecondsSinceEpoch(); }
+
 }  // namespace easy
@@ -10,6 +10,15 @@ namespace easy
 class Timestamp : public copyable
 {
   public:
+    // the clock a caller reads, only REALTIME is comparable with dates
+    enum Clock
+    {
+        REALTIME,          // gettimeofday, for logs and dates
+        MONOTONIC,         // CLOCK_MONOTONIC, for deadlines
+        MONOTONIC_COARSE,  // CLOCK_MONOTONIC_COARSE, cheaper, one kernel tick (1-4ms) behind
+        LOOP,              // the MONOTONIC time the IOManager loop of this thread read after its last wait, MONOTONIC elsewhere
+    };
+
     Timestamp() : microSecondsSinceEpoch_(0) {}
 
     explicit Timestamp(int64_t msc) : microSecondsSinceEpoch_(msc) {}
@@ -40,6 +49,11 @@ class Timestamp : public copyable
 
     static Timestamp now();
 
+    static Timestamp now(Clock clock);
+
+    // the IOManager refreshes LOOP once per wait, an invalid time turns it off for this thread
+    static void setLoopTime(Timestamp time);
+
     static const int kMicroSecondsPerSecond = 1000 * 1000;
     static const int kMillisecondPerSeond   = 1000;
     static const int kSecondsPerHour        = 60 * 60;
@@ -0,0 +1,195 @@
+#include "easy/base/Uring.h"
+
+#ifdef EASY_HAS_IO_URING
+
+#include "easy/base/Logger.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace easy
+{
+static Logger::ptr logger = ELOG_NAME("system");
+
+static int io_uring_setup(unsigned entries, io_uring_params* p) { return static_cast<int>(syscall(__NR_io_uring_setup, entries, p)); }
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+template <typename T>
+static T* RingPtr(void* ring, uint32_t offset)
+{
+    return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+Uring::Uring(unsigned entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags      = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;  // completions of several batches may wait for the reaper
+    int fd            = io_uring_setup(entries, &params);
+    if (fd < 0)
+    {
+        ELOG_WARN(logger) << "io_uring_setup errno=" << errno << " " << strerror(errno);
+        return;
+    }
+    fd_ = fd;
+
+    ringSize_    = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_  = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single  = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && cqRingSize_ > ringSize_)
+    {
+        ringSize_ = cqRingSize_;
+    }
+    ring_ = mmap(nullptr, ringSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (ring_ == MAP_FAILED)
+    {
+        ring_ = nullptr;
+        ELOG_WARN(logger) << "io_uring sq ring mmap errno=" << errno;
+        release();
+        return;
+    }
+    cqRing_ = single ? ring_ : mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (cqRing_ == MAP_FAILED || sqes == MAP_FAILED)
+    {
+        cqRing_ = cqRing_ == MAP_FAILED ? nullptr : cqRing_;
+        sqes_   = sqes == MAP_FAILED ? nullptr : static_cast<io_uring_sqe*>(sqes);
+        ELOG_WARN(logger) << "io_uring cq ring or sqes mmap errno=" << errno;
+        release();
+        return;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    sqHead_      = RingPtr<unsigned>(ring_, params.sq_off.head);
+    sqTail_      = RingPtr<unsigned>(ring_, params.sq_off.tail);
+    sqArray_     = RingPtr<unsigned>(ring_, params.sq_off.array);
+    sqFlags_     = RingPtr<unsigned>(ring_, params.sq_off.flags);
+    sqMask_      = *RingPtr<unsigned>(ring_, params.sq_off.ring_mask);
+    sqEntries_   = params.sq_entries;
+    sqLocalTail_ = *sqTail_;
+
+    cqHead_ = RingPtr<unsigned>(cqRing_, params.cq_off.head);
+    cqTail_ = RingPtr<unsigned>(cqRing_, params.cq_off.tail);
+    cqMask_ = *RingPtr<unsigned>(cqRing_, params.cq_off.ring_mask);
+    cqes_   = RingPtr<io_uring_cqe>(cqRing_, params.cq_off.cqes);
+
+    if (!(params.features & IORING_FEAT_NODROP) || !probe())
+    {
+        ELOG_WARN(logger) << "io_uring lacks features, features=" << params.features;
+        release();
+    }
+}
+
+Uring::~Uring() { release(); }
+
+void Uring::release()
+{
+    if (sqes_)
+    {
+        munmap(sqes_, sqesSize_);
+        sqes_ = nullptr;
+    }
+    if (cqRing_ && cqRing_ != ring_)
+    {
+        munmap(cqRing_, cqRingSize_);
+    }
+    cqRing_ = nullptr;
+    if (ring_)
+    {
+        munmap(ring_, ringSize_);
+        ring_ = nullptr;
+    }
+    if (fd_ >= 0)
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool Uring::probe()
+{
+    const unsigned kOps = 256;
+    // io_uring_probe ends with a flexible array of io_uring_probe_op
+    std::vector<char> buf(sizeof(io_uring_probe) + kOps * sizeof(io_uring_probe_op), 0);
+    io_uring_probe*   p = reinterpret_cast<io_uring_probe*>(&buf[0]);
+    if (io_uring_register(fd_, IORING_REGISTER_PROBE, p, kOps) < 0)
+    {
+        return false;  // before 5.6, no IORING_OP_RECV either
+    }
+    const int kNeeded[] = {IORING_OP_READ,
+        IORING_OP_WRITE,
+        IORING_OP_RECV,
+        IORING_OP_SEND,
+        IORING_OP_ACCEPT,
+        IORING_OP_CONNECT,
+        IORING_OP_LINK_TIMEOUT,
+        IORING_OP_ASYNC_CANCEL};
+    for (int op : kNeeded)
+    {
+        if (op > p->last_op || !(p->ops[op].flags & IO_URING_OP_SUPPORTED))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+io_uring_sqe* Uring::getSqe()
+{
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqLocalTail_ - head >= sqEntries_)
+    {
+        return nullptr;
+    }
+    unsigned      idx = sqLocalTail_ & sqMask_;
+    io_uring_sqe* sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray_[idx] = idx;
+    ++sqLocalTail_;
+    return sqe;
+}
+
+unsigned Uring::pending() const { return sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE); }
+
+int Uring::submit()
+{
+    // publish the sqes filled by getSqe
+    __atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+    unsigned n = pending();
+    if (!n)
+    {
+        return 0;
+    }
+    int ret = io_uring_enter(fd_, n, 0, 0);
+    return ret < 0 ? -errno : ret;
+}
+
+bool Uring::flushOverflow()
+{
+#ifdef IORING_SQ_CQ_OVERFLOW
+    if (__atomic_load_n(sqFlags_, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW)
+    {
+        return io_uring_enter(fd_, 0, 0, IORING_ENTER_GETEVENTS) >= 0;
+    }
+#endif
+    return false;
+}
+
+}  // namespace easy
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef __EASY_URING_H__
+#define __EASY_URING_H__
+
+#include "easy/base/noncopyable.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef EASY_HAS_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+namespace easy
+{
+#ifdef EASY_HAS_IO_URING
+
+// io_uring over the raw syscalls, no liburing
+// the caller serializes getSqe/submit and reap with its own locks
+class Uring : noncopyable
+{
+  public:
+    explicit Uring(unsigned entries);
+
+    ~Uring();
+
+    // false if the kernel has no io_uring or lacks an opcode the IOManager needs
+    bool valid() const { return fd_ >= 0; }
+
+    int fd() const { return fd_; }
+
+    // zeroed sqe at the tail of the submission queue, nullptr if the queue is full
+    io_uring_sqe* getSqe();
+
+    // sqes queued but not consumed by the kernel yet
+    unsigned pending() const;
+
+    // free slots in the submission queue
+    unsigned space() const { return sqEntries_ - pending(); }
+
+    // io_uring_enter for all pending sqes, the number submitted or -errno
+    int submit();
+
+    // f(const io_uring_cqe&) for each completion, returns the number reaped
+    template <typename F>
+    size_t reap(F&& f)
+    {
+        size_t n = 0;
+        do
+        {
+            unsigned head = *cqHead_;
+            unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head, ++n)
+            {
+                f(cqes_[head & cqMask_]);
+            }
+            __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+        } while (flushOverflow());
+        return n;
+    }
+
+  private:
+    bool probe();
+
+    // the cq ring was full and the kernel kept completions aside, move them to the ring
+    bool flushOverflow();
+
+    // unmap and close, valid() is false afterwards
+    void release();
+
+  private:
+    int           fd_{-1};
+    void*         ring_{nullptr};  // sq and cq rings, one mapping with IORING_FEAT_SINGLE_MMAP
+    size_t        ringSize_{0};
+    void*         cqRing_{nullptr};  // separate mapping on old kernels
+    size_t        cqRingSize_{0};
+    io_uring_sqe* sqes_{nullptr};
+    size_t        sqesSize_{0};
+
+    unsigned* sqHead_{nullptr};
+    unsigned* sqTail_{nullptr};
+    unsigned* sqArray_{nullptr};
+    unsigned* sqFlags_{nullptr};
+    unsigned  sqMask_{0};
+    unsigned  sqEntries_{0};
+    unsigned  sqLocalTail_{0};
+
+    unsigned*     cqHead_{nullptr};
+    unsigned*     cqTail_{nullptr};
+    unsigned      cqMask_{0};
+    io_uring_cqe* cqes_{nullptr};
+};
+
+#else
+
+// built without <linux/io_uring.h>, the IOManager stays on epoll
+class Uring : noncopyable
+{
+  public:
+    bool valid() const { return false; }
+
+    int fd() const { return -1; }
+};
+
+#endif
+
+}  // namespace easy
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef __EASY_WORK_STEALING_QUEUE_H__
+#define __EASY_WORK_STEALING_QUEUE_H__
+
+#include "easy/base/noncopyable.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace easy
+{
+// bounded Chase-Lev deque, push/pop by the owner thread at the bottom, steal by any thread at the top
+// see "Correct and Efficient Work-Stealing for Weak Memory Models", Le et al. PPoPP'13
+template <typename T, size_t Capacity = 256>
+class WorkStealingQueue : noncopyable
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity should be a power of 2");
+
+  public:
+    WorkStealingQueue()
+    {
+        for (size_t i = 0; i < Capacity; ++i)
+        {
+            buffer_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    // owner only, false if full
+    bool push(T* item)
+    {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        if (b - t >= static_cast<int64_t>(Capacity))
+        {
+            return false;
+        }
+        buffer_[static_cast<size_t>(b) & kMask].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // owner only, LIFO
+    T* pop()
+    {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        if (t > b)
+        {
+            // empty
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T* item = buffer_[static_cast<size_t>(b) & kMask].load(std::memory_order_relaxed);
+        if (t == b)
+        {
+            // last item, race against thieves
+            if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                item = nullptr;
+            }
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // any thread, FIFO, nullptr if empty or lost the race
+    T* steal()
+    {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b)
+        {
+            return nullptr;
+        }
+        T* item = buffer_[static_cast<size_t>(t) & kMask].load(std::memory_order_relaxed);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        return item;
+    }
+
+    // approximate when called by a thief
+    size_t size() const
+    {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        return b > t ? static_cast<size_t>(b - t) : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+  private:
+    static const size_t kMask = Capacity - 1;
+
+    static const size_t kCacheLine = 64;
+
+    // top_ is written by thieves, bottom_ by the owner, keep them on different cache lines
+    std::atomic<int64_t> top_{0};
+    char                 pad0_[kCacheLine - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> bottom_{0};
+    char                 pad1_[kCacheLine - sizeof(std::atomic<int64_t>)];
+    std::atomic<T*>      buffer_[Capacity];
+};
+
+}  // namespace easy
+
+#endif
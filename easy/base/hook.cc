@@ -1,5 +1,6 @@
 #include "easy/base/hook.h"
 #include "easy/base/Config.h"
+#include "easy/base/Deadline.h"
 #include "easy/base/FdManager.h"
 #include "easy/base/IOManager.h"
 #include "easy/base/Logger.h"
@@ -12,6 +13,7 @@
 #include <stdarg.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <algorithm>
 #include <cstdint>
 #include <functional>
 #include <memory>
@@ -24,6 +26,9 @@ namespace easy
 
 static ConfigVar<uint64_t>::ptr tcp_connect_timeout = Config::Lookup("tcp.connect.timeout", 5000UL, "tcp connect timeout");
 
+static ConfigVar<uint64_t>::ptr tcp_timeout_slack = Config::Lookup(
+    "tcp.timeout_slack", 0UL, "ms a socket or connect timeout may fire late, timeouts due within it expire in one wakeup, 0 for exact");
+
 static __thread bool t_hook_enable = false;
 
 #define HOOK_FUN(XX) \
@@ -66,6 +71,7 @@ void HookInit()
 }
 
 static uint64_t s_connect_timeout = -1UL;
+static uint64_t s_timeout_slack   = 0;
 
 struct __HookIniter
 {
@@ -77,6 +83,11 @@ struct __HookIniter
             ELOG_DEBUG(logger) << "tcp connect timeout changed from " << old_val << " to " << new_val;
             s_connect_timeout = new_val;
         });
+        s_timeout_slack = tcp_timeout_slack->value();
+        tcp_timeout_slack->addListener([](const uint64_t& old_val, const uint64_t& new_val) {
+            ELOG_DEBUG(logger) << "tcp timeout slack changed from " << old_val << " to " << new_val;
+            s_timeout_slack = new_val;
+        });
     }
 };
 
@@ -88,11 +99,112 @@ void SetHookEnable(bool flag) { t_hook_enable = flag; }
 
 }  // namespace easy
 
+// the timeout of a parked hooked call, lives on the stack of its fiber with the Timer, no allocation
 struct timer_info
 {
-    bool cancelled = 0;
+    easy::IOManager* iom;
+    int              fd;
+    uint32_t         event;
+    int              cancelled;  // errno for the call
 };
 
+static void OnIoCancel(void* arg, int error)
+{
+    timer_info* t = static_cast<timer_info*>(arg);
+    __sync_bool_compare_and_swap(&t->cancelled, 0, error);  // before the fiber can resume
+    t->iom->cancelEvent(t->fd, static_cast<easy::Channel::Event>(t->event));
+}
+
+static void OnIoTimeout(void* arg) { OnIoCancel(arg, ETIMEDOUT); }
+
+// parks the fiber until fd is ready for event, the socket timeout ms passed or the Deadline of the fiber ends
+// returns what addEvent did, cancelled is 0 or the errno of a timeout or cancel
+static int wait_event(easy::IOManager* iom, int fd, uint32_t event, uint64_t ms, int& cancelled)
+{
+    timer_info      tinfo    = {iom, fd, event, 0};
+    easy::Timer     timer;
+    easy::Deadline* deadline = easy::Fiber::CurrentDeadline();
+    if (deadline && !deadline->park(&OnIoCancel, &tinfo))
+    {
+        cancelled = deadline->error();
+        return 0;
+    }
+    // the timer of the deadline covers every call, the socket timeout needs one only when it ends first
+    bool timed = ms != -1UL && (!deadline || ms < deadline->remaining());
+    if (timed)
+    {
+        iom->armTimer(timer, ms, &OnIoTimeout, &tinfo, easy::s_timeout_slack);
+    }
+    int ret = iom->addEvent(fd, static_cast<easy::Channel::Event>(event));
+    if (ret == 0)
+    {
+        if (__atomic_load_n(&tinfo.cancelled, __ATOMIC_ACQUIRE))
+        {
+            iom->cancelEvent(fd, static_cast<easy::Channel::Event>(event));  // fired before the event was there
+        }
+        easy::Fiber::YieldToHold();
+    }
+    if (timed)
+    {
+        iom->disarmTimer(timer);  // waits for OnIoTimeout if it is running
+    }
+    if (deadline)
+    {
+        deadline->unpark();
+    }
+    cancelled = ret == 0 ? tinfo.cancelled : 0;
+    return ret;
+}
+
+// io_uring mode, the io is handed to the kernel and the completion is the result
+// -1 and errno ENOSYS for the functions without an io_uring path, they wait on epoll
+template <typename OriginFunC, typename... Args>
+static ssize_t uring_io(easy::IOManager*, OriginFunC, int, uint64_t, Args&&...)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static ssize_t uring_io(easy::IOManager* iom, read_fun, int fd, uint64_t ms, void* buf, size_t count)
+{
+    return iom->uringIo(easy::IOManager::IO_READ, fd, buf, count, 0, ms);
+}
+
+static ssize_t uring_io(easy::IOManager* iom, write_fun, int fd, uint64_t ms, const void* buf, size_t count)
+{
+    return iom->uringIo(easy::IOManager::IO_WRITE, fd, const_cast<void*>(buf), count, 0, ms);
+}
+
+static ssize_t uring_io(easy::IOManager* iom, recv_fun, int fd, uint64_t ms, void* buf, size_t len, int flags)
+{
+    return iom->uringIo(easy::IOManager::IO_RECV, fd, buf, len, flags, ms);
+}
+
+static ssize_t uring_io(easy::IOManager* iom, send_fun, int fd, uint64_t ms, const void* buf, size_t len, int flags)
+{
+    return iom->uringIo(easy::IOManager::IO_SEND, fd, const_cast<void*>(buf), len, flags, ms);
+}
+
+static ssize_t uring_io(easy::IOManager* iom, accept_fun, int fd, uint64_t ms, struct sockaddr* addr, socklen_t* addrlen)
+{
+    // a multishot accept does not report the peer
+    int s = iom->uringAccept(fd, ms);
+    if (s >= 0 && addr && addrlen)
+    {
+        getpeername(s, addr, addrlen);
+    }
+    return s;
+}
+
+// the multishot accept takes connections off the backlog as they come, a nonblocking accept first would mostly miss
+template <typename OriginFunC>
+static bool uring_first(OriginFunC)
+{
+    return false;
+}
+
+static bool uring_first(accept_fun) { return true; }
+
 template <typename OriginFunC, typename... Args>
 static ssize_t do_io(int fd, OriginFunC func, const char* hook_fun_name, uint32_t event, int timeout_so, Args&&... args)
 {
@@ -114,10 +226,27 @@ static ssize_t do_io(int fd, OriginFunC func, const char* hook_fun_name, uint32_
     {
         return func(fd, std::forward<Args>(args)...);
     }
-    uint64_t ms    = ctx->getTimeout(timeout_so);
-    auto     tinfo = std::make_shared<timer_info>();
-
-    ssize_t n = 0;
+    easy::Deadline* deadline = easy::Fiber::CurrentDeadline();
+    if (deadline && deadline->error())
+    {
+        errno = deadline->error();
+        return -1;
+    }
+    uint64_t ms = ctx->getTimeout(timeout_so);
+    ssize_t  n  = 0;
+    if (uring_first(func))
+    {
+        easy::IOManager* iom = easy::IOManager::GetThis();
+        if (iom && iom->uringEnabled())
+        {
+            // a cancel does not reach a submitted io, it sees the deadline only
+            n = uring_io(iom, func, fd, deadline ? std::min(ms, deadline->remaining()) : ms, args...);
+            if (n != -1 || errno != ENOSYS)
+            {
+                return n;
+            }
+        }
+    }
 
 retry:
     n = func(fd, std::forward<Args>(args)...);
@@ -127,48 +256,29 @@ retry:
     }
     if (n == -1 && errno == EAGAIN)
     {
-        easy::IOManager*          iom = easy::IOManager::GetThis();
-        easy::Timer::ptr          timer;
-        std::weak_ptr<timer_info> winfo(tinfo);
-        if (ms != -1UL)
-        {
-            timer = iom->addConditionTimer(
-                ms,
-                [winfo, fd, iom, event]() {
-                    auto t = winfo.lock();
-                    if (!t || t->cancelled)
-                    {
-                        return;
-                    }
-                    t->cancelled = ETIMEDOUT;
-                    iom->cancelEvent(fd, static_cast<easy::Channel::Event>(event));
-                },
-                winfo);
-        }
-        int ret = iom->addEvent(fd, static_cast<easy::Channel::Event>(event));
-        if (EASY_UNLIKELY(ret))
+        easy::IOManager* iom = easy::IOManager::GetThis();
+        if (iom->uringEnabled())
         {
-            ELOG_ERROR(logger) << hook_fun_name << " addEvent(" << fd << ", " << event << ")";
-            if (timer)
+            ssize_t ret = uring_io(iom, func, fd, deadline ? std::min(ms, deadline->remaining()) : ms, args...);
+            if (ret != -1 || errno != ENOSYS)
             {
-                timer->cancel();
+                return ret;
             }
+        }
+        int cancelled = 0;
+        int ret       = wait_event(iom, fd, event, ms, cancelled);
+        if (EASY_UNLIKELY(ret < 0))
+        {
+            ELOG_ERROR(logger) << hook_fun_name << " addEvent(" << fd << ", " << event << ")";
             return -1;
         }
-        else
+        if (cancelled)
         {
-            easy::Fiber::YieldToHold();
-            if (timer)
-            {
-                timer->cancel();
-            }
-            if (tinfo->cancelled)
-            {
-                errno = tinfo->cancelled;
-                return -1;
-            }
-            goto retry;
+            errno = cancelled;
+            return -1;
         }
+        // persistent mode, the edge came in between, or woken
+        goto retry;
     }
     return n;
 }
@@ -186,11 +296,13 @@ extern "C"
             return sleep_f(seconds);
         }
 
-        easy::Fiber::ptr co  = easy::Fiber::GetThis();
-        easy::IOManager* iom = easy::IOManager::GetThis();
-        iom->addTimer(seconds * 1000,
-            std::bind(static_cast<void (easy::Scheduler::*)(easy::Fiber::ptr, int threadId)>(&easy::IOManager::schedule), iom, co, -1));
-        easy::Fiber::YieldToHold();
+        easy::Timestamp start = easy::Timestamp::now(easy::Timestamp::MONOTONIC);
+        if (easy::Fiber::SleepFor(seconds * 1000UL))
+        {
+            // the seconds left
+            int64_t slept = easy::Timestamp::now(easy::Timestamp::MONOTONIC).microSecondsSinceEpoch() - start.microSecondsSinceEpoch();
+            return seconds - std::min(seconds, static_cast<unsigned int>(slept / 1000 / 1000));
+        }
         return 0;
     }
 
@@ -201,11 +313,11 @@ extern "C"
             return usleep_f(usec);
         }
 
-        easy::Fiber::ptr co  = easy::Fiber::GetThis();
-        easy::IOManager* iom = easy::IOManager::GetThis();
-        iom->addTimer(
-            usec / 1000, std::bind(static_cast<void (easy::Scheduler::*)(easy::Fiber::ptr, int threadId)>(&easy::IOManager::schedule), iom, co, -1));
-        easy::Fiber::YieldToHold();
+        if (int error = easy::Fiber::SleepFor(usec / 1000))
+        {
+            errno = error;
+            return -1;
+        }
         return 0;
     }
 
@@ -216,12 +328,21 @@ extern "C"
             return nanosleep_f(req, rem);
         }
 
-        uint64_t         timeout_ms = static_cast<uint64_t>(req->tv_sec * 1000 + req->tv_nsec / 1000 / 1000);
-        easy::Fiber::ptr co         = easy::Fiber::GetThis();
-        easy::IOManager* iom        = easy::IOManager::GetThis();
-        iom->addTimer(
-            timeout_ms, std::bind(static_cast<void (easy::Scheduler::*)(easy::Fiber::ptr, int threadId)>(&easy::IOManager::schedule), iom, co, -1));
-        easy::Fiber::YieldToHold();
+        uint64_t        timeout_ms = static_cast<uint64_t>(req->tv_sec * 1000 + req->tv_nsec / 1000 / 1000);
+        easy::Timestamp start      = easy::Timestamp::now(easy::Timestamp::MONOTONIC);
+        if (int error = easy::Fiber::SleepFor(timeout_ms))
+        {
+            if (rem)
+            {
+                int64_t left = req->tv_sec * 1000 * 1000 + req->tv_nsec / 1000 -
+                               (easy::Timestamp::now(easy::Timestamp::MONOTONIC).microSecondsSinceEpoch() - start.microSecondsSinceEpoch());
+                left         = std::max(left, static_cast<int64_t>(0));
+                rem->tv_sec  = static_cast<time_t>(left / 1000 / 1000);
+                rem->tv_nsec = static_cast<long>(left % (1000 * 1000) * 1000);
+            }
+            errno = error;
+            return -1;
+        }
         return 0;
     }
 
@@ -265,6 +386,21 @@ extern "C"
         {
             return connect_f(fd, addr, addrlen);
         }
+        easy::Deadline* deadline = easy::Fiber::CurrentDeadline();
+        if (deadline && deadline->error())
+        {
+            errno = deadline->error();
+            return -1;
+        }
+        easy::IOManager* iom = easy::IOManager::GetThis();
+        if (iom && iom->uringEnabled())
+        {
+            int ret = iom->uringConnect(fd, addr, addrlen, deadline ? std::min(timeout_ms, deadline->remaining()) : timeout_ms);
+            if (ret != -1 || errno != ENOSYS)
+            {
+                return ret;
+            }
+        }
         int n = connect_f(fd, addr, addrlen);
         if (n == 0)
         {
@@ -277,49 +413,17 @@ extern "C"
             return n;
         }
         // n == -1 && errno == EINPROGRESS
-        easy::IOManager*          iom = easy::IOManager::GetThis();
-        easy::Timer::ptr          timer;
-        auto                      tinfo = std::make_shared<timer_info>();
-        std::weak_ptr<timer_info> winfo(tinfo);
-        if (timeout_ms != -1UL)
-        {
-            timer = iom->addConditionTimer(
-                timeout_ms,
-                [winfo, fd, iom]() {
-                    auto t = winfo.lock();
-                    if (!t || t->cancelled)
-                    {
-                        return;
-                    }
-                    t->cancelled = ETIMEDOUT;
-                    iom->cancelEvent(fd, easy::Channel::WRITE);
-                },
-                winfo);
-        }
-
-        int ret = iom->addEvent(fd, easy::Channel::WRITE);
-
-        if (EASY_UNLIKELY(ret))
+        int cancelled = 0;
+        int ret       = wait_event(iom, fd, easy::Channel::WRITE, timeout_ms, cancelled);
+        if (EASY_UNLIKELY(ret < 0))
         {
             // add event failed
-            if (timer)
-            {
-                timer->cancel();
-            }
             ELOG_ERROR(logger) << "connect addEvent(" << fd << ", WRITE) error";
         }
-        else
+        else if (cancelled)
         {
-            easy::Fiber::YieldToHold();
-            if (timer)
-            {
-                timer->cancel();
-            }
-            if (tinfo->cancelled)
-            {
-                errno = tinfo->cancelled;
-                return -1;
-            }
+            errno = cancelled;
+            return -1;
         }
         // 1. connect error, socketfd can be WRITE and READ
         // 2. connect success, socketfd can be WRITE
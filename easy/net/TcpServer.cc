@@ -78,7 +78,8 @@ void TcpServer::startAccept(Socket::ptr sock)
         if (client)
         {
             client->setRecvTimeout(static_cast<int64_t>(recvTimeout_));
-            io_worker_->schedule(std::bind(&TcpServer::handleClient, shared_from_this(), client));
+            // with loop per thread, connections are spread over the loops and stay there
+            io_worker_->schedule(std::bind(&TcpServer::handleClient, shared_from_this(), client), io_worker_->nextLoopThread());
         }
         else
         {
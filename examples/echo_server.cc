@@ -1,3 +1,5 @@
+#include "easy/base/Config.h"
+#include "easy/base/IOManager.h"
 #include "easy/base/Logger.h"
 #include "easy/net/Buffer.h"
 #include "easy/net/TcpServer.h"
@@ -33,7 +35,9 @@ void EchoServer::handleClient(easy::Socket::ptr client)
         int rt = client->recv(&iovs[0], iovs.size());
         if (rt == 0)
         {
-            ELOG_INFO(logger) << "client close: " << *client;
+            easy::IOManager::Stats stats = easy::IOManager::GetStats();
+            ELOG_INFO(logger) << "client close: " << *client << " epoll_wait=" << stats.epollWaits << " epoll_ctl=" << stats.epollCtls
+                              << " weakup=" << stats.wakeups;
             break;
         }
         else if (rt < 0)
@@ -73,7 +77,7 @@ int main(int argc, char** argv)
 {
     if (argc < 2)
     {
-        ELOG_INFO(logger) << "used as[" << argv[0] << " -t] or [" << argv[0] << " -b]";
+        ELOG_INFO(logger) << "used as[" << argv[0] << " -t] or [" << argv[0] << " -b], append -p for persistent epoll registration";
         return 0;
     }
 
@@ -81,6 +85,10 @@ int main(int argc, char** argv)
     {
         type = 2;
     }
+    if (argc > 2 && !strcmp(argv[2], "-p"))
+    {
+        easy::Config::Lookup<bool>("iomanager.persistent_events")->setValue(true);
+    }
 
     easy::IOManager iom(2);
     iom.schedule(run);
@@ -0,0 +1,22 @@
+#include "easy/base/BinaryLog.h"
+
+#include <iostream>
+#include <string>
+
+// the text of a log file written by an AsyncFileLogAppender in binary mode
+// usage: log_decoder <file> [pattern]
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: " << argv[0] << " <file> [pattern]" << std::endl;
+        return 1;
+    }
+    easy::BinaryLogDecoder decoder(argc > 2 ? argv[2] : "");
+    if (!decoder.decode(argv[1], std::cout))
+    {
+        std::cerr << argv[1] << ": not read to the end, " << decoder.records() << " records" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,5 +1,13 @@
+#include "easy/base/Config.h"
+#include "easy/base/Context.h"
 #include "easy/base/Fiber.h"
 #include "easy/base/Logger.h"
+#include "easy/base/StackAllocator.h"
+#include "easy/base/Timestamp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 static easy::Logger::ptr logger = ELOG_ROOT();
 
@@ -25,8 +33,101 @@ void test_fiber()
     ELOG_INFO(logger) << "main after end";
 }
 
+void use_stack()
+{
+    char buf[32 * 1024];
+    memset(buf, 'x', sizeof(buf));
+    ELOG_INFO(logger) << "use_stack " << buf[sizeof(buf) - 1];
+}
+
+void test_stack_usage()
+{
+    easy::Fiber::GetThis();
+    easy::Fiber::ptr fiber(easy::NewFiber(use_stack), easy::FreeFiber);
+    ELOG_INFO(logger) << "before run high_water=" << fiber->stackHighWater() << " stack_size=" << fiber->stackSize();
+    fiber->resume();
+    ELOG_INFO(logger) << "after run high_water=" << fiber->stackHighWater() << " stack_size=" << fiber->stackSize();
+}
+
+template <typename Context>
+struct SwitchBench
+{
+    static Context main_;
+    static Context co_;
+
+    static void PingPong()
+    {
+        while (true)
+        {
+            Context::Swap(&co_, &main_);
+        }
+    }
+};
+
+template <typename Context>
+Context SwitchBench<Context>::main_;
+
+template <typename Context>
+Context SwitchBench<Context>::co_;
+
+template <typename Context>
+void bench(const char* name)
+{
+    typedef SwitchBench<Context> Bench;
+
+    const size_t kStackSize = 64 * 1024;
+    void*        stack      = malloc(kStackSize);
+    Bench::co_.make(stack, kStackSize, &Bench::PingPong);
+
+    size_t          n     = 1000 * 1000;
+    easy::Timestamp start = easy::Timestamp::now();
+    for (size_t i = 0; i < n; ++i)
+    {
+        Context::Swap(&Bench::main_, &Bench::co_);  // 2 switches per round trip
+    }
+    easy::Timestamp end     = easy::Timestamp::now();
+    double          seconds = static_cast<double>(end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1000 / 1000;
+    printf("%12s:%f seconds, %ld switches, %12.2f switches/s\n", name, seconds, 2 * n, static_cast<double>(2 * n) / seconds);
+    free(stack);
+}
+
+void bench_new_fiber()
+{
+    easy::Fiber::GetThis();
+    size_t          n     = 100 * 1000;
+    easy::Timestamp start = easy::Timestamp::now();
+    for (size_t i = 0; i < n; ++i)
+    {
+        easy::Fiber::ptr fiber(easy::NewFiber([]() {}), easy::FreeFiber);
+        fiber->resume();
+    }
+    easy::Timestamp end     = easy::Timestamp::now();
+    double          seconds = static_cast<double>(end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1000 / 1000;
+
+    easy::StackPool::Stats stats = easy::StackPool::GetStats();
+    printf("%12s:%f seconds, %ld fibers, %12.2f fibers/s, thread_hits=%lu global_hits=%lu misses=%lu releases=%lu max_high_water=%lu\n",
+        "new_fiber",
+        seconds,
+        n,
+        static_cast<double>(n) / seconds,
+        stats.threadHits,
+        stats.globalHits,
+        stats.misses,
+        stats.releases,
+        stats.maxHighWater);
+}
+
 int main()
 {
+    easy::Config::Lookup<bool>("fiber.stack_pool.lazy_commit")->setValue(true);
     test_fiber();
+    test_stack_usage();
+    bench<easy::UContext>("ucontext");
+#ifdef EASY_HAS_ASM_CONTEXT
+    bench<easy::AsmContext>("asm");
+#endif
+    logger->setLevel(easy::LogLevel::INFO);
+    ELOG_NAME("system")->setLevel(easy::LogLevel::INFO);
+    bench_new_fiber();
     return 0;
 }
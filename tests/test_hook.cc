@@ -1,14 +1,37 @@
+#include "easy/base/Deadline.h"
+#include "easy/base/FdManager.h"
 #include "easy/base/IOManager.h"
 #include "easy/base/Logger.h"
+#include "easy/base/Timestamp.h"
 #include "easy/base/hook.h"
 
 #include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <atomic>
 #include <cerrno>
 #include <cstddef>
+#include <new>
+
+// count every operator new of the process to show allocations per blocked read
+static std::atomic<uint64_t> s_allocs{0};
+
+void* operator new(size_t size)
+{
+    s_allocs.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
 
 static easy::Logger::ptr g_logger = ELOG_ROOT();
 
@@ -70,8 +93,188 @@ void test_sock()
     ELOG_INFO(g_logger) << buff;
 }
 
+void test_read_timeout()
+{
+    easy::IOManager iom(1);
+    iom.schedule([]() {
+        int fds[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        easy::FdMgr::GetInstance()->getFdCtx(fds[0], true);
+        struct timeval tv = {0, 50 * 1000};
+        setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        char            c     = 0;
+        easy::Timestamp start = easy::Timestamp::now();
+        ssize_t         n     = read(fds[0], &c, 1);
+        int64_t         us    = easy::Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch();
+        ELOG_INFO(g_logger) << "read with SO_RCVTIMEO 50ms n=" << n << " errno=" << errno << " " << strerror(errno) << " after " << us << "us";
+        close(fds[0]);
+        close(fds[1]);
+    });
+}
+
+void test_deadline()
+{
+    easy::IOManager iom(1);
+    iom.schedule([]() {
+        int fds[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        easy::FdMgr::GetInstance()->getFdCtx(fds[0], true);
+        struct timeval tv = {1, 0};
+        setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        int peer = fds[1];
+        easy::IOManager::GetThis()->schedule([peer]() {
+            for (int i = 0; i < 2; ++i)
+            {
+                usleep(40 * 1000);
+                if (write(peer, "x", 1) != 1)
+                {
+                    return;
+                }
+            }
+        });
+
+        char            c     = 0;
+        easy::Timestamp start = easy::Timestamp::now();
+        {
+            // every read has SO_RCVTIMEO 1s, all of them together 100ms
+            easy::Deadline deadline(100);
+            for (int i = 0; i < 3; ++i)
+            {
+                ssize_t n  = read(fds[0], &c, 1);
+                int64_t us = easy::Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch();
+                ELOG_INFO(g_logger) << "read " << i << " in a 100ms deadline n=" << n << " errno=" << (n < 0 ? errno : 0) << " after " << us << "us";
+            }
+        }
+        {
+            easy::Deadline deadline;
+            easy::IOManager::GetThis()->schedule([&deadline]() {
+                usleep(30 * 1000);
+                deadline.cancel();
+            });
+            start      = easy::Timestamp::now();
+            ssize_t n  = read(fds[0], &c, 1);
+            int64_t us = easy::Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch();
+            ELOG_INFO(g_logger) << "read cancelled after 30ms n=" << n << " errno=" << errno << " " << strerror(errno) << " after " << us << "us";
+        }
+        {
+            easy::Deadline deadline(50);
+            start      = easy::Timestamp::now();
+            int     rt = usleep(500 * 1000);
+            int64_t us = easy::Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch();
+            ELOG_INFO(g_logger) << "usleep 500ms in a 50ms deadline rt=" << rt << " errno=" << errno << " after " << us << "us";
+        }
+        close(fds[0]);
+        close(fds[1]);
+    });
+}
+
+void bench_blocked_read()
+{
+    // ping pong over a socketpair, every read finds nothing first and parks with its SO_RCVTIMEO timeout
+    const size_t kRounds = 100 * 1000;
+    const size_t kWarmUp = 1000;
+    int          fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    uint64_t        allocs = 0;
+    easy::Timestamp start;
+    easy::Timestamp end;
+    {
+        easy::IOManager iom(1, false, "pingpong");
+        for (int side = 0; side < 2; ++side)
+        {
+            iom.schedule([&, side]() {
+                int fd = fds[side];
+                easy::FdMgr::GetInstance()->getFdCtx(fd, true);
+                struct timeval tv = {5, 0};
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+                char c = 'x';
+                if (side == 0 && write(fd, &c, 1) != 1)
+                {
+                    return;
+                }
+                for (size_t i = 0; i < kRounds; ++i)
+                {
+                    if (side == 1 && i == kWarmUp)
+                    {
+                        allocs = s_allocs.load();
+                        start  = easy::Timestamp::now();
+                    }
+                    bool reply = side == 1 || i + 1 < kRounds;
+                    if (read(fd, &c, 1) != 1 || (reply && write(fd, &c, 1) != 1))
+                    {
+                        ELOG_ERROR(g_logger) << "pingpong errno=" << errno;
+                        return;
+                    }
+                }
+                if (side == 1)
+                {
+                    allocs = s_allocs.load() - allocs;
+                    end    = easy::Timestamp::now();
+                }
+            });
+        }
+    }
+    close(fds[0]);
+    close(fds[1]);
+    double reads   = static_cast<double>(kRounds - kWarmUp) * 2;
+    double seconds = static_cast<double>(end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1000 / 1000;
+    printf("%12s:%f seconds, %12.2f blocked reads/s, %.3f allocations per blocked read\n",
+        "pingpong",
+        seconds,
+        reads / seconds,
+        static_cast<double>(allocs) / reads);
+}
+
+void bench_sleep(bool fiber_sleep)
+{
+    // pacing loops, every fiber sleeps and wakes again and again
+    const size_t kFibers = 100;
+    const size_t    kSleeps = 2000;
+    uint64_t        allocs  = s_allocs.load();
+    easy::Timestamp start   = easy::Timestamp::now();
+    {
+        easy::IOManager iom(1, false, "sleep");
+        for (size_t f = 0; f < kFibers; ++f)
+        {
+            iom.schedule([fiber_sleep, kSleeps]() {
+                for (size_t i = 0; i < kSleeps; ++i)
+                {
+                    if (fiber_sleep)
+                    {
+                        easy::Fiber::SleepFor(0);
+                        continue;
+                    }
+                    // what the hooked usleep did before
+                    easy::IOManager* self = easy::IOManager::GetThis();
+                    self->addTimer(
+                        0,
+                        std::bind(static_cast<void (easy::Scheduler::*)(easy::Fiber::ptr, int)>(&easy::IOManager::schedule), self, easy::Fiber::GetThis(), -1),
+                        false,
+                        true);
+                    easy::Fiber::YieldToHold();
+                }
+            });
+        }
+    }
+    easy::Timestamp end     = easy::Timestamp::now();
+    double          sleeps  = static_cast<double>(kFibers * kSleeps);
+    double          seconds = static_cast<double>(end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1000 / 1000;
+    printf("%12s:%f seconds, %12.2f sleeps/s, %.3f allocations per sleep\n",
+        fiber_sleep ? "SleepFor" : "addTimer",
+        seconds,
+        sleeps / seconds,
+        static_cast<double>(s_allocs.load() - allocs) / sleeps);
+}
+
 int main(int argc, char** argv)
 {
+    test_read_timeout();
+    test_deadline();
+    g_logger->setLevel(easy::LogLevel::INFO);
+    ELOG_NAME("system")->setLevel(easy::LogLevel::INFO);
+    bench_blocked_read();
+    bench_sleep(false);
+    bench_sleep(true);
     test_sleep();
     easy::IOManager iom;
     iom.schedule(test_sock);
@@ -1,5 +1,17 @@
+#include "easy/base/Config.h"
+#include "easy/base/FdManager.h"
 #include "easy/base/IOManager.h"
 #include "easy/base/Logger.h"
+#include "easy/base/Macro.h"
+#include "easy/base/Timestamp.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
 
 static easy::Logger::ptr logger = ELOG_ROOT();
 
@@ -24,8 +36,555 @@ void             test_timer()
         true);
 }
 
+void test_inline_timer()
+{
+    easy::IOManager iom(1);
+    iom.addTimer(
+        10, []() { ELOG_INFO(logger) << "inline timer in_inline=" << easy::Scheduler::InInlineTask(); }, false, true);
+    // hooks are off inside, this really blocks the thread and gets reported
+    iom.addTimer(
+        20, []() { usleep(20 * 1000); }, false, true);
+}
+
+void test_timer_wheel()
+{
+    // the intervals cross the level 0 and level 1 boundaries of the wheel
+    easy::Config::Lookup<std::string>("timer.queue")->setValue("wheel");
+    {
+        easy::IOManager iom(1, false, "wheel");
+        easy::Timestamp start = easy::Timestamp::now();
+        for (uint64_t ms : {1, 5, 63, 64, 65, 200, 1000, 4100})
+        {
+            iom.addTimer(ms, [start, ms]() {
+                int64_t elapsed = (easy::Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1000;
+                ELOG_INFO(logger) << "wheel timer " << ms << "ms fired after " << elapsed << "ms";
+            });
+        }
+        iom.addTimer(3000, []() { ELOG_ERROR(logger) << "cancelled wheel timer fired"; })->cancel();
+    }
+    easy::Config::Lookup<std::string>("timer.queue")->setValue("set");
+}
+
+void test_loop_per_thread()
+{
+    easy::Config::Lookup<bool>("iomanager.loop_per_thread")->setValue(true);
+    {
+        easy::IOManager iom(3, false, "loop");
+        for (int i = 0; i < 6; ++i)
+        {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+            {
+                ELOG_ERROR(logger) << "socketpair errno=" << errno;
+                return;
+            }
+            easy::FdMgr::GetInstance()->getFdCtx(fds[0], true);
+            iom.schedule(
+                [fds]() {
+                    int     tid = easy::Thread::GetCurrentThreadId();
+                    char    c   = 0;
+                    ssize_t n   = read(fds[0], &c, 1);  // parks in the loop of this thread
+                    ELOG_INFO(logger) << "read n=" << n << " parked on " << tid << " resumed on " << easy::Thread::GetCurrentThreadId();
+                    close(fds[0]);
+                },
+                iom.nextLoopThread());
+            iom.addTimer(50, [fds]() {
+                ssize_t n = write(fds[1], "x", 1);
+                ELOG_DEBUG(logger) << "write n=" << n;
+                close(fds[1]);
+            });
+        }
+    }
+    easy::Config::Lookup<bool>("iomanager.loop_per_thread")->setValue(false);
+}
+
+void test_loop_timers()
+{
+    // shared timers with loop_per_thread, only the timer loop wakes up for them, the callbacks go back to the adding thread
+    easy::Config::Lookup<bool>("iomanager.loop_per_thread")->setValue(true);
+    std::atomic<int> fired{0};
+    std::atomic<int> moved{0};
+    {
+        easy::IOManager iom(3, false, "loop_timers");
+        usleep(20 * 1000);  // the threads claim their loops
+        for (int i = 0; i < 6; ++i)
+        {
+            iom.schedule(
+                [&fired, &moved, i]() {
+                    int tid = easy::Thread::GetCurrentThreadId();
+                    easy::IOManager::GetThis()->addTimer(20 + i, [&fired, &moved, tid]() {
+                        moved += tid != easy::Thread::GetCurrentThreadId();
+                        ++fired;
+                    });
+                },
+                iom.nextLoopThread());
+        }
+    }
+    ELOG_INFO(logger) << "loop timers fired=" << fired << " on another thread=" << moved;
+    EASY_ASSERT(fired == 6 && moved == 0);
+    easy::Config::Lookup<bool>("iomanager.loop_per_thread")->setValue(false);
+}
+
+void test_per_thread_timers()
+{
+    easy::Config::Lookup<bool>("iomanager.loop_per_thread")->setValue(true);
+    easy::Config::Lookup<bool>("iomanager.per_thread_timers")->setValue(true);
+    {
+        easy::IOManager               iom(3, false, "local");
+        std::vector<easy::Timer::ptr> timers(3);
+        easy::MutexLock               mutex;
+        for (size_t i = 0; i < timers.size(); ++i)
+        {
+            iom.schedule(
+                [&, i]() {
+                    int tid = easy::Thread::GetCurrentThreadId();
+                    easy::MutexLockGuard _(mutex);
+                    timers[i] = easy::IOManager::GetThis()->addTimer(
+                        100 + i * 10,
+                        [tid, i]() {
+                            ELOG_INFO(logger) << "local timer " << i << " added on " << tid << " fired on " << easy::Thread::GetCurrentThreadId();
+                        },
+                        i == 2);
+                },
+                iom.nextLoopThread());
+        }
+        usleep(20 * 1000);  // not hooked, the caller is not in the IOManager
+        easy::MutexLockGuard _(mutex);
+        // from another thread, through the message queues
+        ELOG_INFO(logger) << "cross thread cancel=" << timers[0]->cancel() << " again=" << timers[0]->cancel();
+        ELOG_INFO(logger) << "cross thread reset=" << timers[1]->reset(10, true);
+        iom.addTimer(350, [&timers]() { ELOG_INFO(logger) << "cancel repeating=" << timers[2]->cancel(); });
+    }
+    easy::Config::Lookup<bool>("iomanager.per_thread_timers")->setValue(false);
+    easy::Config::Lookup<bool>("iomanager.loop_per_thread")->setValue(false);
+}
+
+void test_epoll_timers()
+{
+    easy::Config::Lookup<bool>("iomanager.epoll_timers")->setValue(true);
+    {
+        easy::IOManager iom(2, false, "epoll_timers");
+        easy::Timestamp start = easy::Timestamp::now();
+        // from outside the IOManager, the timerfd still shortens the wait of the sleeping threads
+        for (uint64_t ms : {1, 2, 5, 30})
+        {
+            iom.addTimer(ms, [start, ms]() {
+                int64_t elapsed = easy::Timestamp::now().microSecondsSinceEpoch() - start.microSecondsSinceEpoch();
+                ELOG_INFO(logger) << "epoll timer " << ms << "ms fired after " << elapsed << "us";
+            });
+        }
+        iom.schedule([]() {
+            // from a loop thread, only the epoll_wait timeout
+            easy::Timestamp added = easy::Timestamp::now();
+            easy::IOManager::GetThis()->addTimer(3, [added]() {
+                int64_t elapsed = easy::Timestamp::now().microSecondsSinceEpoch() - added.microSecondsSinceEpoch();
+                ELOG_INFO(logger) << "epoll timer 3ms added on a loop thread fired after " << elapsed << "us";
+            });
+        });
+    }
+    easy::Config::Lookup<bool>("iomanager.epoll_timers")->setValue(false);
+}
+
+void test_timer_clock(const char* clock)
+{
+    easy::Config::Lookup<std::string>("timer.clock")->setValue(clock);
+    {
+        easy::IOManager iom(1, false, clock);
+        iom.schedule([clock]() {
+            easy::Timestamp start = easy::Timestamp::now(easy::Timestamp::MONOTONIC);
+            easy::IOManager::GetThis()->addTimer(20, [clock, start]() {
+                int64_t elapsed = easy::Timestamp::now(easy::Timestamp::MONOTONIC).microSecondsSinceEpoch() - start.microSecondsSinceEpoch();
+                ELOG_INFO(logger) << clock << " clock 20ms timer fired after " << elapsed << "us";
+            });
+        });
+    }
+    easy::Config::Lookup<std::string>("timer.clock")->setValue("monotonic");
+}
+
+void test_timer_slack()
+{
+    easy::IOManager iom(1, false, "slack");
+    iom.schedule([]() {
+        easy::Timestamp start = easy::Timestamp::now(easy::Timestamp::MONOTONIC);
+        for (uint64_t ms : {20, 23, 31})
+        {
+            easy::IOManager::GetThis()->addTimer(
+                ms,
+                [start, ms]() {
+                    int64_t elapsed = easy::Timestamp::now(easy::Timestamp::MONOTONIC).microSecondsSinceEpoch() - start.microSecondsSinceEpoch();
+                    ELOG_INFO(logger) << "slack 16ms timer " << ms << "ms fired after " << elapsed << "us";
+                },
+                false,
+                false,
+                16);
+        }
+    });
+}
+
+void test_timer_stats()
+{
+    easy::IOManager iom(2, false, "timer_stats");
+    for (uint64_t ms : {1, 5, 10})
+    {
+        iom.addTimer(ms, [ms]() { usleep(static_cast<useconds_t>(ms * 100)); });
+    }
+    iom.addTimer(1000, []() {})->cancel();
+    easy::Timer::ptr repeating = iom.addTimer(2, []() {}, true);
+    iom.addTimer(15, [repeating]() { repeating->cancel(); });
+    iom.addTimer(30, [&iom]() { ELOG_INFO(logger) << "timer stats:\n" << iom.timerStats().toYamlString(); });
+}
+
+static easy::AtomicInt<uint64_t> s_fired{0};
+
+void bench_timer(const char* name, bool nonblocking)
+{
+    size_t n = 100 * 1000;
+    s_fired.set(0);
+    easy::Timestamp start = easy::Timestamp::now();
+    {
+        easy::IOManager iom(1, false, name);
+        for (size_t i = 0; i < n; ++i)
+        {
+            iom.addTimer(
+                0, []() { s_fired.increment(); }, false, nonblocking);
+        }
+    }
+    easy::Timestamp end     = easy::Timestamp::now();
+    double          seconds = static_cast<double>(end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1000 / 1000;
+    printf("%12s:%f seconds, %lu timers, %12.2f timers/s\n", name, seconds, s_fired.get(), static_cast<double>(s_fired.get()) / seconds);
+}
+
+void bench_timer_queue(const char* kind)
+{
+    // the hooked read pattern: a timeout is added and cancelled while many others are outstanding
+    easy::Config::Lookup<std::string>("timer.queue")->setValue(kind);
+    const size_t                  kOutstanding = 1000 * 1000;
+    const size_t                  kOps         = 1000 * 1000;
+    easy::TimerManager            manager;
+    std::vector<easy::Timer::ptr> timers;
+    timers.reserve(kOutstanding);
+    easy::Timestamp start = easy::Timestamp::now();
+    for (size_t i = 0; i < kOutstanding; ++i)
+    {
+        timers.push_back(manager.addTimer(60 * 1000 + i % 3600 * 1000, []() {}));
+    }
+    easy::Timestamp added = easy::Timestamp::now();
+    for (size_t i = 0; i < kOps; ++i)
+    {
+        manager.addTimer(5000 + i % 1000, []() {})->cancel();
+    }
+    easy::Timestamp cycled = easy::Timestamp::now();
+    for (auto& timer : timers)
+    {
+        timer->cancel();
+    }
+    easy::Timestamp end = easy::Timestamp::now();
+
+    double add_seconds    = static_cast<double>(added.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1000 / 1000;
+    double cycle_seconds  = static_cast<double>(cycled.microSecondsSinceEpoch() - added.microSecondsSinceEpoch()) / 1000 / 1000;
+    double cancel_seconds = static_cast<double>(end.microSecondsSinceEpoch() - cycled.microSecondsSinceEpoch()) / 1000 / 1000;
+    printf("%12s:add %12.2f/s, add+cancel at 1M outstanding %12.2f/s, cancel %12.2f/s\n",
+        kind,
+        static_cast<double>(kOutstanding) / add_seconds,
+        static_cast<double>(kOps) / cycle_seconds,
+        static_cast<double>(kOutstanding) / cancel_seconds);
+    easy::Config::Lookup<std::string>("timer.queue")->setValue("set");
+}
+
+void bench_thread_timers(bool per_thread, int threads)
+{
+    // every thread runs the hooked read pattern, add a timeout and cancel it, and fires short timers
+    easy::Config::Lookup<bool>("iomanager.loop_per_thread")->setValue(true);
+    easy::Config::Lookup<bool>("iomanager.per_thread_timers")->setValue(per_thread);
+    const size_t kOps = 200 * 1000;
+    s_fired.set(0);
+    easy::Timestamp start = easy::Timestamp::now();
+    {
+        easy::IOManager iom(threads, false, "timers");
+        for (int t = 0; t < threads; ++t)
+        {
+            iom.schedule(
+                [kOps]() {
+                    easy::IOManager* self = easy::IOManager::GetThis();
+                    for (size_t i = 0; i < kOps; ++i)
+                    {
+                        self->addTimer(5000 + i % 1000, []() {})->cancel();
+                        if (i % 100 == 0)
+                        {
+                            self->addTimer(i % 7, []() { s_fired.increment(); });
+                        }
+                    }
+                },
+                iom.nextLoopThread());
+        }
+    }
+    easy::Timestamp end     = easy::Timestamp::now();
+    double          seconds = static_cast<double>(end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1000 / 1000;
+    printf("%2d threads %6s:%f seconds, %12.2f add+cancel/s, %lu fired\n",
+        threads,
+        per_thread ? "local" : "shared",
+        seconds,
+        static_cast<double>(kOps) * threads / seconds,
+        s_fired.get());
+    easy::Config::Lookup<bool>("iomanager.per_thread_timers")->setValue(false);
+    easy::Config::Lookup<bool>("iomanager.loop_per_thread")->setValue(false);
+}
+
+void bench_epoll_timers(bool epoll_timers)
+{
+    // per request timeouts of the same length, each new one is the earliest once the previous is cancelled
+    easy::Config::Lookup<bool>("iomanager.epoll_timers")->setValue(epoll_timers);
+    const size_t           kOps   = 200 * 1000;
+    easy::IOManager::Stats before = easy::IOManager::GetStats();
+    easy::Timestamp        start  = easy::Timestamp::now();
+    {
+        easy::IOManager iom(1, false, "timeouts");
+        iom.schedule([kOps]() {
+            easy::IOManager* self = easy::IOManager::GetThis();
+            for (size_t i = 0; i < kOps; ++i)
+            {
+                self->addTimer(3000, []() {})->cancel();
+            }
+        });
+    }
+    easy::Timestamp        end     = easy::Timestamp::now();
+    easy::IOManager::Stats after   = easy::IOManager::GetStats();
+    double                 seconds = static_cast<double>(end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1000 / 1000;
+    printf("%12s:%f seconds, %12.2f add+cancel/s, %.3f timerfd_settime per timer\n",
+        epoll_timers ? "epoll" : "timerfd",
+        seconds,
+        static_cast<double>(kOps) / seconds,
+        static_cast<double>(after.timerfdSets - before.timerfdSets) / static_cast<double>(kOps));
+    easy::Config::Lookup<bool>("iomanager.epoll_timers")->setValue(false);
+}
+
+void bench_timer_slack(uint64_t slack)
+{
+    // idle connection timeouts a little apart, each wants its own wakeup unless they may be late
+    const size_t kTimers = 2000;
+    s_fired.set(0);
+    easy::IOManager::Stats before = easy::IOManager::GetStats();
+    {
+        easy::IOManager iom(1, false, "slack");
+        iom.schedule([slack, kTimers]() {
+            easy::IOManager* self = easy::IOManager::GetThis();
+            for (size_t i = 0; i < kTimers; ++i)
+            {
+                self->addTimer(100 + i % 200, []() { s_fired.increment(); }, false, true, slack);
+            }
+        });
+    }
+    easy::IOManager::Stats after = easy::IOManager::GetStats();
+    printf("%6lums slack:%lu timers, %lu epoll_wait, %lu timerfd_settime\n",
+        slack,
+        s_fired.get(),
+        after.epollWaits - before.epollWaits,
+        after.timerfdSets - before.timerfdSets);
+}
+
+void bench_clock()
+{
+    const size_t kReads = 10 * 1000 * 1000;
+    const char*  names[] = {"realtime", "monotonic", "coarse", "loop"};
+    easy::Timestamp::setLoopTime(easy::Timestamp::now(easy::Timestamp::MONOTONIC));
+    for (int clock = easy::Timestamp::REALTIME; clock <= easy::Timestamp::LOOP; ++clock)
+    {
+        int64_t         sum   = 0;
+        easy::Timestamp start = easy::Timestamp::now(easy::Timestamp::MONOTONIC);
+        for (size_t i = 0; i < kReads; ++i)
+        {
+            sum += easy::Timestamp::now(static_cast<easy::Timestamp::Clock>(clock)).microSecondsSinceEpoch();
+        }
+        easy::Timestamp end = easy::Timestamp::now(easy::Timestamp::MONOTONIC);
+        double          ns  = static_cast<double>(end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) * 1000 / kReads;
+        printf("%12s:%8.2f ns per read%s\n", names[clock], ns, sum ? "" : " ");
+    }
+    easy::Timestamp::setLoopTime(easy::Timestamp());
+}
+
+static easy::AtomicInt<uint64_t> s_done{0};
+
+void bench_burst(int threads)
+{
+    // one fiber posts tasks one by one, like handleEvent for a burst of ready fds
+    size_t n = 200 * 1000;
+    s_done.set(0);
+    easy::Timestamp start = easy::Timestamp::now();
+    {
+        easy::IOManager iom(threads, false, "burst");
+        iom.schedule([n]() {
+            for (size_t i = 0; i < n; ++i)
+            {
+                easy::IOManager::GetThis()->schedule([]() { s_done.increment(); });
+            }
+        });
+    }
+    easy::Timestamp end     = easy::Timestamp::now();
+    double          seconds = static_cast<double>(end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1000 / 1000;
+    printf("%2d threads %6s:%f seconds, %lu tasks, %12.2f tasks/s\n",
+        threads,
+        easy::Config::Lookup<bool>("iomanager.loop_per_thread")->value() ? "loops" : "shared",
+        seconds,
+        s_done.get(),
+        static_cast<double>(s_done.get()) / seconds);
+}
+
+void bench_echo(const char* mode, int pairs)
+{
+    // ping-pong over socketpairs, each side parks on every read, the pairs run concurrently
+    easy::Config::Lookup<bool>("iomanager.persistent_events")->setValue(!strcmp(mode, "persistent"));
+    easy::Config::Lookup<bool>("iomanager.io_uring")->setValue(!strcmp(mode, "io_uring"));
+    size_t                 n      = 20 * 1000 / static_cast<size_t>(pairs);
+    easy::IOManager::Stats before = easy::IOManager::GetStats();
+    easy::Timestamp        start  = easy::Timestamp::now();
+    {
+        easy::IOManager iom(1, false, "echo");
+        for (int i = 0; i < pairs; ++i)
+        {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+            {
+                ELOG_ERROR(logger) << "socketpair errno=" << errno;
+                return;
+            }
+            easy::FdMgr::GetInstance()->getFdCtx(fds[0], true);
+            easy::FdMgr::GetInstance()->getFdCtx(fds[1], true);
+            iom.schedule([fds]() {
+                char c = 0;
+                while (read(fds[1], &c, 1) == 1 && write(fds[1], &c, 1) == 1) {}
+                close(fds[1]);
+            });
+            iom.schedule([fds, n]() {
+                char c = 'x';
+                for (size_t j = 0; j < n; ++j)
+                {
+                    if (write(fds[0], &c, 1) != 1 || read(fds[0], &c, 1) != 1)
+                    {
+                        break;
+                    }
+                }
+                close(fds[0]);
+            });
+        }
+    }
+    easy::Timestamp        end     = easy::Timestamp::now();
+    easy::IOManager::Stats after   = easy::IOManager::GetStats();
+    double                 seconds = static_cast<double>(end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1000 / 1000;
+    double                 rounds  = static_cast<double>(n * static_cast<size_t>(pairs));
+    printf("%12s %2d pairs:%f seconds, %12.2f round trips/s, epoll_ctl=%.2f epoll_wait=%.2f io_uring_enter=%.2f per round trip\n",
+        mode,
+        pairs,
+        seconds,
+        rounds / seconds,
+        static_cast<double>(after.epollCtls - before.epollCtls) / rounds,
+        static_cast<double>(after.epollWaits - before.epollWaits) / rounds,
+        static_cast<double>(after.uringEnters - before.uringEnters) / rounds);
+    easy::Config::Lookup<bool>("iomanager.persistent_events")->setValue(false);
+    easy::Config::Lookup<bool>("iomanager.io_uring")->setValue(false);
+}
+
+void test_uring_accept()
+{
+    // connections come in through one multishot accept, connect and recv complete through io_uring too
+    easy::Config::Lookup<bool>("iomanager.io_uring")->setValue(true);
+    {
+        easy::IOManager iom(2, false, "uring");
+        ELOG_INFO(logger) << "io_uring enabled=" << iom.uringEnabled();
+        int listenfd = socket(AF_INET, SOCK_STREAM, 0);
+        easy::FdMgr::GetInstance()->getFdCtx(listenfd, true);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len        = sizeof(addr);
+        if (bind(listenfd, reinterpret_cast<sockaddr*>(&addr), len) || listen(listenfd, 64) ||
+            getsockname(listenfd, reinterpret_cast<sockaddr*>(&addr), &len))
+        {
+            ELOG_ERROR(logger) << "listen errno=" << errno;
+            return;
+        }
+        const int kClients = 8;
+        iom.schedule([listenfd, kClients]() {
+            for (int i = 0; i < kClients; ++i)
+            {
+                sockaddr_in peer;
+                socklen_t   peerlen = sizeof(peer);
+                int         fd      = accept(listenfd, reinterpret_cast<sockaddr*>(&peer), &peerlen);
+                char        buf[16] = {0};
+                ssize_t     n       = fd >= 0 ? recv(fd, buf, sizeof(buf) - 1, 0) : -1;
+                ELOG_INFO(logger) << "accepted fd=" << fd << " port=" << ntohs(peer.sin_port) << " recv=" << n << " " << buf;
+                close(fd);
+            }
+            close(listenfd);
+        });
+        for (int i = 0; i < kClients; ++i)
+        {
+            iom.schedule([addr, i]() {
+                int fd = socket(AF_INET, SOCK_STREAM, 0);
+                if (connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)))
+                {
+                    ELOG_ERROR(logger) << "connect errno=" << errno;
+                }
+                std::string msg = "hello " + std::to_string(i);
+                send(fd, msg.data(), msg.size(), 0);
+                close(fd);
+            });
+        }
+    }
+    easy::Config::Lookup<bool>("iomanager.io_uring")->setValue(false);
+}
+
 int main(int argc, char** argv)
 {
     test_timer();
+    test_inline_timer();
+    test_timer_wheel();
+    test_loop_per_thread();
+    test_loop_timers();
+    test_per_thread_timers();
+    test_epoll_timers();
+    test_timer_clock("monotonic");
+    test_timer_clock("coarse");
+    test_timer_clock("loop");
+    test_timer_slack();
+    test_timer_stats();
+    test_uring_accept();
+
+    logger->setLevel(easy::LogLevel::INFO);
+    ELOG_NAME("system")->setLevel(easy::LogLevel::INFO);
+    bench_timer("fiber", false);
+    bench_timer("inline", true);
+    easy::Config::Lookup<bool>("timer.stats")->setValue(false);
+    bench_timer("fiber-nostats", false);
+    bench_timer("inline-nostats", true);
+    easy::Config::Lookup<bool>("timer.stats")->setValue(true);
+    bench_timer_queue("set");
+    bench_timer_queue("wheel");
+    bench_clock();
+    bench_epoll_timers(false);
+    bench_epoll_timers(true);
+    bench_timer_slack(0);
+    bench_timer_slack(50);
+    for (int threads = 2; threads <= 4; threads <<= 1)
+    {
+        bench_thread_timers(false, threads);
+        bench_thread_timers(true, threads);
+    }
+    for (int threads = 1; threads <= 4; threads <<= 1)
+    {
+        bench_burst(threads);
+    }
+    easy::Config::Lookup<bool>("iomanager.loop_per_thread")->setValue(true);
+    for (int threads = 2; threads <= 4; threads <<= 1)
+    {
+        bench_burst(threads);
+    }
+    easy::Config::Lookup<bool>("iomanager.loop_per_thread")->setValue(false);
+    for (int pairs : {1, 64})
+    {
+        bench_echo("oneshot", pairs);
+        bench_echo("persistent", pairs);
+        bench_echo("io_uring", pairs);
+    }
     return 0;
 }
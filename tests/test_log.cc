@@ -1,18 +1,64 @@
+#include "easy/base/FileUtil.h"
 #include "easy/base/LogAppender.h"
 #include "easy/base/LogFormatter.h"
 #include "easy/base/Logger.h"
+#include "easy/base/Macro.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
 #include <memory>
+#include <new>
+#include <sstream>
+#include <vector>
 
-void bench(const char* file, bool kLongLog)
+#ifdef EASY_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+// count every operator new of the process to show that logging does not allocate
+static std::atomic<uint64_t> s_allocs{0};
+
+// not inlined, gcc takes the free of a new expression or the delete of a malloc for a mismatch
+__attribute__((noinline)) void* operator new(size_t size)
+{
+    s_allocs.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+
+void bench(const char* file, bool kLongLog, bool async = false)
 {
     auto logger = std::make_shared<easy::Logger>("bench");
 
     easy::LogFormatter::ptr formatter = std::make_shared<easy::LogFormatter>("%m");  // only message
 
-    easy::FileLogAppender::ptr fileAppender = std::make_shared<easy::FileLogAppender>(file);
+    easy::AsyncFileLogAppender::ptr asyncAppender;
+    easy::LogAppender::ptr          fileAppender;
+    if (async)
+    {
+        asyncAppender = std::make_shared<easy::AsyncFileLogAppender>(file);
+        fileAppender  = asyncAppender;
+    }
+    else
+    {
+        fileAppender = std::make_shared<easy::FileLogAppender>(file);
+    }
 
     // easy::ConsoleLogAppender::ptr consoleAppender = std::make_shared<easy::ConsoleLogAppender>();
 
@@ -33,9 +79,14 @@ void bench(const char* file, bool kLongLog)
     {
         ELOG_DEBUG(logger) << content << (kLongLog ? longStr : empty) << i;
     }
+    if (asyncAppender)
+    {
+        asyncAppender->flush();  // on disk, like the sync appender
+    }
     easy::Timestamp end     = easy::Timestamp::now();
     double          seconds = static_cast<double>(easy::timeDifference(end, start)) / 1000;
-    printf("%12s:%f seconds, %ld bytes, %10.2f msg/s, %.2f MiB/s\n",
+    printf("%6s %12s:%f seconds, %ld bytes, %10.2f msg/s, %.2f MiB/s\n",
+        async ? "async" : "sync",
         file,
         seconds,
         n * len,
@@ -75,11 +126,545 @@ void test_logger()
     ELOG_INFO(root) << "root logger";
 }
 
+// the log lines, not the dropped counts
+static size_t count_lines(const char* file)
+{
+    std::ifstream ifs(file);
+    std::string   line;
+    size_t        lines = 0;
+    while (std::getline(ifs, line))
+    {
+        if (line.compare(0, 8, "dropped ") != 0)
+        {
+            ++lines;
+        }
+    }
+    return lines;
+}
+
+void test_async_appender()
+{
+    const char* file = "./test_async.log";
+    unlink(file);
+    auto logger = std::make_shared<easy::Logger>("async");
+    {
+        auto appender = std::make_shared<easy::AsyncFileLogAppender>(file, 4096, 1000, 2);
+        logger->addAppender(appender);
+        for (int i = 0; i < 10000; ++i)
+        {
+            ELOG_INFO(logger) << "async " << i;  // blocks while both buffers wait for the disk
+        }
+        appender->flush();
+        EASY_ASSERT(count_lines(file) == 10000);
+        EASY_ASSERT(appender->dropped() == 0);
+        logger->clearAppender();
+    }
+
+    unlink(file);
+    {
+        auto appender = std::make_shared<easy::AsyncFileLogAppender>(file, 4096, 1000, 2, easy::AsyncFileLogAppender::DROP);
+        logger->addAppender(appender);
+        for (int i = 0; i < 10000; ++i)
+        {
+            ELOG_INFO(logger) << "async " << i;
+        }
+        uint64_t dropped = appender->dropped();
+        logger->clearAppender();
+        appender.reset();  // the rest and the dropped count are written
+        size_t lines = count_lines(file);
+        EASY_ASSERT(lines + dropped == 10000);
+        std::cout << "test_async_appender dropped=" << dropped << std::endl;
+    }
+    unlink(file);
+}
+
+// appends the message of each record to a string
+class StringLogAppender : public easy::LogAppender
+{
+  public:
+    void log(const easy::Logger::ptr& logger, easy::LogLevel level, const easy::LogRecord::ptr& record) override
+    {
+        if (nested_)
+        {
+            nested_ = false;
+            ELOG_INFO(logger) << "nested";  // the thread local stream is busy, this one gets its own
+            inner_ = last_;
+        }
+        last_.assign(record->getStream().data(), record->getStream().length());
+    }
+
+    std::string toYamlString() override { return ""; }
+
+    std::string last_;
+    std::string inner_;
+    bool        nested_{false};
+};
+
+void test_log_stream()
+{
+    auto logger   = std::make_shared<easy::Logger>("stream");
+    auto appender = std::make_shared<StringLogAppender>();
+    logger->addAppender(appender);
+
+    ELOG_INFO(logger) << 0 << ' ' << -1 << ' ' << INT_MIN << ' ' << LLONG_MIN << ' ' << ULLONG_MAX << ' ' << static_cast<short>(-7);
+    EASY_ASSERT(appender->last_ == "0 -1 -2147483648 -9223372036854775808 18446744073709551615 -7");
+    ELOG_INFO(logger) << static_cast<unsigned char>(65) << static_cast<signed char>(66) << static_cast<uint8_t>('C') << std::setw(3)
+                      << static_cast<int8_t>('D');
+    EASY_ASSERT(appender->last_ == "ABC  D");  // characters as with std::ostream
+
+    ELOG_INFO(logger) << std::hex << 255 << ' ' << 1.5 << ' ' << true << ' ' << std::string("s") << ' ' << "c";
+    EASY_ASSERT(appender->last_ == "ff 1.5 1 s c");
+    // a manipulator does not leak into the next record
+    ELOG_INFO(logger) << 255;
+    EASY_ASSERT(appender->last_ == "255");
+
+    std::string big(easy::LogStream::kSize * 3, 'x');
+    ELOG_INFO(logger) << "big " << big << ' ' << 42;
+    EASY_ASSERT(appender->last_ == "big " + big + " 42");
+    ELOG_INFO(logger) << "small";
+    EASY_ASSERT(appender->last_ == "small");
+
+    ELOG_FMT_INFO(logger, "fmt %d %s", 7, big.c_str());
+    EASY_ASSERT(appender->last_ == "fmt 7 " + big);
+
+    appender->nested_ = true;
+    ELOG_INFO(logger) << "outer";
+    EASY_ASSERT(appender->inner_ == "nested");
+    EASY_ASSERT(appender->last_ == "outer");
+
+    // no allocation for a short message once the thread is warm
+    uint64_t begin = s_allocs.load();
+    for (int i = 0; i < 1000; ++i)
+    {
+        ELOG_DEBUG(logger) << "no alloc " << i << ' ' << std::string(10, 'y').size();
+    }
+    EASY_ASSERT(s_allocs.load() == begin);
+}
+
+static std::string format_line(const easy::LogFormatter& formatter, const easy::Logger::ptr& logger, const easy::LogRecord::ptr& record)
+{
+    easy::LogLine line;
+    formatter.format(line, logger, record->getLevel(), record);
+    return std::string(line.data(), line.length());
+}
+
+void test_log_formatter()
+{
+    auto logger = std::make_shared<easy::Logger>("fmt");
+    EASY_ASSERT(logger->getFormatter()->getPattern() == easy::DefaultLogFormatter::pattern());
+
+    easy::LogRecord record(logger.get(), easy::LogLevel::WARN, "dir/file.cc", 42, "func", 7, 1234, 56, easy::Timestamp::now(), "main");
+    record.getSS() << "hello " << -1;
+    easy::LogRecord::ptr ptr(easy::LogRecord::ptr(), &record);
+
+    // the fixed form against the fields of the record, the instructions against the fixed form
+    std::string expected = logger->getFormatter()->format(logger, easy::LogLevel::WARN, ptr);
+    size_t      date     = expected.find(']');
+    EASY_ASSERT(expected[0] == '[' && date == strlen("[2000-01-01 00:00:00.000000"));
+    EASY_ASSERT(expected.substr(date) == "] 1234 main 56 [WARN] [fmt] func file.cc:42 hello -1\n");
+    easy::LogFormatter tabs("[%d{%Y-%m-%d %H:%M:%S}]%T%t%T%N%T%C%T[%p]%T[%c]%T%f%T%F:%L%T%m%n");
+    std::string        tabbed = expected;
+    for (size_t i = tabbed.find(']'); i < tabbed.find("hello"); ++i)
+    {
+        tabbed[i] = tabbed[i] == ' ' ? '\t' : tabbed[i];
+    }
+    EASY_ASSERT(format_line(tabs, logger, ptr) == tabbed);
+
+    easy::LogFormatter others("%r|%p|%m|%%x");
+    EASY_ASSERT(others.error());
+    EASY_ASSERT(format_line(others, logger, ptr) == "7|WARN|hello -1|<<error_format %%>>x");
+
+    // two formats of a thread in the same second, each keeps its own date
+    easy::Timestamp    time(static_cast<int64_t>(86400) * easy::Timestamp::kMicroSecondsPerSecond * 365 + 42);
+    easy::LogRecord    dated(logger.get(), easy::LogLevel::INFO, "f.cc", 1, "f", 0, 0, 0, time, "t");
+    easy::LogFormatter year("%d{%Y}");
+    easy::LogFormatter seconds("%d{%S}");
+    easy::LogRecord::ptr datedPtr(easy::LogRecord::ptr(), &dated);
+    for (int i = 0; i < 2; ++i)
+    {
+        EASY_ASSERT(format_line(year, logger, datedPtr) == "1971.000042");
+        EASY_ASSERT(format_line(seconds, logger, datedPtr) == "00.000042");
+    }
+}
+
+static void log_rotated(const easy::Logger::ptr& logger, int i) { ELOG_BIN_INFO(logger, "rotated %d", i); }
+
+static void log_first(const easy::Logger::ptr& logger, int i) { ELOG_BIN_INFO(logger, "A int=%d", i); }
+
+static void log_second(const easy::Logger::ptr& logger, const char* s) { ELOG_BIN_INFO(logger, "B str=%s", s); }
+
+// a binary appender of file, the records of logger in the order of statements
+static void log_appended(const char* file, const std::function<void(const easy::Logger::ptr&)>& statements)
+{
+    auto logger = std::make_shared<easy::Logger>("appended");
+    auto binary = std::make_shared<easy::AsyncFileLogAppender>(
+        file, 4096, 1000, 2, easy::AsyncFileLogAppender::BLOCK, easy::AsyncFileLogAppender::BINARY);
+    logger->addAppender(binary);
+    statements(logger);
+    binary->flush();
+    logger->clearAppender();
+}
+
+void test_binary_log()
+{
+    auto logger   = std::make_shared<easy::Logger>("binary");
+    auto appender = std::make_shared<StringLogAppender>();
+    logger->addAppender(appender);
+
+    // a text appender formats the record on the calling thread
+    int x = 0;
+    ELOG_BIN_INFO(logger, "bin %d %ld %u %.2f %s %c|%5s|%-4d|%x|%%", 7, -3L, 4u, 2.5, "str", 'x', "ab", 9, 255);
+    EASY_ASSERT(appender->last_ == "bin 7 -3 4 2.50 str x|   ab|9   |ff|%");
+    ELOG_BIN_INFO(logger, "%*d %s %p", 4, 1, static_cast<const char*>(nullptr), static_cast<void*>(&x));
+    char pointer[32];
+    snprintf(pointer, sizeof(pointer), "%p", static_cast<void*>(&x));
+    EASY_ASSERT(appender->last_ == std::string("   1 (null) ") + pointer);
+    logger->setLevel(easy::LogLevel::WARN);
+    ELOG_BIN_INFO(logger, "%s", "filtered");
+    EASY_ASSERT(appender->last_ == std::string("   1 (null) ") + pointer);
+    logger->setLevel(easy::LogLevel::TRACE);
+    logger->clearAppender();
+
+    // a binary file, the records of both kinds and threads, the text is made offline
+    const char* file = "./test_binary.log";
+    unlink(file);
+    {
+        auto binary = std::make_shared<easy::AsyncFileLogAppender>(
+            file, 4096, 1000, 2, easy::AsyncFileLogAppender::BLOCK, easy::AsyncFileLogAppender::BINARY);
+        logger->addAppender(binary);
+        EASY_ASSERT(binary->toYamlString().find("mode: binary") != std::string::npos);
+        std::vector<easy::Thread::ptr> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.push_back(std::make_shared<easy::Thread>(
+                [logger]() {
+                    for (int i = 0; i < 1000; ++i)
+                    {
+                        ELOG_BIN_DEBUG(logger, "binary %d of %s", i, easy::Thread::GetCurrentThreadName());
+                    }
+                },
+                "bin" + std::to_string(t)));
+        }
+        for (auto& t : threads)
+        {
+            t->join();
+        }
+        ELOG_WARN(logger) << "text " << 42;
+        binary->flush();
+        logger->clearAppender();
+    }
+
+    easy::BinaryLogDecoder decoder("%p %c %N %m%n");
+    std::stringstream      text;
+    EASY_ASSERT(decoder.decode(file, text));
+    EASY_ASSERT(decoder.records() == 4001);
+    std::string line;
+    std::string last;
+    size_t      lines = 0;
+    size_t      bin1  = 0;
+    while (std::getline(text, line))
+    {
+        ++lines;
+        last = line;
+        if (line.compare(0, 25, "DEBUG binary bin1 binary ") == 0 && line.compare(line.size() - 8, 8, " of bin1") == 0)
+        {
+            ++bin1;
+        }
+    }
+    EASY_ASSERT(lines == 4001);
+    EASY_ASSERT(bin1 == 1000);
+    EASY_ASSERT(last == "WARN binary main text 42");
+
+    // a new file after a rotation starts with the sites and loggers the records use
+    const char* rotated = "./test_binary.log.1";
+    {
+        auto binary = std::make_shared<easy::AsyncFileLogAppender>(
+            file, 4096, 1000, 2, easy::AsyncFileLogAppender::BLOCK, easy::AsyncFileLogAppender::BINARY);
+        logger->addAppender(binary);
+        log_rotated(logger, 1);
+        binary->flush();
+        EASY_ASSERT(rename(file, rotated) == 0);
+        binary->reopen();
+        binary->flush();
+        log_rotated(logger, 2);
+        binary->flush();
+        logger->clearAppender();
+    }
+    easy::BinaryLogDecoder next("%p %c %m%n");
+    std::stringstream      nextText;
+    EASY_ASSERT(next.decode(file, nextText));
+    EASY_ASSERT(nextText.str() == "INFO binary rotated 2\n");
+    unlink(rotated);
+
+    // two processes append to one file, their ids of the same statements differ
+    unlink(file);
+    pid_t pid = fork();
+    EASY_ASSERT(pid >= 0);
+    if (pid == 0)
+    {
+        log_appended(file, [](const easy::Logger::ptr& l) {
+            log_first(l, 7);
+            log_second(l, "x");
+        });
+        _exit(0);
+    }
+    int status = 0;
+    EASY_ASSERT(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    log_appended(file, [](const easy::Logger::ptr& l) {
+        log_second(l, "y");
+        log_first(l, 8);
+    });
+    easy::BinaryLogDecoder appended("%c %m%n");
+    std::stringstream      appendedText;
+    EASY_ASSERT(appended.decode(file, appendedText));
+    EASY_ASSERT(appendedText.str() == "appended A int=7\nappended B str=x\nappended B str=y\nappended A int=8\n");
+
+    // the last entry cut by a crash
+    EASY_ASSERT(truncate(file, 10) == 0);
+    easy::BinaryLogDecoder cut;
+    std::stringstream      rest;
+    EASY_ASSERT(!cut.decode(file, rest));
+    unlink(file);
+}
+
+// the lines of a file, gunzipped if it is a .gz
+static std::vector<std::string> read_lines(const std::string& file)
+{
+    std::string data;
+    if (file.size() > 3 && file.compare(file.size() - 3, 3, ".gz") == 0)
+    {
+#ifdef EASY_HAS_ZLIB
+        gzFile gz = gzopen(file.c_str(), "rb");
+        char   buf[4096];
+        int    n;
+        while (gz && (n = gzread(gz, buf, sizeof(buf))) > 0)
+        {
+            data.append(buf, static_cast<size_t>(n));
+        }
+        gzclose(gz);
+#endif
+    }
+    else
+    {
+        std::ifstream ifs(file);
+        data.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+    std::vector<std::string> lines;
+    std::stringstream        ss(data);
+    std::string              line;
+    while (std::getline(ss, line))
+    {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+// the rolled files of dir, oldest first
+static std::vector<std::string> rolled_files(const std::string& dir)
+{
+    std::vector<std::string> files;
+    easy::FileUtil::ListAllFile(files, dir, "");
+    files.erase(std::remove_if(files.begin(), files.end(), [](const std::string& f) { return f.find(".log.") == std::string::npos; }), files.end());
+    std::sort(files.begin(), files.end(), [](const std::string& a, const std::string& b) {
+        // a .gz sorts with the name it had
+        std::string x = a.size() > 3 && a.compare(a.size() - 3, 3, ".gz") == 0 ? a.substr(0, a.size() - 3) : a;
+        std::string y = b.size() > 3 && b.compare(b.size() - 3, 3, ".gz") == 0 ? b.substr(0, b.size() - 3) : b;
+        return x.size() != y.size() ? x.size() < y.size() : x < y;  // .9 before .10
+    });
+    return files;
+}
+
+void test_log_roll()
+{
+    const std::string dir  = "./test_roll";
+    const std::string file = dir + "/roll.log";
+    easy::FileUtil::Rm(dir);
+    auto logger = std::make_shared<easy::Logger>("roll");
+
+    // by size, the 3 newest are kept and compressed, the lines go on across the files
+    {
+        easy::LogRollOptions roll;
+        roll.maxSize  = 4096;
+        roll.maxFiles = 3;
+        roll.compress = true;
+        auto appender = std::make_shared<easy::FileLogAppender>(file, roll);
+        appender->setFormatter(std::make_shared<easy::LogFormatter>("%m%n"));
+        EASY_ASSERT(appender->toYamlString().find("max_size: 4096") != std::string::npos);
+        logger->addAppender(appender);
+        for (int i = 0; i < 2000; ++i)
+        {
+            ELOG_INFO(logger) << "roll " << i;
+        }
+        logger->clearAppender();
+    }
+    easy::LogFileRoller::Drain();
+    std::vector<std::string> files = rolled_files(dir);
+    EASY_ASSERT(files.size() == 3);
+    std::vector<std::string> lines;
+    for (auto& f : files)
+    {
+#ifdef EASY_HAS_ZLIB
+        EASY_ASSERT(f.compare(f.size() - 3, 3, ".gz") == 0);
+#endif
+        std::vector<std::string> part = read_lines(f);
+        size_t                   size = 0;
+        for (auto& l : part)
+        {
+            size += l.size() + 1;
+        }
+        EASY_ASSERT(size <= 4096);
+        lines.insert(lines.end(), part.begin(), part.end());
+    }
+    std::vector<std::string> current = read_lines(file);
+    lines.insert(lines.end(), current.begin(), current.end());
+    int first = 2000 - static_cast<int>(lines.size());
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        EASY_ASSERT(lines[i] == "roll " + std::to_string(first + static_cast<int>(i)));
+    }
+    easy::FileUtil::Rm(dir);
+
+    // an async binary file rolls on its background thread, every file decodes alone
+    {
+        easy::LogRollOptions roll;
+        roll.maxSize  = 8192;
+        auto appender = std::make_shared<easy::AsyncFileLogAppender>(
+            file, 4096, 1000, 2, easy::AsyncFileLogAppender::BLOCK, easy::AsyncFileLogAppender::BINARY, roll);
+        logger->addAppender(appender);
+        for (int i = 0; i < 2000; ++i)
+        {
+            ELOG_BIN_INFO(logger, "async roll %d", i);
+        }
+        appender->flush();
+        logger->clearAppender();
+    }
+    files = rolled_files(dir);
+    EASY_ASSERT(files.size() > 1);
+    files.push_back(file);
+    uint64_t records = 0;
+    for (auto& f : files)
+    {
+        struct stat st;
+        EASY_ASSERT(stat(f.c_str(), &st) == 0 && st.st_size <= 8192 + 4096);
+        easy::BinaryLogDecoder decoder("%m%n");
+        std::stringstream      text;
+        EASY_ASSERT(decoder.decode(f, text));
+        EASY_ASSERT(text.str().find("unknown") == std::string::npos);
+        records += decoder.records();
+    }
+    EASY_ASSERT(records == 2000);
+    easy::FileUtil::Rm(dir);
+
+    // by time, the line after the end of the interval goes to a new file
+    {
+        easy::LogRollOptions roll;
+        roll.interval = 1;
+        auto appender = std::make_shared<easy::FileLogAppender>(file, roll);
+        appender->setFormatter(std::make_shared<easy::LogFormatter>("%m%n"));
+        logger->addAppender(appender);
+        ELOG_INFO(logger) << "before";
+        usleep(1100 * 1000);
+        ELOG_INFO(logger) << "after";
+        logger->clearAppender();
+    }
+    files = rolled_files(dir);
+    EASY_ASSERT(files.size() == 1);
+    EASY_ASSERT(read_lines(files[0]) == std::vector<std::string>{"before"});
+    EASY_ASSERT(read_lines(file) == std::vector<std::string>{"after"});
+    easy::FileUtil::Rm(dir);
+}
+
+// ns per line of the compiled instructions and the fixed template on the default pattern
+void bench_formatter()
+{
+    auto            logger = std::make_shared<easy::Logger>("bench");
+    easy::LogRecord record(logger.get(), easy::LogLevel::DEBUG, __FILE__, __LINE__, __FUNCTION__, 0, 1234, 56, easy::Timestamp::now(), "main");
+    record.getSS() << "Hello 0123456789 abcdefghijklmnopqrstuvwxyz " << 42;
+    easy::LogRecord::ptr ptr(easy::LogRecord::ptr(), &record);
+
+    const int n = 1000 * 1000;
+    // the same instructions as the default pattern, %T keeps it off the fixed form
+    easy::LogFormatter compiled("[%d{%Y-%m-%d %H:%M:%S}]%T%t%T%N%T%C%T[%p]%T[%c]%T%f%T%F:%L%T%m%n");
+    easy::LogLine      line;
+
+    easy::Timestamp start = easy::Timestamp::now();
+    for (int i = 0; i < n; ++i)
+    {
+        line.clear();
+        compiled.format(line, logger, easy::LogLevel::DEBUG, ptr);
+    }
+    easy::Timestamp compiledEnd = easy::Timestamp::now();
+    for (int i = 0; i < n; ++i)
+    {
+        line.clear();
+        easy::DefaultLogFormatter::format(line, easy::LogLevel::DEBUG, record);
+    }
+    easy::Timestamp fixedEnd = easy::Timestamp::now();
+
+    auto ns = [n](easy::Timestamp from, easy::Timestamp to) {
+        return static_cast<double>(to.microSecondsSinceEpoch() - from.microSecondsSinceEpoch()) * 1000 / n;
+    };
+    printf("formatter compiled %.1f ns/line, fixed %.1f ns/line\n", ns(start, compiledEnd), ns(compiledEnd, fixedEnd));
+}
+
+// the hot thread cost of ELOG_BIN_* on a binary appender against ELOG_FMT_* on a text one
+void bench_binary()
+{
+    const char* file = "./bench_binary.log";
+    for (int binary = 0; binary < 2; ++binary)
+    {
+        unlink(file);
+        auto logger   = std::make_shared<easy::Logger>("bench");
+        auto appender = std::make_shared<easy::AsyncFileLogAppender>(file,
+            static_cast<size_t>(easy::AsyncFileLogAppender::kDefaultBufferSize),  // make_shared takes it by reference
+            1000,
+            16,
+            easy::AsyncFileLogAppender::BLOCK,
+            binary ? easy::AsyncFileLogAppender::BINARY : easy::AsyncFileLogAppender::TEXT);
+        logger->addAppender(appender);
+
+        const int       n     = 1000 * 1000;
+        easy::Timestamp start = easy::Timestamp::now();
+        for (int i = 0; i < n; ++i)
+        {
+            if (binary)
+            {
+                ELOG_BIN_DEBUG(logger, "Hello %s %d", "0123456789 abcdefghijklmnopqrstuvwxyz", i);
+            }
+            else
+            {
+                ELOG_FMT_DEBUG(logger, "Hello %s %d", "0123456789 abcdefghijklmnopqrstuvwxyz", i);
+            }
+        }
+        easy::Timestamp logged = easy::Timestamp::now();
+        appender->flush();
+        easy::Timestamp end = easy::Timestamp::now();
+        struct stat     st;
+        stat(file, &st);
+        printf("%6s async: %.1f ns/msg logged, %.1f ns/msg on disk, %ld bytes\n",
+            binary ? "binary" : "text",
+            static_cast<double>(logged.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) * 1000 / n,
+            static_cast<double>(end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) * 1000 / n,
+            static_cast<long>(st.st_size));
+    }
+    unlink(file);
+}
+
 int main()
 {
     test_logger();
+    test_log_stream();
+    test_log_formatter();
+    test_async_appender();
+    test_binary_log();
+    test_log_roll();
+    bench_formatter();
+    bench_binary();
     bench("/dev/null", false);
     bench("/tmp/log", false);
     bench("./bench.log", false);
+    bench("/dev/null", false, true);
+    bench("/tmp/log", false, true);
+    bench("./bench.log", false, true);
     return 0;
 }
@@ -1,6 +1,31 @@
+#include "easy/base/FiberMutex.h"
+#include "easy/base/IOManager.h"
 #include "easy/base/Logger.h"
 #include "easy/base/Macro.h"
 #include "easy/base/Scheduler.h"
+#include "easy/base/Timestamp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <deque>
+#include <new>
+
+// count every operator new of the process to show allocations per posted task
+static std::atomic<uint64_t> s_allocs{0};
+
+void* operator new(size_t size)
+{
+    s_allocs.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
 
 static easy::Logger::ptr logger = ELOG_ROOT();
 
@@ -14,6 +39,362 @@ void test_fiber()
     }
 }
 
+static easy::AtomicInt<uint64_t> s_done{0};
+
+void work()
+{
+    volatile uint64_t x = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        x = x + static_cast<uint64_t>(i);
+    }
+    s_done.increment();
+}
+
+void fan_out(size_t n)
+{
+    // children land in this worker's deque, idle workers steal them
+    for (size_t i = 0; i < n; ++i)
+    {
+        easy::Scheduler::GetThis()->schedule(&work);
+    }
+}
+
+void bench(int threads)
+{
+    size_t          n     = 200 * 1000;
+    size_t          fans  = 16;
+    easy::Scheduler sc(threads, false, "bench");
+    s_done.set(0);
+    easy::Timestamp start = easy::Timestamp::now();
+    sc.start();
+    for (size_t i = 0; i < fans; ++i)
+    {
+        sc.schedule(std::bind(&fan_out, n / fans));
+    }
+    sc.stop();
+    easy::Timestamp end     = easy::Timestamp::now();
+    double          seconds = static_cast<double>(end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1000 / 1000;
+    printf("%2d threads:%f seconds, %lu tasks, %12.2f tasks/s\n", threads, seconds, s_done.get(), static_cast<double>(s_done.get()) / seconds);
+}
+
+static const size_t kChains = 16;
+static const size_t kWarmUp = 10 * 1000;
+
+static std::atomic<uint64_t> s_allocs_begin{0};
+static std::atomic<uint64_t> s_allocs_end{0};
+
+void post_chain(easy::Scheduler* sc, easy::AtomicInt<uint64_t>* done, size_t total, size_t left)
+{
+    uint64_t count = done->incrementAndFetch();
+    if (count == kWarmUp)
+    {
+        s_allocs_begin = s_allocs.load();
+    }
+    else if (count == total)
+    {
+        s_allocs_end = s_allocs.load();
+    }
+    if (left)
+    {
+        // four words captured, more than the local storage of std::function
+        sc->schedule([sc, done, total, left]() { post_chain(sc, done, total, left - 1); });
+    }
+}
+
+// the baseline task path: std::function, new Task, std::deque, Fiber::ptr(NewFiber, FreeFiber)
+void bench_malloc_old(size_t n)
+{
+    struct OldTask
+    {
+        easy::Fiber::ptr      fiber_;
+        std::function<void()> cb_;
+        int                   threadId_;
+    };
+
+    easy::Fiber::GetThis();
+    easy::AtomicInt<uint64_t> done{0};
+    std::deque<OldTask*>      queue;
+    uint64_t                  begin = 0;
+    easy::Timestamp           start = easy::Timestamp::now();
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (i == kWarmUp)
+        {
+            begin = s_allocs.load();
+        }
+        easy::AtomicInt<uint64_t>* pdone = &done;
+        queue.push_back(new OldTask{nullptr,
+            [pdone, n, i]() {
+                if (i < n)
+                {
+                    pdone->increment();
+                }
+            },
+            -1});
+        OldTask* task = queue.front();
+        queue.pop_front();
+        easy::Fiber::ptr fiber(easy::NewFiber(task->cb_), easy::FreeFiber);
+        fiber->resume();
+        delete task;
+    }
+    uint64_t        end_allocs = s_allocs.load();
+    easy::Timestamp end        = easy::Timestamp::now();
+    double          seconds    = static_cast<double>(end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1000 / 1000;
+    printf("%12s:%f seconds, %lu tasks, %12.2f tasks/s, %.3f mallocs/task\n",
+        "old",
+        seconds,
+        n,
+        static_cast<double>(n) / seconds,
+        static_cast<double>(end_allocs - begin) / static_cast<double>(n - kWarmUp));
+}
+
+void bench_malloc_new()
+{
+    size_t                    total = kChains * 10000;
+    easy::AtomicInt<uint64_t> done{0};
+    easy::Scheduler           sc(1, false, "malloc");
+    easy::Timestamp           start = easy::Timestamp::now();
+    sc.start();
+    for (size_t i = 0; i < kChains; ++i)
+    {
+        sc.schedule(std::bind(&post_chain, &sc, &done, total, total / kChains - 1));
+    }
+    sc.stop();
+    easy::Timestamp end     = easy::Timestamp::now();
+    double          seconds = static_cast<double>(end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1000 / 1000;
+    printf("%12s:%f seconds, %lu tasks, %12.2f tasks/s, %.3f mallocs/task\n",
+        "new",
+        seconds,
+        done.get(),
+        static_cast<double>(done.get()) / seconds,
+        static_cast<double>(s_allocs_end.load() - s_allocs_begin.load()) / static_cast<double>(total - kWarmUp));
+}
+
+static const size_t kLockFibers = 64;
+
+void test_fiber_mutex()
+{
+    easy::FiberMutex mutex;
+    uint64_t         count = 0;
+    {
+        easy::Scheduler sc(4, false, "mutex");
+        sc.start();
+        for (size_t i = 0; i < kLockFibers; ++i)
+        {
+            sc.schedule([&mutex, &count]() {
+                for (int j = 0; j < 1000; ++j)
+                {
+                    easy::FiberMutexGuard _(mutex);
+                    uint64_t              value = count;
+                    if (j % 100 == 0)
+                    {
+                        // the holder parks, the others queue up behind it
+                        easy::Scheduler::GetThis()->schedule(easy::Fiber::GetThis(), easy::Scheduler::CurrentThreadId());
+                        easy::Fiber::YieldToHold();
+                    }
+                    count = value + 1;
+                }
+            });
+        }
+        sc.stop();
+    }
+    EASY_ASSERT(count == kLockFibers * 1000);
+    EASY_ASSERT(mutex.tryLock());
+    ELOG_INFO(logger) << "test_fiber_mutex count=" << count;
+}
+
+void test_fiber_condition()
+{
+    easy::FiberMutex     mutex;
+    easy::FiberCondition cond(mutex);
+    easy::FiberSemaphore slots(8);
+    std::deque<int>      queue;
+    uint64_t             sum      = 0;
+    size_t               consumed = 0;
+    const size_t         n        = 5000;
+    {
+        easy::Scheduler sc(4, false, "cond");
+        sc.start();
+        for (size_t i = 0; i < 4; ++i)
+        {
+            // producers, at most 8 items queued
+            sc.schedule([&, i]() {
+                for (size_t j = i; j < n; j += 4)
+                {
+                    slots.wait();
+                    easy::FiberMutexGuard _(mutex);
+                    queue.push_back(static_cast<int>(j));
+                    cond.notify();
+                }
+            });
+            sc.schedule([&]() {
+                for (;;)
+                {
+                    int value = 0;
+                    {
+                        easy::FiberMutexGuard _(mutex);
+                        while (queue.empty() && consumed < n)
+                        {
+                            cond.wait();
+                        }
+                        if (consumed == n)
+                        {
+                            cond.notifyAll();
+                            return;
+                        }
+                        value = queue.front();
+                        queue.pop_front();
+                        sum += static_cast<uint64_t>(value);
+                        ++consumed;
+                    }
+                    slots.notify();
+                }
+            });
+        }
+        sc.stop();
+    }
+    EASY_ASSERT(consumed == n);
+    EASY_ASSERT(sum == static_cast<uint64_t>(n) * (n - 1) / 2);
+    ELOG_INFO(logger) << "test_fiber_condition sum=" << sum;
+}
+
+void test_fiber_rwlock()
+{
+    easy::FiberRWLock         lock;
+    easy::AtomicInt<int>      readers{0};
+    easy::AtomicInt<int>      max_readers{0};
+    easy::AtomicInt<uint64_t> errors{0};
+    uint64_t                  value = 0;
+    {
+        easy::Scheduler sc(4, false, "rwlock");
+        sc.start();
+        for (size_t i = 0; i < kLockFibers; ++i)
+        {
+            sc.schedule([&, i]() {
+                for (int j = 0; j < 500; ++j)
+                {
+                    if ((i + static_cast<size_t>(j)) % 8 == 0)
+                    {
+                        easy::FiberWriteLockGuard _(lock);
+                        if (readers.get())
+                        {
+                            errors.increment();
+                        }
+                        ++value;
+                    }
+                    else
+                    {
+                        easy::FiberReadLockGuard _(lock);
+                        int now = readers.incrementAndFetch();
+                        if (now > max_readers.get())
+                        {
+                            max_readers.set(now);
+                        }
+                        // readers park together
+                        easy::Scheduler::GetThis()->schedule(easy::Fiber::GetThis(), easy::Scheduler::CurrentThreadId());
+                        easy::Fiber::YieldToHold();
+                        readers.decrement();
+                    }
+                }
+            });
+        }
+        sc.stop();
+    }
+    EASY_ASSERT(errors.get() == 0);
+    EASY_ASSERT(value == kLockFibers * 500 / 8);
+    ELOG_INFO(logger) << "test_fiber_rwlock writes=" << value << " max readers=" << max_readers.get();
+}
+
+// a fiber sleeping with the lock held does not stop the other fibers of its thread
+void test_fiber_mutex_sleep()
+{
+    easy::FiberMutex          mutex;
+    easy::AtomicInt<uint64_t> ticks{0};
+    uint64_t                  ticks_held = 0;
+    {
+        easy::IOManager iom(1, false, "sleep");
+        iom.schedule([&]() {
+            easy::FiberMutexGuard _(mutex);
+            easy::Fiber::SleepFor(50);
+            ticks_held = ticks.get();
+        });
+        iom.schedule([&]() {
+            easy::FiberMutexGuard _(mutex);  // parks until the sleeper is done
+        });
+        iom.schedule([&]() {
+            for (int i = 0; i < 10; ++i)
+            {
+                ticks.increment();
+                easy::Fiber::SleepFor(1);
+            }
+        });
+    }
+    EASY_ASSERT(ticks_held > 0);
+    ELOG_INFO(logger) << "test_fiber_mutex_sleep ticks while held=" << ticks_held;
+}
+
+template <typename Lock, typename Guard>
+void bench_lock(const char* name, int threads)
+{
+    size_t                    n = 200 * 1000;
+    Lock                      lock;
+    volatile uint64_t         count = 0;
+    easy::Scheduler           sc(threads, false, "lock");
+    easy::Timestamp           start = easy::Timestamp::now();
+    sc.start();
+    for (size_t i = 0; i < kLockFibers; ++i)
+    {
+        sc.schedule([&lock, &count, n]() {
+            for (size_t j = 0; j < n / kLockFibers; ++j)
+            {
+                Guard _(lock);
+                count = count + 1;
+            }
+        });
+    }
+    sc.stop();
+    easy::Timestamp end     = easy::Timestamp::now();
+    double          seconds = static_cast<double>(end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1000 / 1000;
+    printf("%14s %d threads:%f seconds, %lu ops, %12.2f ops/s\n", name, threads, seconds, count, static_cast<double>(count) / seconds);
+}
+
+// one write in 16
+template <typename Lock, typename ReadGuard, typename WriteGuard>
+void bench_rwlock(const char* name, int threads)
+{
+    size_t                    n = 200 * 1000;
+    Lock                      lock;
+    volatile uint64_t         writes = 0;
+    easy::AtomicInt<uint64_t> reads{0};
+    easy::Scheduler           sc(threads, false, "rwlock");
+    easy::Timestamp           start = easy::Timestamp::now();
+    sc.start();
+    for (size_t i = 0; i < kLockFibers; ++i)
+    {
+        sc.schedule([&lock, &writes, &reads, n, i]() {
+            for (size_t j = 0; j < n / kLockFibers; ++j)
+            {
+                if ((i + j) % 16 == 0)
+                {
+                    WriteGuard _(lock);
+                    writes = writes + 1;
+                }
+                else
+                {
+                    ReadGuard _(lock);
+                    reads.increment();
+                }
+            }
+        });
+    }
+    sc.stop();
+    easy::Timestamp end     = easy::Timestamp::now();
+    double          seconds = static_cast<double>(end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch()) / 1000 / 1000;
+    uint64_t        ops     = writes + reads.get();
+    printf("%14s %d threads:%f seconds, %lu ops, %12.2f ops/s\n", name, threads, seconds, ops, static_cast<double>(ops) / seconds);
+}
+
 int main(int argc, char** argv)
 {
     ELOG_INFO(logger) << "main";
@@ -24,5 +405,26 @@ int main(int argc, char** argv)
     sc.schedule(&test_fiber);
     sc.stop();
     ELOG_INFO(logger) << "over";
+
+    logger->setLevel(easy::LogLevel::INFO);
+    ELOG_NAME("system")->setLevel(easy::LogLevel::INFO);
+    for (int threads = 1; threads <= 8; threads <<= 1)
+    {
+        bench(threads);
+    }
+    bench_malloc_old(kChains * 10000);
+    bench_malloc_new();
+
+    test_fiber_mutex();
+    test_fiber_condition();
+    test_fiber_rwlock();
+    test_fiber_mutex_sleep();
+    for (int threads = 1; threads <= 4; threads <<= 1)
+    {
+        bench_lock<easy::MutexLock, easy::MutexLockGuard>("MutexLock", threads);
+        bench_lock<easy::FiberMutex, easy::FiberMutexGuard>("FiberMutex", threads);
+        bench_rwlock<easy::ReadWriteLock, easy::ReadLockGuard, easy::WriteLockGuard>("ReadWriteLock", threads);
+        bench_rwlock<easy::FiberRWLock, easy::FiberReadLockGuard, easy::FiberWriteLockGuard>("FiberRWLock", threads);
+    }
     return 0;
 }
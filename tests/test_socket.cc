@@ -1,5 +1,5 @@
 #include "easy/base/IOManager.h"
-#include "easy/base/logger.h"
+#include "easy/base/Logger.h"
 #include "easy/net/Socket.h"
 
 static easy::Logger::ptr logger = ELOG_ROOT();